@@ -0,0 +1,1089 @@
+// picconv_bench：各子系统的微基准（-DPICCONV_BUILD_BENCH=ON 时构建）
+//
+// 用法：picconv_bench [--isa name] <name> [args...]，不带参数时列出所有基准。
+// --isa 强制使用指定的 SIMD kernel 集合（默认按 cpuid 选择）。
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <csignal>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+#include "image.h"
+#include "resample.h"
+#include "renderer.h"
+#include "cell_moments.h"
+#include "glyph_eval.h"
+#include "ansi_emitter.h"
+#include "TaskSystem.h"
+#include "CpuDispatch.h"
+#include "timing.h"
+#include "Logger.h"
+#include "OutputSink.h"
+#include "Server.h"
+#include "ServeProtocol.h"
+#include "convert.h"
+#include "batch.h"
+#include "jpeg_decoder.h"
+#include "RenderCache.h"
+#include "plane_file.h"
+#include "stb_image.h"
+
+// ---- 全局分配计数（覆盖 operator new/delete） ----
+static std::atomic<uint64_t> g_allocs{0};
+static std::atomic<uint64_t> g_alloc_bytes{0};
+
+// 所有形式的 new/delete 都经过同一对 malloc/free 包装，避免分配与释放函数不配对（-Wmismatched-new-delete）
+static void* counted_alloc(size_t n) {
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    g_alloc_bytes.fetch_add(n, std::memory_order_relaxed);
+    if (void* p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+static void counted_free(void* p) noexcept { std::free(p); }
+
+void* operator new(size_t n) { return counted_alloc(n); }
+void* operator new[](size_t n) { return counted_alloc(n); }
+void operator delete(void* p) noexcept { counted_free(p); }
+void operator delete[](void* p) noexcept { counted_free(p); }
+void operator delete(void* p, size_t) noexcept { counted_free(p); }
+void operator delete[](void* p, size_t) noexcept { counted_free(p); }
+
+struct AllocScope {
+    uint64_t a0 = g_allocs.load(), b0 = g_alloc_bytes.load();
+    uint64_t allocs() const { return g_allocs.load() - a0; }
+    uint64_t bytes() const { return g_alloc_bytes.load() - b0; }
+};
+
+// 确定性的合成 RGB 图像（平滑渐变 + 高频纹理 + 平坦区域）
+static Image make_synthetic_image(int w, int h) {
+    Image img;
+    img.width = w; img.height = h; img.channels = 3;
+    img.pixels.resize((size_t)w * h * 3);
+    uint32_t seed = 12345;
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            uint8_t* p = &img.pixels[((size_t)y * w + x) * 3];
+            if (y < h / 5) { p[0] = 120; p[1] = 170; p[2] = 230; continue; }
+            seed = seed * 1664525u + 1013904223u;
+            p[0] = (uint8_t)(x * 255 / w);
+            p[1] = (uint8_t)(y * 255 / h);
+            p[2] = (uint8_t)(((x / 16 + y / 16) & 1) ? (seed >> 24) : 40);
+        }
+    }
+    return img;
+}
+
+static int arg_int(int argc, char** argv, int idx, int def) {
+    return idx < argc ? std::atoi(argv[idx]) : def;
+}
+
+// alloc [threads] [chunks] [rounds]：join 方式的堆分配次数对比
+static int bench_alloc(int argc, char** argv) {
+    int threads = arg_int(argc, argv, 2, 8);
+    int chunks = arg_int(argc, argv, 3, 256);
+    int rounds = arg_int(argc, argv, 4, 20);
+    PicConvertor::TaskSystem pool(threads);
+    pool.preheat();
+    std::vector<uint64_t> sink(chunks);
+
+    auto report = [&](const char* name, auto&& round) {
+        round(); // 预热（节点池 slab、vector 容量等）
+        AllocScope scope;
+        Stopwatch sw;
+        for (int r = 0; r < rounds; ++r) round();
+        uint64_t us = sw.elapsed_us();
+        std::printf("  %-40s %10.1f allocs/round %10.1f KB/round %8.1f us/round\n", name,
+                    (double)scope.allocs() / rounds, (double)scope.bytes() / rounds / 1024.0, (double)us / rounds);
+    };
+
+    std::printf("alloc: threads=%d chunks=%d rounds=%d\n", threads, chunks, rounds);
+    report("submitTask + vector<future>", [&]() {
+        std::vector<std::future<void>> futs;
+        futs.reserve(chunks);
+        for (int c = 0; c < chunks; ++c) futs.push_back(pool.submitTask([c, &sink]() { sink[c] += c; }));
+        for (auto& f : futs) f.get();
+    });
+    report("submit(std::function) + wait_idle", [&]() {
+        for (int c = 0; c < chunks; ++c) pool.submit(std::function<void()>([c, &sink]() { sink[c] += c; }));
+        pool.wait_idle();
+    });
+    report("TaskGroup::run + wait", [&]() {
+        PicConvertor::TaskGroup group(pool);
+        for (int c = 0; c < chunks; ++c) group.run([c, &sink]() { sink[c] += c; });
+        group.wait();
+    });
+    report("parallel_for(grain=1)", [&]() {
+        pool.parallel_for(0, chunks, 1, [&](int64_t b, int64_t e) {
+            for (int64_t c = b; c < e; ++c) sink[c] += c;
+        });
+    });
+
+    // 完整 resample + render_high 流水线（包含输出缓冲等必要分配）
+    Image img = make_synthetic_image(3840, 2160);
+    int out_w = 160, out_h = 45;
+    report("resample_to_planes_fast + render_high", [&]() {
+        BlockPlanes planes = resample_to_planes_fast(img, out_w * 8, out_h * 8, pool, 0);
+        std::string s = render_high(planes, out_w, out_h, pool, 24, nullptr, false);
+        sink[0] += s.size();
+    });
+    return 0;
+}
+
+// 旧版逐字形求值（按 GDesc::type 分支、每字形 std::ceil 与整数除法），作为 glyph 基准的对照与正确性参照
+static CellChoice legacy_glyph_search(const CellMoments &cm, int prune_threshold) {
+    struct GDesc { int code; enum {H, V, Q, F, S} type; int level; int qidx; };
+    static const std::vector<GDesc> glyphs = [](){
+        std::vector<GDesc> g;
+        g.push_back({0x2588, GDesc::F, 0, 0});
+        g.push_back({0x20, GDesc::S, 0, 0});
+        g.push_back({0x2598, GDesc::Q, 0, 0});
+        g.push_back({0x259D, GDesc::Q, 0, 1});
+        g.push_back({0x2596, GDesc::Q, 0, 2});
+        g.push_back({0x259E, GDesc::Q, 0, 3});
+        for (int level = 8; level >= 1; --level) g.push_back({0x2580 + level, GDesc::H, level, 0});
+        const int vert_codes[8] = {0x258F,0x258E,0x258D,0x258C,0x258B,0x258A,0x2589,0x2588};
+        for (int i = 7; i >= 0; --i) g.push_back({vert_codes[i], GDesc::V, 8 - i, 0});
+        return g;
+    }();
+    const uint64_t tot = 64;
+    double best_err = 1e308;
+    CellChoice best{0x20, 0, 0, 0, 0, 0, 0};
+    for (const auto &gd : glyphs) {
+        uint64_t fg[3] = {0, 0, 0}, fgCnt = 0;
+        for (int c = 0; c < 3; ++c) {
+            const ChannelMoments &m = cm.ch[c];
+            if (gd.type == GDesc::H) { int rows = (int)std::ceil(gd.level * 8.0 / 8.0); fgCnt = 8 * rows; fg[c] = m.bottom_rows[rows - 1]; }
+            else if (gd.type == GDesc::V) { int cols = (int)std::ceil(gd.level * 8.0 / 8.0); fgCnt = 8 * cols; fg[c] = m.left_cols[cols - 1]; }
+            else if (gd.type == GDesc::Q) { fgCnt = 16; fg[c] = m.quad[gd.qidx]; }
+            else if (gd.type == GDesc::F) { fgCnt = tot; fg[c] = m.total; }
+        }
+        uint64_t bgCnt = tot - fgCnt;
+        int fq[3] = {0, 0, 0}, bq[3] = {0, 0, 0}, diff = 0;
+        for (int c = 0; c < 3; ++c) {
+            if (fgCnt > 0) fq[c] = (int)(fg[c] / fgCnt);
+            if (bgCnt > 0) bq[c] = (int)((cm.ch[c].total - fg[c]) / bgCnt);
+            diff += std::abs(fq[c] - bq[c]);
+        }
+        if (diff < prune_threshold) continue;
+        double err = 0.0;
+        for (int c = 0; c < 3; ++c) {
+            const double T = cm.ch[c].total, T2 = cm.ch[c].total_sq;
+            if (fgCnt > 0) {
+                double term_bg = 0.0;
+                if (bgCnt > 0) term_bg = (T - fg[c]) * (T - fg[c]) / (double)bgCnt;
+                err += T2 - (double)fg[c] * (double)fg[c] / (double)fgCnt - term_bg;
+            } else {
+                err += T2 - T * T / (double)bgCnt;
+            }
+        }
+        if (err < best_err) {
+            best_err = err;
+            best.cp = gd.code;
+            if (fgCnt > 0) { best.fr = fq[0]; best.fg = fq[1]; best.fb = fq[2]; }
+            if (bgCnt > 0) { best.br = bq[0]; best.bg = bq[1]; best.bb = bq[2]; }
+        }
+    }
+    return best;
+}
+
+// glyph [cols] [rows] [rounds] [prune]：glyph search 吞吐（cells/s），旧版逐字形循环 vs evaluate_glyphs
+static int bench_glyph(int argc, char** argv) {
+    int cols = arg_int(argc, argv, 2, 320);
+    int rows = arg_int(argc, argv, 3, 90);
+    int rounds = arg_int(argc, argv, 4, 20);
+    int prune = arg_int(argc, argv, 5, 24);
+    PicConvertor::TaskSystem pool(1);
+    Image img = make_synthetic_image(cols * 12, rows * 24);
+    BlockPlanes planes = resample_to_planes_fast(img, cols * 8, rows * 8, pool, 0);
+    std::vector<CellMoments> moments((size_t)cols * rows);
+    for (int y = 0; y < rows; ++y) compute_cell_moments_row(planes, 0, y, cols, &moments[(size_t)y * cols]);
+    const size_t cells = moments.size();
+    std::vector<CellChoice> a(cells), b(cells);
+
+    std::printf("glyph: %d x %d cells, rounds=%d, prune=%d, evaluator isa=%s\n", cols, rows, rounds, prune, PicConvertor::isaName(PicConvertor::activeIsa()));
+    Stopwatch sw;
+    for (int r = 0; r < rounds; ++r)
+        for (size_t i = 0; i < cells; ++i) a[i] = legacy_glyph_search(moments[i], prune);
+    double legacy_us = (double)sw.elapsed_us();
+    sw.reset();
+    GlyphEvalCounts counts{0, 0};
+    for (int r = 0; r < rounds; ++r) counts = evaluate_glyphs(moments.data(), (int)cells, prune, b.data());
+    double soa_us = (double)sw.elapsed_us();
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < cells; ++i) mismatches += std::memcmp(&a[i], &b[i], sizeof(CellChoice)) != 0;
+    auto rate = [&](double us) { return us > 0 ? (double)cells * rounds / us : 0.0; };
+    std::printf("  %-28s %10.2f Mcells/s\n", "legacy per-glyph loop", rate(legacy_us));
+    std::printf("  %-28s %10.2f Mcells/s  (%.2fx)\n", "evaluate_glyphs", rate(soa_us), soa_us > 0 ? legacy_us / soa_us : 0.0);
+    std::printf("  pruned %.1f%% of candidates, flat fast path %.1f%% of cells, mismatches=%zu\n",
+                100.0 * counts.skipped / ((double)cells * kGlyphCandidates), 100.0 * counts.flat / (double)cells, mismatches);
+    return mismatches == 0 ? 0 : 1;
+}
+
+// 旧版逐单元格式化（每次颜色变化构造 ostringstream、每个字形返回新 std::string，fg/bg 分两条 SGR）
+static std::string legacy_emit_rows(const std::vector<CellChoice> &cells, int cols, int rows) {
+    auto rgb = [](const char* prefix, int r, int g, int b) {
+        std::ostringstream ss;
+        ss << prefix << r << ";" << g << ";" << b << "m";
+        return ss.str();
+    };
+    auto utf8 = [](int code) {
+        std::string s;
+        s.push_back((char)(0xE0 | ((code >> 12) & 0x0F)));
+        s.push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+        s.push_back((char)(0x80 | (code & 0x3F)));
+        return code <= 0x7F ? std::string(1, (char)code) : s;
+    };
+    std::string out;
+    out.reserve((size_t)rows * cols * 12);
+    for (int y = 0; y < rows; ++y) {
+        int pb[3] = {-1, -1, -1}, pf[3] = {-1, -1, -1};
+        for (int x = 0; x < cols; ++x) {
+            const CellChoice &c = cells[(size_t)y * cols + x];
+            if (c.br != pb[0] || c.bg != pb[1] || c.bb != pb[2]) { out += rgb("\x1b[48;2;", c.br, c.bg, c.bb); pb[0] = c.br; pb[1] = c.bg; pb[2] = c.bb; }
+            if (c.fr != pf[0] || c.fg != pf[1] || c.fb != pf[2]) { out += rgb("\x1b[38;2;", c.fr, c.fg, c.fb); pf[0] = c.fr; pf[1] = c.fg; pf[2] = c.fb; }
+            out += utf8(c.cp);
+        }
+        out += "\x1b[0m";
+        out += '\n';
+    }
+    return out;
+}
+
+// emit [cols] [rows] [rounds]：render_high 输出组装（MB/s 与每轮分配），旧版 ostringstream vs AnsiRowWriter
+static int bench_emit(int argc, char** argv) {
+    int cols = arg_int(argc, argv, 2, 300);
+    int rows = arg_int(argc, argv, 3, 150);
+    int rounds = arg_int(argc, argv, 4, 20);
+    PicConvertor::TaskSystem pool(1);
+    Image img = make_synthetic_image(cols * 12, rows * 24);
+    BlockPlanes planes = resample_to_planes_fast(img, cols * 8, rows * 8, pool, 0);
+    std::vector<CellMoments> moments(cols);
+    std::vector<CellChoice> cells((size_t)cols * rows);
+    for (int y = 0; y < rows; ++y) {
+        compute_cell_moments_row(planes, 0, y, cols, moments.data());
+        evaluate_glyphs(moments.data(), cols, 24, &cells[(size_t)y * cols]);
+    }
+
+    std::printf("emit: %d x %d cells, rounds=%d\n", cols, rows, rounds);
+    size_t legacy_bytes = 0, new_bytes = 0;
+    auto report = [&](const char* name, size_t &bytes, auto &&round) {
+        round();
+        AllocScope scope;
+        Stopwatch sw;
+        for (int r = 0; r < rounds; ++r) bytes = round();
+        double us = (double)sw.elapsed_us();
+        std::printf("  %-28s %8.1f us/round %8.1f MB/s %10.1f allocs/round %8zu bytes\n", name, us / rounds,
+                    us > 0 ? (double)bytes * rounds / us : 0.0, (double)scope.allocs() / rounds, bytes);
+    };
+    report("ostringstream per color", legacy_bytes, [&]() { return legacy_emit_rows(cells, cols, rows).size(); });
+    std::string buf;
+    report("AnsiRowWriter", new_bytes, [&]() {
+        buf.resize((size_t)rows * ansi_row_bound(cols));
+        AnsiRowWriter w(&buf[0]);
+        for (int y = 0; y < rows; ++y) {
+            w.begin_row();
+            for (int x = 0; x < cols; ++x) {
+                const CellChoice &c = cells[(size_t)y * cols + x];
+                w.cell(c.cp, c.fr, c.fg, c.fb, c.br, c.bg, c.bb);
+            }
+            w.end_row();
+        }
+        return (size_t)(w.pos() - buf.data());
+    });
+    return 0;
+}
+
+// PruneStats 开/关时 render_high（measure_only）的吞吐差异；两种配置交替运行，各取最快一轮
+static int bench_stats(int argc, char** argv) {
+    int cols = arg_int(argc, argv, 2, 320);
+    int rows = arg_int(argc, argv, 3, 90);
+    int rounds = arg_int(argc, argv, 4, 20);
+    int threads = arg_int(argc, argv, 5, 2);
+    PicConvertor::TaskSystem pool(threads > 1 ? threads - 1 : 1);
+    Image img = make_synthetic_image(cols * 12, rows * 24);
+    BlockPlanes planes = resample_to_planes_fast(img, cols * 8, rows * 8, pool, 0);
+
+    std::printf("stats: %d x %d cells, rounds=%d, instrumentation %s\n", cols, rows, rounds,
+                PicConvertor::kInstrumentation ? "compiled in" : "compiled out");
+    PruneStats stats;
+    double best_off = 1e300, best_on = 1e300;
+    for (int r = 0; r < rounds; ++r) {
+        Stopwatch sw;
+        render_high(planes, cols, rows, pool, 24, nullptr, true);
+        best_off = std::min(best_off, (double)sw.elapsed_us());
+        sw.reset();
+        render_high(planes, cols, rows, pool, 24, &stats, true);
+        best_on = std::min(best_on, (double)sw.elapsed_us());
+    }
+    const double cells = (double)cols * rows;
+    std::printf("  %-28s %10.2f Mcells/s\n", "stats=nullptr", best_off > 0 ? cells / best_off : 0.0);
+    std::printf("  %-28s %10.2f Mcells/s  (%+.2f%%)\n", "PruneStats", best_on > 0 ? cells / best_on : 0.0,
+                best_off > 0 ? 100.0 * (best_on - best_off) / best_off : 0.0);
+    std::printf("  shards=%zu\n  %s\n", stats.shardCount(), format_prune_stats(stats).c_str());
+    return 0;
+}
+
+// render_low 的单元均值：旧版逐子像素标量累加 vs compute_cell_means_row
+static int bench_low(int argc, char** argv) {
+    int cols = arg_int(argc, argv, 2, 300);
+    int rows = arg_int(argc, argv, 3, 150);
+    int rounds = arg_int(argc, argv, 4, 50);
+    PicConvertor::TaskSystem pool(1);
+    Image img = make_synthetic_image(cols * 12, rows * 24);
+    BlockPlanes planes = resample_to_planes_fast(img, cols * 8, rows * 8, pool, 0);
+    const size_t cells = (size_t)cols * rows;
+    std::vector<uint8_t> a(cells * 3), b(cells * 3);
+
+    std::printf("low: %d x %d cells, rounds=%d, kernel isa=%s\n", cols, rows, rounds, PicConvertor::isaName(PicConvertor::activeIsa()));
+    Stopwatch sw;
+    for (int r = 0; r < rounds; ++r) {
+        for (int y = 0; y < rows; ++y) {
+            for (int x = 0; x < cols; ++x) {
+                long long sum[3] = {0, 0, 0};
+                for (int dy = 0; dy < 8; ++dy) {
+                    const size_t row = planes.cell_row(x, y, dy);
+                    for (int dx = 0; dx < 8; ++dx) {
+                        sum[0] += planes.r[row + dx]; sum[1] += planes.g[row + dx]; sum[2] += planes.b[row + dx];
+                    }
+                }
+                for (int c = 0; c < 3; ++c) a[c * cells + (size_t)y * cols + x] = (uint8_t)(sum[c] / 64);
+            }
+        }
+    }
+    double legacy_us = (double)sw.elapsed_us();
+    sw.reset();
+    for (int r = 0; r < rounds; ++r)
+        for (int y = 0; y < rows; ++y) {
+            const size_t o = (size_t)y * cols;
+            compute_cell_means_row(planes, 0, y, cols, &b[o], &b[cells + o], &b[2 * cells + o]);
+        }
+    double simd_us = (double)sw.elapsed_us();
+
+    auto rate = [&](double us) { return us > 0 ? (double)cells * rounds / us : 0.0; };
+    std::printf("  %-28s %10.2f Mcells/s\n", "scalar 8x8 loop", rate(legacy_us));
+    std::printf("  %-28s %10.2f Mcells/s  (%.2fx)\n", "compute_cell_means_row", rate(simd_us), simd_us > 0 ? legacy_us / simd_us : 0.0);
+    const bool same = a == b;
+    std::printf("  identical=%s\n", same ? "yes" : "no");
+    return same ? 0 : 1;
+}
+
+// --serve 的负载生成器：进程内启动 ConversionServer，clients 个线程各自保持一个连接顺序发送请求，
+// 统计端到端延迟分位数；另以"每次请求新建并预热 TaskSystem"模拟逐进程转换作为对照（不含 exec 与日志初始化）
+static int bench_serve(int argc, char** argv) {
+#ifdef _WIN32
+    (void)argc; (void)argv;
+    std::printf("serve: not supported on Windows\n");
+    return 0;
+#else
+    int clients = arg_int(argc, argv, 2, 4);
+    int requests = arg_int(argc, argv, 3, 100);
+    int width = arg_int(argc, argv, 4, 80);
+    int concurrency = arg_int(argc, argv, 5, 2);
+    const bool high = arg_int(argc, argv, 6, 1) != 0;
+    signal(SIGPIPE, SIG_IGN);
+
+    // 缩略图大小的输入，以内联 PPM 字节发送
+    Image img = make_synthetic_image(320, 240);
+    std::string ppm = "P6\n320 240\n255\n";
+    ppm.append((const char*)img.pixels.data(), img.pixels.size());
+
+    PicConvertor::TaskSystem pool;
+    pool.preheat();
+    PicConvertor::ConversionServer::Options options;
+    options.socketPath = "/tmp/picconv_bench_" + std::to_string((long)getpid()) + ".sock";
+    options.maxConcurrent = concurrency;
+    PicConvertor::ConversionServer server(pool, options);
+    std::string error;
+    if (!server.start(error)) { std::printf("serve: %s\n", error.c_str()); return 1; }
+
+    PicConvertor::ServeRequest request;
+    request.inlineData = true;
+    request.data = ppm;
+    request.width = width;
+    request.high = high;
+
+    auto percentiles = [](std::vector<double> &v, const char* name, double wall_us) {
+        std::sort(v.begin(), v.end());
+        auto at = [&](double p) { return v.empty() ? 0.0 : v[std::min(v.size() - 1, (size_t)(p * (double)(v.size() - 1) + 0.5))]; };
+        std::printf("  %-30s p50 %8.0f us  p99 %8.0f us  max %8.0f us  %8.1f req/s\n", name, at(0.50), at(0.99),
+                    v.empty() ? 0.0 : v.back(), wall_us > 0 ? (double)v.size() * 1e6 / wall_us : 0.0);
+    };
+
+    std::printf("serve: %d clients x %d requests, 320x240 inline PPM -> %d cols %s, server concurrency=%d, pool workers=%d\n",
+                clients, requests, width, high ? "high" : "low", concurrency, pool.workerCount());
+    std::atomic<int> errors{0};
+    // 先以单个客户端测服务延迟，再以 clients 个并发客户端测排队下的分位数
+    auto run_load = [&](int n) {
+        std::vector<std::vector<double>> per_client(n);
+        std::vector<std::thread> threads;
+        for (int c = 0; c < n; ++c) {
+            threads.emplace_back([&, c]() {
+                PicConvertor::ServeClient client;
+                std::string err;
+                if (!client.connect(options.socketPath, err)) { errors.fetch_add(requests); return; }
+                PicConvertor::CallbackSink discard([](const char*, size_t) {});
+                for (int r = 0; r < requests; ++r) {
+                    PicConvertor::ServeResult result;
+                    Stopwatch sw;
+                    if (!client.request(request, discard, result) || result.status != PicConvertor::ServeStatus::Ok) { errors.fetch_add(1); continue; }
+                    per_client[c].push_back((double)sw.elapsed_us());
+                }
+            });
+        }
+        for (auto &t : threads) t.join();
+        std::vector<double> all;
+        for (auto &v : per_client) all.insert(all.end(), v.begin(), v.end());
+        return all;
+    };
+    Stopwatch wall;
+    std::vector<double> single = run_load(1);
+    const double single_us = (double)wall.elapsed_us();
+    wall.reset();
+    std::vector<double> loaded = run_load(clients);
+    const double loaded_us = (double)wall.elapsed_us();
+    server.stop();
+
+    // 对照：每次请求重新创建线程池并解码、渲染（相当于逐进程转换中进程内的部分）
+    const int cold_requests = std::max(1, std::min(requests, 50));
+    std::vector<double> cold;
+    PicConvertor::CallbackSink discard([](const char*, size_t) {});
+    wall.reset();
+    for (int r = 0; r < cold_requests; ++r) {
+        Stopwatch sw;
+        PicConvertor::TaskSystem fresh;
+        fresh.preheat();
+        Image decoded;
+        decoded.load_from_memory((const uint8_t*)ppm.data(), ppm.size());
+        ConvertOptions opt;
+        opt.out_w = width;
+        opt.charset = high ? Charset::high : Charset::low;
+        convert_image(decoded, opt, fresh, discard);
+        cold.push_back((double)sw.elapsed_us());
+    }
+    const double cold_us = (double)wall.elapsed_us();
+
+    percentiles(single, "--serve, 1 client", single_us);
+    percentiles(loaded, ("--serve, " + std::to_string(clients) + " clients").c_str(), loaded_us);
+    percentiles(cold, "new TaskSystem per request", cold_us);
+    std::printf("  errors=%d\n", errors.load());
+    return errors.load() == 0 ? 0 : 1;
+#endif
+}
+
+// 批处理流水线：同一组 PPM 文件，逐张 解码 -> 转换 的顺序循环 vs run_batch 的三级重叠流水线
+static int bench_batch(int argc, char** argv) {
+    const int images = arg_int(argc, argv, 2, 48);
+    const int width = arg_int(argc, argv, 3, 80);
+    const bool high = arg_int(argc, argv, 4, 0) != 0;
+#ifdef _WIN32
+    const std::string dir = "picconv_bench_batch";
+#else
+    const std::string dir = "/tmp/picconv_bench_batch_" + std::to_string((long)getpid());
+#endif
+    std::filesystem::create_directories(dir);
+    std::vector<std::string> inputs;
+    for (int i = 0; i < images; ++i) {
+        // 尺寸交替，模拟混合大小的输入目录
+        const int w = (i % 3 == 0) ? 1920 : 1024, h = (i % 3 == 0) ? 1080 : 768;
+        Image img = make_synthetic_image(w, h);
+        const std::string path = dir + "/img" + std::to_string(i) + ".ppm";
+        FILE* f = std::fopen(path.c_str(), "wb");
+        if (!f) { std::printf("batch: cannot write %s\n", path.c_str()); return 1; }
+        std::fprintf(f, "P6\n%d %d\n255\n", w, h);
+        std::fwrite(img.pixels.data(), 1, img.pixels.size(), f);
+        std::fclose(f);
+        inputs.push_back(path);
+    }
+
+    ConvertOptions opt;
+    opt.out_w = width;
+    opt.charset = high ? Charset::high : Charset::low;
+    PicConvertor::TaskSystem pool;
+    pool.preheat();
+    PicConvertor::CallbackSink discard([](const char*, size_t) {});
+    std::printf("batch: %d PPM inputs (1920x1080 / 1024x768) -> %d cols %s, pool workers=%d\n",
+                images, width, high ? "high" : "low", pool.workerCount());
+
+    Stopwatch sw;
+    for (const std::string& path : inputs) {
+        Image img;
+        if (!img.load_from_file(path)) return 1;
+        convert_image(img, opt, pool, discard);
+    }
+    const double seq_us = (double)sw.elapsed_us();
+
+    BatchOptions bopt;
+    const BatchStats stats = run_batch(inputs, opt, bopt, pool, &discard);
+    std::printf("  sequential  %8.1f ms  %7.1f images/s\n", seq_us / 1e3, images * 1e6 / seq_us);
+    std::printf("  pipelined   %8.1f ms  %7.1f images/s  (%.2fx)\n", stats.wall_us / 1e3, images * 1e6 / (double)stats.wall_us,
+                seq_us / (double)stats.wall_us);
+    std::printf("%s", format_batch_stats(stats).c_str());
+    std::filesystem::remove_all(dir);
+    return stats.failed == 0 ? 0 : 1;
+}
+
+// 图像加载：stdio 读取 + 复制进 std::vector（旧路径）vs 映射文件解码并接管解码缓冲（Image::load_from_file）
+static int bench_load(int argc, char** argv) {
+    const int w = arg_int(argc, argv, 2, 6000);
+    const int h = arg_int(argc, argv, 3, 4000);
+    const int rounds = arg_int(argc, argv, 4, 5);
+#ifdef _WIN32
+    const std::string path = "picconv_bench_load.ppm";
+#else
+    const std::string path = "/tmp/picconv_bench_load_" + std::to_string((long)getpid()) + ".ppm";
+#endif
+    {
+        Image img = make_synthetic_image(w, h);
+        FILE* f = std::fopen(path.c_str(), "wb");
+        if (!f) { std::printf("load: cannot write %s\n", path.c_str()); return 1; }
+        std::fprintf(f, "P6\n%d %d\n255\n", w, h);
+        std::fwrite(img.pixels.data(), 1, img.pixels.size(), f);
+        std::fclose(f);
+    }
+    const double mb = (double)w * h * 3 / (1024.0 * 1024.0);
+    std::printf("load: %dx%d PPM (%.1f MB decoded), %d rounds\n", w, h, mb, rounds);
+
+    double copy_us = 0, adopt_us = 0;
+    uint64_t copy_bytes = 0, adopt_bytes = 0;
+    for (int r = 0; r < rounds; ++r) {
+        {
+            AllocScope scope;
+            Stopwatch sw;
+            int iw = 0, ih = 0, ic = 0;
+            unsigned char* data = stbi_load(path.c_str(), &iw, &ih, &ic, 3);
+            if (!data) return 1;
+            std::vector<uint8_t> pixels(data, data + (size_t)iw * ih * 3);
+            stbi_image_free(data);
+            copy_us += (double)sw.elapsed_us();
+            copy_bytes = scope.bytes();
+        }
+        {
+            AllocScope scope;
+            Stopwatch sw;
+            Image img;
+            if (!img.load_from_file(path)) return 1;
+            adopt_us += (double)sw.elapsed_us();
+            adopt_bytes = scope.bytes();
+        }
+    }
+    std::printf("  stbi_load + vector copy   %8.1f ms/load  %8.1f MB via operator new (peak ~2x decoded)\n", copy_us / rounds / 1e3, copy_bytes / (1024.0 * 1024.0));
+    std::printf("  mmap + adopt              %8.1f ms/load  %8.1f MB via operator new (peak ~1x decoded)\n", adopt_us / rounds / 1e3, adopt_bytes / (1024.0 * 1024.0));
+    std::remove(path.c_str());
+    return 0;
+}
+
+// ---- 最小 baseline JPEG 编码器（4:2:0，标准亮度表用于全部分量），只为 jpeg 基准生成输入 ----
+namespace {
+const uint8_t kBenchZigzag[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+const uint8_t kStdLumaQuant[64] = { // 自然顺序
+    16, 11, 10, 16, 24, 40, 51, 61,  12, 12, 14, 19, 26, 58, 60, 55,
+    14, 13, 16, 24, 40, 57, 69, 56,  14, 17, 22, 29, 51, 87, 80, 62,
+    18, 22, 37, 56, 68,109,103, 77,  24, 35, 55, 64, 81,104,113, 92,
+    49, 64, 78, 87,103,121,120,101,  72, 92, 95, 98,112,100,103, 99,
+};
+const uint8_t kStdDcBits[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+const uint8_t kStdDcVals[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+const uint8_t kStdAcBits[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+const uint8_t kStdAcVals[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa,
+};
+
+struct BenchJpegWriter {
+    std::vector<uint8_t> out;
+    uint32_t acc = 0;
+    int bits = 0;
+    uint16_t dc_code[12], ac_code[256];
+    uint8_t dc_len[12], ac_len[256];
+
+    static void make_codes(const uint8_t* nbits, const uint8_t* vals, uint16_t* code, uint8_t* len) {
+        int c = 0, k = 0;
+        for (int l = 1; l <= 16; ++l, c <<= 1)
+            for (int i = 0; i < nbits[l - 1]; ++i, ++k, ++c) { code[vals[k]] = (uint16_t)c; len[vals[k]] = (uint8_t)l; }
+    }
+    BenchJpegWriter() {
+        make_codes(kStdDcBits, kStdDcVals, dc_code, dc_len);
+        make_codes(kStdAcBits, kStdAcVals, ac_code, ac_len);
+    }
+    void byte(int b) { out.push_back((uint8_t)b); }
+    void word(int w) { byte(w >> 8); byte(w & 255); }
+    void put(uint32_t v, int n) {
+        acc = (acc << n) | (v & ((1u << n) - 1));
+        bits += n;
+        while (bits >= 8) {
+            const int b = (int)((acc >> (bits - 8)) & 255);
+            byte(b);
+            if (b == 0xFF) byte(0);
+            bits -= 8;
+        }
+    }
+    void flush() { if (bits > 0) put(0x7F, 8 - bits); }
+    static int magnitude(int v) { int n = 0; for (v = std::abs(v); v; v >>= 1) ++n; return n; }
+    void block(const int* q, int& pred) {
+        const int diff = q[0] - pred;
+        pred = q[0];
+        int n = magnitude(diff);
+        put(dc_code[n], dc_len[n]);
+        if (n) put((uint32_t)(diff < 0 ? diff - 1 : diff), n);
+        int run = 0;
+        for (int k = 1; k < 64; ++k) {
+            const int v = q[kBenchZigzag[k]];
+            if (v == 0) { ++run; continue; }
+            for (; run > 15; run -= 16) put(ac_code[0xF0], ac_len[0xF0]);
+            n = magnitude(v);
+            const int sym = (run << 4) | n;
+            put(ac_code[sym], ac_len[sym]);
+            put((uint32_t)(v < 0 ? v - 1 : v), n);
+            run = 0;
+        }
+        if (run) put(ac_code[0], ac_len[0]);
+    }
+};
+
+void bench_fdct_quant(const float* in, int stride, const int* quant, int* out) {
+    static float basis[8][8]; // basis[u][x] = C(u)/2 * cos((2x+1)uπ/16)
+    static bool init = false;
+    if (!init) {
+        for (int u = 0; u < 8; ++u)
+            for (int x = 0; x < 8; ++x) basis[u][x] = (float)(0.5 * (u ? 1.0 : std::sqrt(0.5)) * std::cos((2 * x + 1) * u * 3.14159265358979 / 16));
+        init = true;
+    }
+    float tmp[8][8];
+    for (int y = 0; y < 8; ++y)
+        for (int u = 0; u < 8; ++u) {
+            float s = 0;
+            for (int x = 0; x < 8; ++x) s += basis[u][x] * (in[y * stride + x] - 128.0f);
+            tmp[y][u] = s;
+        }
+    for (int v = 0; v < 8; ++v)
+        for (int u = 0; u < 8; ++u) {
+            float s = 0;
+            for (int y = 0; y < 8; ++y) s += basis[v][y] * tmp[y][u];
+            out[v * 8 + u] = (int)std::lround(s / quant[v * 8 + u]);
+        }
+}
+} // namespace
+
+// 4:2:0 baseline JPEG；restart_mcus > 0 时每隔该数量的 MCU 插入 RST 标记
+static std::vector<uint8_t> encode_bench_jpeg(const Image& img, int quality, int restart_mcus) {
+    const int w = img.width, h = img.height;
+    const int mw = (w + 15) / 16, mh = (h + 15) / 16;
+    const int pw = mw * 16, ph = mh * 16;
+    std::vector<float> Y((size_t)pw * ph), Cb((size_t)pw / 2 * ph / 2), Cr((size_t)pw / 2 * ph / 2);
+    for (int y = 0; y < ph; ++y)
+        for (int x = 0; x < pw; ++x) {
+            const uint8_t* p = &img.pixels[((size_t)std::min(y, h - 1) * w + std::min(x, w - 1)) * 3];
+            Y[(size_t)y * pw + x] = 0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2];
+            const size_t c = (size_t)(y / 2) * (pw / 2) + x / 2;
+            Cb[c] += 0.25f * (-0.168736f * p[0] - 0.331264f * p[1] + 0.5f * p[2] + 128);
+            Cr[c] += 0.25f * (0.5f * p[0] - 0.418688f * p[1] - 0.081312f * p[2] + 128);
+        }
+    int quant[64];
+    const int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+    for (int i = 0; i < 64; ++i) quant[i] = std::max(1, std::min(255, (kStdLumaQuant[i] * scale + 50) / 100));
+
+    BenchJpegWriter wr;
+    wr.word(0xFFD8);
+    wr.word(0xFFDB); wr.word(67); wr.byte(0);
+    for (int k = 0; k < 64; ++k) wr.byte(quant[kBenchZigzag[k]]);
+    wr.word(0xFFC0); wr.word(17); wr.byte(8); wr.word(h); wr.word(w); wr.byte(3);
+    wr.byte(1); wr.byte(0x22); wr.byte(0);
+    wr.byte(2); wr.byte(0x11); wr.byte(0);
+    wr.byte(3); wr.byte(0x11); wr.byte(0);
+    wr.word(0xFFC4); wr.word(2 + 17 + 12 + 17 + 162);
+    wr.byte(0x00); for (uint8_t b : kStdDcBits) wr.byte(b); for (uint8_t v : kStdDcVals) wr.byte(v);
+    wr.byte(0x10); for (uint8_t b : kStdAcBits) wr.byte(b); for (uint8_t v : kStdAcVals) wr.byte(v);
+    if (restart_mcus > 0) { wr.word(0xFFDD); wr.word(4); wr.word(restart_mcus); }
+    wr.word(0xFFDA); wr.word(12); wr.byte(3);
+    wr.byte(1); wr.byte(0x00); wr.byte(2); wr.byte(0x00); wr.byte(3); wr.byte(0x00);
+    wr.byte(0); wr.byte(63); wr.byte(0);
+
+    int pred[3] = {0, 0, 0};
+    int q[64];
+    const int total = mw * mh;
+    for (int m = 0; m < total; ++m) {
+        if (restart_mcus > 0 && m > 0 && m % restart_mcus == 0) {
+            wr.flush();
+            wr.word(0xFFD0 + (m / restart_mcus - 1) % 8);
+            pred[0] = pred[1] = pred[2] = 0;
+        }
+        const int mx = m % mw, my = m / mw;
+        for (int b = 0; b < 4; ++b) {
+            bench_fdct_quant(&Y[(size_t)(my * 16 + (b / 2) * 8) * pw + mx * 16 + (b % 2) * 8], pw, quant, q);
+            wr.block(q, pred[0]);
+        }
+        bench_fdct_quant(&Cb[(size_t)(my * 8) * (pw / 2) + mx * 8], pw / 2, quant, q);
+        wr.block(q, pred[1]);
+        bench_fdct_quant(&Cr[(size_t)(my * 8) * (pw / 2) + mx * 8], pw / 2, quant, q);
+        wr.block(q, pred[2]);
+    }
+    wr.flush();
+    wr.word(0xFFD9);
+    return std::move(wr.out);
+}
+
+// JPEG 解码：stb_image 全尺寸、内置解码器全尺寸与按 cols 个字符的采样网格在 DCT 域缩小，
+// 以及加上重采样的端到端耗时（restart > 0 时各段在线程池上并行）
+static int bench_jpeg(int argc, char** argv) {
+    const int w = arg_int(argc, argv, 2, 4000);
+    const int h = arg_int(argc, argv, 3, 3000);
+    const int cols = arg_int(argc, argv, 4, 160);
+    const int rounds = arg_int(argc, argv, 5, 5);
+    const int restart = arg_int(argc, argv, 6, 0);
+    const std::vector<uint8_t> jpeg = encode_bench_jpeg(make_synthetic_image(w, h), 85, restart);
+    PicConvertor::TaskSystem pool;
+    pool.preheat();
+    ConvertOptions opt;
+    opt.out_w = cols;
+    std::printf("jpeg: %dx%d 4:2:0 q85 (%.1f MB), cols=%d (grid %d px wide), restart=%d MCUs, %d rounds, pool workers=%d\n",
+                w, h, jpeg.size() / (1024.0 * 1024.0), cols, cols * 8, restart, rounds, pool.workerCount());
+
+    auto run = [&](const char* label, const DecodeHint& hint, bool resample) {
+        double us = 0;
+        uint64_t planes = 0;
+        size_t pixels = 0;
+        JpegDecodeInfo info;
+        for (int r = 0; r < rounds; ++r) {
+            AllocScope scope;
+            Stopwatch sw;
+            Image img;
+            if (!decode_jpeg(jpeg.data(), jpeg.size(), hint, img, &info)) { std::printf("  %s: decode failed\n", label); return; }
+            img.source_width = info.full_width;
+            img.source_height = info.full_height;
+            if (resample) prepare_frame(img, opt, pool);
+            us += (double)sw.elapsed_us();
+            planes = scope.bytes();
+            pixels = img.pixels.size();
+        }
+        std::printf("  %-34s %8.1f ms  1/%d -> %5dx%-5d  pixels %7.1f MB  planes %7.1f MB\n", label, us / rounds / 1e3,
+                    info.scale_denom, (info.full_width + info.scale_denom - 1) / info.scale_denom,
+                    (info.full_height + info.scale_denom - 1) / info.scale_denom, pixels / (1024.0 * 1024.0), planes / (1024.0 * 1024.0));
+    };
+    {
+        double us = 0;
+        int iw = 0, ih = 0, ic = 0;
+        for (int r = 0; r < rounds; ++r) {
+            Stopwatch sw;
+            unsigned char* data = stbi_load_from_memory(jpeg.data(), (int)jpeg.size(), &iw, &ih, &ic, 3);
+            if (!data) { us = -1; break; }
+            stbi_image_free(data);
+            us += (double)sw.elapsed_us();
+        }
+        if (us >= 0) std::printf("  %-34s %8.1f ms\n", "stb_image (full)", us / rounds / 1e3);
+        else std::printf("  %-34s unsupported by this stb_image build\n", "stb_image (full)");
+    }
+    opt.full_decode = true;
+    const DecodeHint full = decode_hint(opt, nullptr);
+    opt.full_decode = false;
+    const DecodeHint scaled = decode_hint(opt, nullptr);
+    const DecodeHint scaled_pool = decode_hint(opt, &pool);
+    run("built-in, full", full, false);
+    run("built-in, DCT-scaled", scaled, false);
+    run("built-in, DCT-scaled, pool", scaled_pool, false);
+    run("full + prepare_frame", full, true);
+    run("DCT-scaled + prepare_frame", scaled_pool, true);
+    return 0;
+}
+
+// 渲染缓存：未命中（哈希 + 解码 + 重采样 + 渲染 + 写入缓存）与命中（哈希 + 查找 + 从映射写出）的单次延迟。
+// 每轮使用不同的输出宽度，使未命中轮次不会互相命中
+static int bench_cache(int argc, char** argv) {
+#ifdef _WIN32
+    std::printf("cache: --cache-dir is not supported on Windows\n");
+    return 1;
+#else
+    const int w = arg_int(argc, argv, 2, 1920);
+    const int h = arg_int(argc, argv, 3, 1080);
+    const int cols = arg_int(argc, argv, 4, 160);
+    const int rounds = arg_int(argc, argv, 5, 20);
+    const bool high = arg_int(argc, argv, 6, 1) != 0;
+    const std::vector<uint8_t> jpeg = encode_bench_jpeg(make_synthetic_image(w, h), 85, 0);
+    const std::string dir = (std::filesystem::temp_directory_path() / ("picconv_bench_cache." + std::to_string(::getpid()))).string();
+    PicConvertor::RenderCache cache;
+    PicConvertor::RenderCache::Options cache_opt;
+    cache_opt.dir = dir;
+    std::string error;
+    if (!cache.open(cache_opt, error)) { std::printf("cache: %s\n", error.c_str()); return 1; }
+    PicConvertor::TaskSystem pool;
+    pool.preheat();
+    ConvertOptions opt;
+    opt.charset = high ? Charset::high : Charset::low;
+    std::printf("cache: %dx%d JPEG (%.1f MB) -> %d cols %s, %d rounds, pool workers=%d\n",
+                w, h, jpeg.size() / (1024.0 * 1024.0), cols, high ? "high" : "low", rounds, pool.workerCount());
+
+    size_t discarded = 0;
+    PicConvertor::CallbackSink discard([&](const char*, size_t n) { discarded += n; });
+    double miss_us = 0, hit_us = 0, hash_us = 0;
+    std::string copy;
+    for (int r = 0; r < rounds; ++r) {
+        opt.out_w = cols + r;
+        opt.out_h = 0;
+        Stopwatch sw;
+        const PicConvertor::RenderCacheKey key = PicConvertor::RenderCache::makeKey(jpeg.data(), jpeg.size(), render_options_hash(opt));
+        if (cache.lookup(key, discard)) { std::printf("  unexpected hit\n"); return 1; }
+        Image img;
+        if (!img.load_from_memory(jpeg.data(), jpeg.size(), decode_hint(opt, &pool))) { std::printf("  decode failed\n"); return 1; }
+        copy.clear();
+        PicConvertor::TeeSink tee(discard, copy);
+        convert_image(img, opt, pool, tee);
+        cache.store(key, copy, sw.elapsed_us());
+        miss_us += (double)sw.elapsed_us();
+    }
+    for (int r = 0; r < rounds; ++r) {
+        opt.out_w = cols + r;
+        Stopwatch sw;
+        const PicConvertor::RenderCacheKey key = PicConvertor::RenderCache::makeKey(jpeg.data(), jpeg.size(), render_options_hash(opt));
+        hash_us += (double)sw.elapsed_us();
+        if (!cache.lookup(key, discard)) { std::printf("  unexpected miss\n"); return 1; }
+        hit_us += (double)sw.elapsed_us();
+    }
+    std::printf("  miss (decode + render + store)  %9.1f us/image\n", miss_us / rounds);
+    std::printf("  hit (hash + lookup + write)     %9.1f us/image  (hash %.1f us, %.2f GB/s)  speedup x%.1f\n", hit_us / rounds,
+                hash_us / rounds, hash_us > 0 ? jpeg.size() * (double)rounds / hash_us / 1e3 : 0.0, hit_us > 0 ? miss_us / hit_us : 0.0);
+    std::printf("  %s\n", cache.formatStats().c_str());
+    cache.close();
+    std::filesystem::remove_all(dir);
+    return discarded > 0 ? 0 : 1;
+#endif
+}
+
+// 平面文件：每次都解码 + 重采样 + 渲染，与映射 --dump-planes 写出的文件后直接渲染的对比（调参时的典型循环）
+static int bench_planes(int argc, char** argv) {
+    const int w = arg_int(argc, argv, 2, 4000);
+    const int h = arg_int(argc, argv, 3, 3000);
+    const int cols = arg_int(argc, argv, 4, 240);
+    const int rounds = arg_int(argc, argv, 5, 5);
+    const std::vector<uint8_t> jpeg = encode_bench_jpeg(make_synthetic_image(w, h), 85, 0);
+    const std::string path = "/tmp/picconv_bench_planes_" + std::to_string((long)getpid()) + ".bin";
+    PicConvertor::TaskSystem pool;
+    pool.preheat();
+    ConvertOptions opt;
+    opt.out_w = cols;
+    opt.charset = Charset::high;
+    size_t discarded = 0;
+    PicConvertor::CallbackSink discard([&](const char*, size_t n) { discarded += n; });
+
+    double full_us = 0, map_us = 0, save_us = 0;
+    for (int r = 0; r < rounds; ++r) {
+        Stopwatch sw;
+        Image img;
+        if (!img.load_from_memory(jpeg.data(), jpeg.size(), decode_hint(opt, &pool))) { std::printf("planes: decode failed\n"); return 1; }
+        const PreparedFrame frame = prepare_frame(img, opt, pool);
+        render_frame(frame, opt, pool, discard);
+        full_us += (double)sw.elapsed_us();
+        if (r == 0) {
+            Stopwatch ss;
+            std::string error;
+            if (!save_planes(path, frame, error)) { std::printf("planes: %s\n", error.c_str()); return 1; }
+            save_us = (double)ss.elapsed_us();
+            std::printf("planes: %dx%d JPEG -> %dx%d cells high, file %.1f MB, %d rounds, pool workers=%d\n",
+                        w, h, frame.out_w, frame.out_h, frame.bytes() / (1024.0 * 1024.0), rounds, pool.workerCount());
+        }
+    }
+    for (int r = 0; r < rounds; ++r) {
+        Stopwatch sw;
+        PreparedFrame frame;
+        std::string error;
+        if (!map_planes(path, frame, error)) { std::printf("planes: %s\n", error.c_str()); return 1; }
+        render_frame(frame, opt, pool, discard);
+        map_us += (double)sw.elapsed_us();
+    }
+    std::filesystem::remove(path);
+    std::printf("  decode + resample + render   %9.1f ms\n", full_us / rounds / 1e3);
+    std::printf("  map planes + render          %9.1f ms  (speedup x%.1f; writing the file took %.1f ms once)\n",
+                map_us / rounds / 1e3, map_us > 0 ? full_us / map_us : 0.0, save_us / 1e3);
+    return discarded > 0 ? 0 : 1;
+}
+
+// 多宽度：逐个宽度从全分辨率源图像 convert_image，与 convert_image_multi（共享金字塔、一次提交）对比，
+// 并报告从金字塔重采样的平面与直接重采样的差异
+static int bench_pyramid(int argc, char** argv) {
+    const int w = arg_int(argc, argv, 2, 4000);
+    const int h = arg_int(argc, argv, 3, 3000);
+    const int rounds = arg_int(argc, argv, 4, 3);
+    const bool high = arg_int(argc, argv, 5, 1) != 0;
+    const std::vector<int> widths = {40, 60, 80, 120, 160, 240};
+    Image img = make_synthetic_image(w, h);
+    PicConvertor::TaskSystem pool;
+    pool.preheat();
+    ConvertOptions opt;
+    opt.charset = high ? Charset::high : Charset::low;
+    std::printf("pyramid: %dx%d -> widths 40,60,80,120,160,240 %s, %d rounds, pool workers=%d\n",
+                w, h, high ? "high" : "low", rounds, pool.workerCount());
+
+    std::vector<std::string> outputs(widths.size());
+    std::vector<std::unique_ptr<PicConvertor::StringSink>> sinks;
+    std::vector<RenderTarget> targets;
+    for (size_t i = 0; i < widths.size(); ++i) {
+        sinks.push_back(std::make_unique<PicConvertor::StringSink>(outputs[i]));
+        RenderTarget t;
+        t.out_w = widths[i];
+        t.sink = sinks.back().get();
+        targets.push_back(t);
+    }
+    double one_us = 0, each_us = 0, multi_us = 0;
+    for (int r = 0; r < rounds; ++r) {
+        for (auto& o : outputs) o.clear();
+        Stopwatch sw;
+        opt.out_w = widths.back();
+        convert_image(img, opt, pool, *sinks.back());
+        one_us += (double)sw.elapsed_us();
+        sw.reset();
+        for (size_t i = 0; i < widths.size(); ++i) {
+            opt.out_w = widths[i];
+            convert_image(img, opt, pool, *sinks[i]);
+        }
+        each_us += (double)sw.elapsed_us();
+        sw.reset();
+        convert_image_multi(img, opt, targets, pool);
+        multi_us += (double)sw.elapsed_us();
+    }
+    std::printf("  largest width only            %9.1f ms\n", one_us / rounds / 1e3);
+    std::printf("  each width from the source    %9.1f ms\n", each_us / rounds / 1e3);
+    std::printf("  convert_image_multi           %9.1f ms  (x%.2f of largest only, speedup x%.1f)\n", multi_us / rounds / 1e3,
+                one_us > 0 ? multi_us / one_us : 0.0, multi_us > 0 ? each_us / multi_us : 0.0);
+
+    // 精度：各宽度的 8x8 子像素平面，金字塔级 vs 源图像
+    const ImagePyramid pyramid = build_pyramid(img, widths.front() * 8, default_out_height(img, widths.front()) * 8, pool);
+    for (int cols : widths) {
+        const int rows = default_out_height(img, cols);
+        const int level = pyramid.best_level(cols * 8, rows * 8);
+        const BlockPlanes direct = resample_to_planes_fast(img, cols * 8, rows * 8, pool, 0);
+        const BlockPlanes reduced = resample_to_planes_fast(pyramid.level(level), cols * 8, rows * 8, pool, 0);
+        uint64_t sum = 0;
+        int worst = 0;
+        const PixelBuffer* a[3] = {&direct.r, &direct.g, &direct.b};
+        const PixelBuffer* b[3] = {&reduced.r, &reduced.g, &reduced.b};
+        for (int c = 0; c < 3; ++c)
+            for (size_t i = 0; i < a[c]->size(); ++i) {
+                const int d = std::abs((int)(*a[c])[i] - (int)(*b[c])[i]);
+                sum += (uint64_t)d;
+                worst = std::max(worst, d);
+            }
+        std::printf("  %4d cols: level %d  mean |diff| %.3f  max %d\n", cols, level, (double)sum / (3.0 * direct.r.size()), worst);
+    }
+    return 0;
+}
+
+// 日志开销：小图重采样（每次调用 3 条 INFO 记录）在日志开启与运行期关闭时的耗时，
+// 以及单条记录的调用方开销（字符串拼接 vs 结构化参数）。编译期关闭（-DPICCONV_LOG_LEVEL=OFF）时宏为空，等同于"off"下界
+static int bench_log(int argc, char** argv) {
+    const int rounds = arg_int(argc, argv, 2, 5000);
+    const int cols = arg_int(argc, argv, 3, 80);
+    auto& logger = PicConvertor::Logger::getInstance();
+    Image img = make_synthetic_image(320, 240);
+    const int rows = std::max(1, cols * 240 / 320 / 2);
+    PicConvertor::TaskSystem pool;
+    pool.preheat();
+    std::printf("log: 320x240 -> %dx%d cell resample, %d rounds, pool workers=%d, compiled level=%d\n",
+                cols, rows, rounds, pool.workerCount(), PICCONV_LOG_LEVEL);
+
+    auto time_resample = [&]() {
+        for (int i = 0; i < 50; ++i) resample_to_cells(img, cols, rows, pool);
+        Stopwatch sw;
+        for (int r = 0; r < rounds; ++r) resample_to_cells(img, cols, rows, pool);
+        return (double)sw.elapsed_us() / rounds;
+    };
+    // 调用方开销：每批 1000 条（小于环形缓冲容量），批间留时间让写线程取空，只计调用线程的时间
+    auto time_calls = [&](bool structured) {
+        constexpr int kBurst = 1000;
+        const int bursts = std::max(1, rounds / 250);
+        uint64_t total_us = 0;
+        for (int b = 0; b < bursts; ++b) {
+            Stopwatch sw;
+            for (int i = 0; i < kBurst; ++i) {
+                if (structured) PC_LOGF_INFO("bench record {} of {} ({}us)", i, kBurst, total_us);
+                else PC_LOG_INFO("bench record " + std::to_string(i) + " of " + std::to_string(kBurst) + " (" + std::to_string(total_us) + "us)");
+            }
+            total_us += sw.elapsed_us();
+            std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        }
+        return (double)total_us * 1e3 / ((double)bursts * kBurst);
+    };
+
+    logger.setLevel(PicConvertor::LogLevel::LOG_INFO);
+    const double on_us = time_resample();
+    const double on_concat_ns = time_calls(false);
+    const double on_struct_ns = time_calls(true);
+    logger.setLevel(PicConvertor::LogLevel::LOG_OFF);
+    const double off_us = time_resample();
+    const double off_concat_ns = time_calls(false);
+    const double off_struct_ns = time_calls(true);
+    logger.setLevel(PicConvertor::LogLevel::LOG_INFO);
+
+    std::printf("  resample, logging on    %8.2f us/call\n", on_us);
+    std::printf("  resample, logging off   %8.2f us/call  (logging overhead %+.1f%%)\n", off_us, off_us > 0 ? (on_us / off_us - 1.0) * 100.0 : 0.0);
+    std::printf("  PC_LOG_INFO(concat)     on %7.1f ns/record   off %6.1f ns\n", on_concat_ns, off_concat_ns);
+    std::printf("  PC_LOGF_INFO(fmt, ...)  on %7.1f ns/record   off %6.1f ns\n", on_struct_ns, off_struct_ns);
+    return 0;
+}
+
+struct BenchEntry {
+    const char* name;
+    int (*fn)(int, char**);
+    const char* usage;
+};
+
+static const BenchEntry kBenches[] = {
+    {"alloc", bench_alloc, "alloc [threads=8] [chunks=256] [rounds=20]  heap allocations per join round"},
+    {"glyph", bench_glyph, "glyph [cols=320] [rows=90] [rounds=20] [prune=24]  glyph search cells/s, legacy vs evaluate_glyphs"},
+    {"stats", bench_stats, "stats [cols=320] [rows=90] [rounds=20] [threads=2]  render_high throughput with PruneStats on vs off"},
+    {"low", bench_low, "low [cols=300] [rows=150] [rounds=50]  render_low cell means, scalar loop vs SIMD kernel"},
+    {"serve", bench_serve, "serve [clients=4] [requests=100] [width=80] [concurrency=2] [high=1]  --serve latency p50/p99 under load"},
+    {"log", bench_log, "log [rounds=5000] [cols=80]  resample and per-record cost with the async logger on vs off"},
+    {"load", bench_load, "load [width=6000] [height=4000] [rounds=5]  image load, stdio + copy vs mmap + adopted decoder buffer"},
+    {"jpeg", bench_jpeg, "jpeg [width=4000] [height=3000] [cols=160] [rounds=5] [restart=0]  JPEG decode, full vs DCT-domain scaled"},
+    {"cache", bench_cache, "cache [width=1920] [height=1080] [cols=160] [rounds=20] [high=1]  render cache miss vs hit latency"},
+    {"planes", bench_planes, "planes [width=4000] [height=3000] [cols=240] [rounds=5]  re-render from a mapped plane file vs full pipeline"},
+    {"pyramid", bench_pyramid, "pyramid [width=4000] [height=3000] [rounds=3] [high=1]  six widths, one by one vs shared pyramid in one pass"},
+    {"batch", bench_batch, "batch [images=48] [width=80] [high=0]  batch conversion, sequential loop vs pipelined stages"},
+    {"emit", bench_emit, "emit [cols=300] [rows=150] [rounds=20]  ANSI output assembly, ostringstream vs AnsiRowWriter"},
+};
+
+int main(int argc, char** argv) {
+    PicConvertor::Logger::getInstance().initialize("picconv_bench.log");
+    if (argc >= 3 && std::strcmp(argv[1], "--isa") == 0) {
+        PicConvertor::Isa isa;
+        if (!PicConvertor::parseIsa(argv[2], isa) || !PicConvertor::setIsa(isa)) {
+            std::printf("ISA %s is unknown or not supported (max: %s)\n", argv[2], PicConvertor::isaName(PicConvertor::detectIsa()));
+            return 1;
+        }
+        argv[2] = argv[0];
+        argc -= 2; argv += 2;
+    }
+    if (argc >= 2) {
+        for (const auto& b : kBenches) {
+            if (std::strcmp(argv[1], b.name) == 0) return b.fn(argc, argv);
+        }
+    }
+    std::printf("Usage: picconv_bench [--isa scalar|sse41|avx2|avx512] <name> [args...]\n");
+    for (const auto& b : kBenches) std::printf("  %s\n", b.usage);
+    return 1;
+}
@@ -0,0 +1,133 @@
+#include "CpuDispatch.h"
+#include "Logger.h"
+#include <atomic>
+
+#if defined(PICCONV_KERNELS_X86) && (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+    #define PICCONV_CPUID 1
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #else
+        #include <cpuid.h>
+    #endif
+#endif
+
+PICCONV_DECLARE_KERNELS(isa_scalar)
+#ifdef PICCONV_KERNELS_X86
+PICCONV_DECLARE_KERNELS(isa_sse41)
+PICCONV_DECLARE_KERNELS(isa_avx2)
+PICCONV_DECLARE_KERNELS(isa_avx512bw)
+#endif
+
+namespace PicConvertor {
+
+    // 按 Isa 的取值索引；非 x86 构建只编译 scalar 表
+#define PICCONV_KERNEL_TABLE(isa, ns) KernelTable{isa, &ns::horizontal_box_row, &ns::cell_moments_row, &ns::cell_means_row, &ns::evaluate_glyphs}
+    static const KernelTable kTables[] = {
+        PICCONV_KERNEL_TABLE(Isa::Scalar, isa_scalar),
+#ifdef PICCONV_KERNELS_X86
+        PICCONV_KERNEL_TABLE(Isa::SSE41, isa_sse41),
+        PICCONV_KERNEL_TABLE(Isa::AVX2, isa_avx2),
+        PICCONV_KERNEL_TABLE(Isa::AVX512BW, isa_avx512bw),
+#endif
+    };
+#undef PICCONV_KERNEL_TABLE
+    static constexpr int kTableCount = (int)(sizeof(kTables) / sizeof(kTables[0]));
+
+#ifdef PICCONV_CPUID
+    static void cpuid(uint32_t leaf, uint32_t sub, uint32_t regs[4]) {
+#if defined(_MSC_VER)
+        int r[4];
+        __cpuidex(r, (int)leaf, (int)sub);
+        for (int i = 0; i < 4; ++i) regs[i] = (uint32_t)r[i];
+#else
+        __cpuid_count(leaf, sub, regs[0], regs[1], regs[2], regs[3]);
+#endif
+    }
+
+    // XCR0：OS 在上下文切换时保存的寄存器状态
+    static uint64_t xgetbv0() {
+#if defined(_MSC_VER)
+        return _xgetbv(0);
+#else
+        uint32_t eax, edx;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return ((uint64_t)edx << 32) | eax;
+#endif
+    }
+#endif
+
+    static Isa detect_host_isa() {
+#ifdef PICCONV_CPUID
+        uint32_t r[4];
+        cpuid(0, 0, r);
+        const uint32_t maxLeaf = r[0];
+        cpuid(1, 0, r);
+        const uint32_t ecx1 = r[2];
+        const bool sse41 = (ecx1 >> 19) & 1;
+        const bool osxsave = (ecx1 >> 27) & 1;
+        const bool avx = (ecx1 >> 28) & 1;
+        const uint64_t xcr0 = osxsave ? xgetbv0() : 0;
+        const bool ymmState = (xcr0 & 0x6) == 0x6;           // XMM + YMM
+        const bool zmmState = (xcr0 & 0xE6) == 0xE6;         // 另加 opmask、ZMM0-15 高半、ZMM16-31
+        uint32_t ebx7 = 0;
+        if (maxLeaf >= 7) {
+            cpuid(7, 0, r);
+            ebx7 = r[1];
+        }
+        const bool avx2 = avx && ymmState && ((ebx7 >> 5) & 1);
+        const bool avx512bw = avx2 && zmmState && ((ebx7 >> 16) & 1) && ((ebx7 >> 30) & 1); // F + BW
+        if (avx512bw) return Isa::AVX512BW;
+        if (avx2) return Isa::AVX2;
+        if (sse41) return Isa::SSE41;
+#endif
+        return Isa::Scalar;
+    }
+
+    Isa detectIsa() {
+        static const Isa detected = [] {
+            int level = (int)detect_host_isa();
+            if (level >= kTableCount) level = kTableCount - 1;
+            return (Isa)level;
+        }();
+        return detected;
+    }
+
+    static std::atomic<const KernelTable*>& active_table() {
+        static std::atomic<const KernelTable*> table{&kTables[(int)detectIsa()]};
+        return table;
+    }
+
+    const KernelTable& kernels() {
+        return *active_table().load(std::memory_order_acquire);
+    }
+
+    bool setIsa(Isa isa) {
+        if ((int)isa > (int)detectIsa()) return false;
+        active_table().store(&kTables[(int)isa], std::memory_order_release);
+        PC_LOG_INFO(std::string("SIMD kernels: ") + isaName(isa) + " (host supports " + isaName(detectIsa()) + ")");
+        return true;
+    }
+
+    Isa activeIsa() {
+        return kernels().isa;
+    }
+
+    const char* isaName(Isa isa) {
+        switch (isa) {
+            case Isa::SSE41: return "sse41";
+            case Isa::AVX2: return "avx2";
+            case Isa::AVX512BW: return "avx512";
+            default: return "scalar";
+        }
+    }
+
+    bool parseIsa(const std::string& name, Isa& out) {
+        if (name == "scalar") out = Isa::Scalar;
+        else if (name == "sse41" || name == "sse4.1") out = Isa::SSE41;
+        else if (name == "avx2") out = Isa::AVX2;
+        else if (name == "avx512" || name == "avx512bw") out = Isa::AVX512BW;
+        else return false;
+        return true;
+    }
+
+} // namespace PicConvertor
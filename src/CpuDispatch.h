@@ -0,0 +1,48 @@
+#pragma once
+#ifndef PICCONVERTOR_CPU_DISPATCH_H
+#define PICCONVERTOR_CPU_DISPATCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "simd_kernels.h"
+
+namespace PicConvertor {
+
+    // kernel 的目标指令集，按能力递增排列
+    enum class Isa { Scalar = 0, SSE41 = 1, AVX2 = 2, AVX512BW = 3 };
+
+    /**
+     * @brief 一组按同一 ISA 编译的 kernel 函数指针。
+     *
+     * 启动时按 cpuid/xgetbv 检测结果选择当前主机支持的最高级别；可通过 setIsa（例如 --isa）降级以便对比基准。
+     */
+    struct KernelTable {
+        Isa isa;
+        void (*horizontal_box_row)(const uint8_t* row, const int* x0s, const Run* runs, int run_count,
+                                   uint32_t* dstR, uint32_t* dstG, uint32_t* dstB);
+        void (*cell_moments_row)(const uint8_t* r, const uint8_t* g, const uint8_t* b,
+                                 size_t cell_step, size_t row_stride, int count, CellMoments* out);
+        void (*cell_means_row)(const uint8_t* r, const uint8_t* g, const uint8_t* b,
+                               size_t cell_step, size_t row_stride, int count,
+                               uint8_t* outR, uint8_t* outG, uint8_t* outB);
+        GlyphEvalCounts (*evaluate_glyphs)(const CellMoments* cells, int count, int prune_threshold, CellChoice* out);
+    };
+
+    // 当前使用的 kernel 表（首次调用时按检测结果初始化）
+    const KernelTable& kernels();
+
+    // 当前主机（CPU 与 OS 保存的寄存器状态）支持、且已编译进二进制的最高 ISA
+    Isa detectIsa();
+
+    // 切换 kernel 表；ISA 高于 detectIsa() 时返回 false 且不做修改。应在开始渲染前调用
+    bool setIsa(Isa isa);
+    Isa activeIsa();
+
+    const char* isaName(Isa isa);
+    // 解析 "scalar" / "sse41" / "avx2" / "avx512"（亦接受 "avx512bw"）
+    bool parseIsa(const std::string& name, Isa& out);
+
+} // namespace PicConvertor
+
+#endif // PICCONVERTOR_CPU_DISPATCH_H
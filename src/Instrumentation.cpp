@@ -0,0 +1,32 @@
+#include "Instrumentation.h"
+#include <cstdio>
+
+namespace PicConvertor {
+
+    void Log2Histogram::merge(const Log2Histogram& other) {
+        for (int b = 0; b < kBuckets; ++b) buckets[b] += other.buckets[b];
+        count += other.count;
+        sum += other.sum;
+    }
+
+    uint64_t Log2Histogram::percentile(double p) const {
+        if (count == 0) return 0;
+        const uint64_t target = (uint64_t)(p * (double)(count - 1)) + 1;
+        uint64_t seen = 0;
+        for (int b = 0; b < kBuckets; ++b) {
+            seen += buckets[b];
+            if (seen >= target) return b == 0 ? 0 : (b >= 64 ? UINT64_MAX : (1ull << b) - 1);
+        }
+        return UINT64_MAX;
+    }
+
+    std::string Log2Histogram::summary(const char* unit) const {
+        char buf[192];
+        std::snprintf(buf, sizeof(buf), "n=%llu mean=%.0f%s p50<=%llu%s p99<=%llu%s max<=%llu%s",
+                      (unsigned long long)count, count ? (double)sum / (double)count : 0.0, unit,
+                      (unsigned long long)percentile(0.50), unit, (unsigned long long)percentile(0.99), unit,
+                      (unsigned long long)percentile(1.0), unit);
+        return buf;
+    }
+
+} // namespace PicConvertor
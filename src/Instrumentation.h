@@ -0,0 +1,130 @@
+#pragma once
+#ifndef PICCONVERTOR_INSTRUMENTATION_H
+#define PICCONVERTOR_INSTRUMENTATION_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 编译期开关：-DPICCONV_INSTRUMENTATION=0 时 kInstrumentation 为 false，
+// 以 if constexpr 包裹的探针（见 renderer.cpp）连同分支一起被编译器移除
+#ifndef PICCONV_INSTRUMENTATION
+#define PICCONV_INSTRUMENTATION 1
+#endif
+
+namespace PicConvertor {
+
+    constexpr bool kInstrumentation = PICCONV_INSTRUMENTATION != 0;
+
+    // 采样计时的周期（2 的幂）：每个线程每 kSamplePeriod 次事件计时一次
+    constexpr uint32_t kSamplePeriod = 16;
+
+    /**
+     * @brief log2 分桶的直方图：值 v 落入第 bit_width(v) 个桶（0 单独一桶），另记总和与次数。
+     */
+    struct Log2Histogram {
+        static constexpr int kBuckets = 65;
+        uint64_t buckets[kBuckets] = {};
+        uint64_t count = 0;
+        uint64_t sum = 0;
+
+        void add(uint64_t v) {
+            int b = 0;
+            while (b < 64 && (v >> b)) ++b; // v >= 2^63 时 v >> 64 未定义
+            ++buckets[b];
+            ++count;
+            sum += v;
+        }
+        void merge(const Log2Histogram& other);
+        // 第 p 分位（0..1）所在桶的上界
+        uint64_t percentile(double p) const;
+        // "n=… mean=… p50<=… p99<=… max<=…"
+        std::string summary(const char* unit) const;
+    };
+
+    /**
+     * @brief 按线程分片的计数器与直方图：每个线程写自己的 cache line 对齐分片，读取时合并。
+     *
+     * 热路径上只有普通的加法，不存在跨线程的原子操作或伪共享。
+     * 分片在线程首次访问时分配并登记，线程退出后保留以供合并。每个线程缓存最近访问的实例的分片；
+     * 在多个实例之间交替时（并发的 --serve 请求、同一线程池上嵌套的多宽度渲染）在锁内按线程找回
+     * 已有的分片，不会重复分配，采样计数也随之延续。
+     */
+    template<size_t NCounters, size_t NHistograms>
+    class ThreadShardedStats {
+    public:
+        struct alignas(64) Shard {
+            uint64_t counters[NCounters] = {};
+            Log2Histogram histograms[NHistograms > 0 ? NHistograms : 1];
+            uint32_t sampleTick = 0;
+            std::thread::id owner;
+
+            // 采样计时：返回 true 的事件需要计时
+            bool sample() { return (++sampleTick & (kSamplePeriod - 1)) == 0; }
+        };
+
+        ThreadShardedStats() : id(nextInstanceId().fetch_add(1, std::memory_order_relaxed) + 1) {}
+        ThreadShardedStats(const ThreadShardedStats&) = delete;
+        ThreadShardedStats& operator=(const ThreadShardedStats&) = delete;
+
+        // 当前线程的分片
+        Shard& local() {
+            struct Cache { uint64_t owner = 0; Shard* shard = nullptr; };
+            static thread_local Cache cache;
+            if (cache.owner != id) {
+                const std::thread::id self = std::this_thread::get_id();
+                std::lock_guard<std::mutex> lock(mutex);
+                Shard* found = nullptr;
+                for (const auto& s : shards) {
+                    if (s->owner == self) { found = s.get(); break; }
+                }
+                if (!found) {
+                    shards.push_back(std::unique_ptr<Shard>(new Shard()));
+                    found = shards.back().get();
+                    found->owner = self;
+                }
+                cache.owner = id;
+                cache.shard = found;
+            }
+            return *cache.shard;
+        }
+
+        // 以下读取接口应在写入线程结束本轮工作后调用（例如 parallel_for 返回后）
+        uint64_t counter(size_t i) const {
+            std::lock_guard<std::mutex> lock(mutex);
+            uint64_t total = 0;
+            for (const auto& s : shards) total += s->counters[i];
+            return total;
+        }
+
+        Log2Histogram histogram(size_t i) const {
+            std::lock_guard<std::mutex> lock(mutex);
+            Log2Histogram merged;
+            for (const auto& s : shards) merged.merge(s->histograms[i]);
+            return merged;
+        }
+
+        size_t shardCount() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return shards.size();
+        }
+
+    private:
+        static std::atomic<uint64_t>& nextInstanceId() {
+            static std::atomic<uint64_t> next{0};
+            return next;
+        }
+
+        const uint64_t id; // 全局唯一，避免实例地址复用时命中过期的线程缓存
+        mutable std::mutex mutex;
+        std::vector<std::unique_ptr<Shard>> shards;
+    };
+
+} // namespace PicConvertor
+
+#endif // PICCONVERTOR_INSTRUMENTATION_H
@@ -1,69 +1,367 @@
 #include "Logger.h"
-#include <iostream> 
+#include <chrono>
+#include <ctime>
+#include <iostream>
 
 namespace PicConvertor {
 
+    /**
+     * @brief 单生产者（所属线程）/ 单消费者（写线程）的字节环形缓冲。
+     *
+     * 每条记录为 [u32 长度][载荷]；记录不跨越缓冲末尾：末尾剩余空间不足时写入回绕标记
+     * （剩余不足 4 字节时双方都直接跳过），下一条记录从缓冲起点开始。head/tail 为单调递增的字节位置。
+     */
+    class LogRing {
+    public:
+        static constexpr size_t kCapacity = 256 * 1024;
+        static constexpr uint32_t kWrapMarker = 0xFFFFFFFFu;
+
+        uint8_t data[kCapacity];
+        alignas(64) std::atomic<uint64_t> head{0}; // 生产者写入
+        alignas(64) std::atomic<uint64_t> tail{0}; // 消费者写入
+        uint64_t reserved = 0;                     // 生产者私有：当前预留记录的起点
+        // 预留中记录序号的下界（取序号之前的 nextSeq）；没有预留中的记录时为 ~0
+        alignas(64) std::atomic<uint64_t> reservedSeq{~0ull};
+        std::atomic<bool> retired{false};          // 所属线程已退出，取空后可移除
+        std::atomic<bool> writing{false};          // 生产者位于 beginRecord 与 commitRecord 之间
+    };
+
+    namespace {
+        constexpr size_t kMask = LogRing::kCapacity - 1;
+        static_assert((LogRing::kCapacity & kMask) == 0, "ring capacity must be a power of two");
+
+        // 线程退出时把环形缓冲标记为退役，由写线程取空后释放
+        struct RingHolder {
+            std::shared_ptr<LogRing> ring;
+            ~RingHolder() { if (ring) ring->retired.store(true, std::memory_order_release); }
+        };
+        thread_local RingHolder tlsRing;
+
+        const char* levelToString(int level) {
+            switch ((LogLevel)level) {
+                case LogLevel::LOG_INFO:    return "INFO";
+                case LogLevel::LOG_WARNING: return "WARN"; // 使用 WARN 缩写
+                case LogLevel::LOG_ERROR:   return "ERROR";
+                default:                    return "?????";
+            }
+        }
+
+        // 把 fmt 中的 {} 依次替换为编码参数；多余的参数以空格分隔追加在末尾
+        void formatMessage(std::string& out, const char* fmt, const uint8_t* args, uint8_t argc) {
+            auto appendArg = [&](const uint8_t*& p) {
+                char num[32];
+                const uint8_t tag = *p++;
+                if (tag == LogEncoding::kString) {
+                    uint32_t n;
+                    std::memcpy(&n, p, 4);
+                    out.append((const char*)p + 4, n);
+                    p += 4 + n;
+                    return;
+                }
+                int len = 0;
+                if (tag == LogEncoding::kInt) { int64_t v; std::memcpy(&v, p, 8); len = std::snprintf(num, sizeof(num), "%lld", (long long)v); }
+                else if (tag == LogEncoding::kUInt) { uint64_t v; std::memcpy(&v, p, 8); len = std::snprintf(num, sizeof(num), "%llu", (unsigned long long)v); }
+                else { double v; std::memcpy(&v, p, 8); len = std::snprintf(num, sizeof(num), "%.6g", v); }
+                out.append(num, (size_t)std::max(0, len));
+                p += 8;
+            };
+            const uint8_t* p = args;
+            uint8_t used = 0;
+            for (const char* f = fmt; *f; ++f) {
+                if (f[0] == '{' && f[1] == '}' && used < argc) {
+                    appendArg(p);
+                    ++used;
+                    ++f;
+                } else {
+                    out.push_back(*f);
+                }
+            }
+            for (; used < argc; ++used) {
+                out.push_back(' ');
+                appendArg(p);
+            }
+        }
+
+        int64_t nowMicros() {
+            return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        }
+
+        void formatTimestamp(int64_t second, char* buf, size_t size) {
+            const std::time_t t = (std::time_t)second;
+            std::tm tm{};
+#ifdef _WIN32
+            localtime_s(&tm, &t);
+#else
+            localtime_r(&t, &tm);
+#endif
+            std::strftime(buf, size, "%Y-%m-%d %H:%M:%S", &tm);
+        }
+
+        struct PendingRecord {
+            uint64_t seq;
+            int64_t timeUs;
+            int level;
+            const char* fmt;
+            uint8_t argc;
+            size_t argsOffset; // 参数字节在批次缓冲中的偏移
+            size_t argsSize;
+        };
+    }
+
     Logger& Logger::getInstance() {
         // C++11 保证静态局部变量的初始化是线程安全的
         static Logger instance;
         return instance;
     }
 
+    Logger::~Logger() { shutdown(); }
+
     bool Logger::initialize(const std::string& filename) {
-        std::lock_guard<std::mutex> lock(logMutex);
-        if (initialized) {
-            // 允许重新初始化，先关闭旧的
-            if (logFile.is_open()) {
-                logFile.close();
-            }
+        std::lock_guard<std::mutex> lock(lifecycleMutex);
+        if (running.load()) {
+            // 允许重新初始化：先写完并关闭旧文件
+            running.store(false);
+            wakeCond.notify_all();
+            writer.join();
+            closeFile();
         }
-        logFile.open(filename, std::ios::app); // 追加模式打开
-        if (!logFile.is_open()) {
+        std::FILE* file = std::fopen(filename.c_str(), "a"); // 追加模式打开
+        if (!file) {
             std::cerr << "Error: Failed to open log file: " << filename << std::endl;
-            initialized = false;
             return false;
         }
-        initialized = true;
-        // 写入一条初始化消息，但不通过 log() 函数以避免死锁
-        logFile << "[" << getCurrentTimestamp() << "] [" << levelToString(LogLevel::LOG_INFO) << "] " << "Logger initialized. Log file: " + filename << std::endl;
+        std::setvbuf(file, nullptr, _IOFBF, 64 * 1024);
+        {
+            std::lock_guard<std::mutex> fileLock(fileMutex);
+            logFile = file;
+        }
+        running.store(true);
+        writer = std::thread(&Logger::writerLoop, this);
+        logf(LogLevel::LOG_INFO, "Logger initialized. Log file: {}", filename);
         return true;
     }
 
     void Logger::shutdown() {
-        std::lock_guard<std::mutex> lock(logMutex);
-        if (initialized && logFile.is_open()) {
-            // 写入一条关闭消息，但不通过 log() 函数以避免死锁
-            logFile << "[" << getCurrentTimestamp() << "] [" << levelToString(LogLevel::LOG_INFO) << "] " << "Logger shutting down." << std::endl;
-            logFile.close();
-            initialized = false;
+        std::lock_guard<std::mutex> lock(lifecycleMutex);
+        if (!running.load()) return;
+        running.store(false);
+        wakeCond.notify_all();
+        writer.join(); // 写线程退出前取空所有环形缓冲
+        // 析构期间本线程的 thread_local 缓冲可能已销毁：结束消息直接写入文件
+        writeSync(LogLevel::LOG_INFO, "Logger shutting down.", nullptr, 0);
+        closeFile();
+    }
+
+    void Logger::closeFile() {
+        std::lock_guard<std::mutex> lock(fileMutex);
+        if (logFile) std::fclose(logFile);
+        logFile = nullptr;
+    }
+
+    LogRing* Logger::threadRing() {
+        if (!tlsRing.ring) {
+            tlsRing.ring = std::make_shared<LogRing>();
+            std::lock_guard<std::mutex> lock(registryMutex);
+            rings.push_back(tlsRing.ring);
+        }
+        return tlsRing.ring.get();
+    }
+
+    uint8_t* Logger::beginRecord(LogLevel level, const char* fmt, uint8_t argc, size_t payload) {
+        // 超长记录（只可能来自多个长字符串参数）由调用线程同步写出
+        if (!running.load(std::memory_order_acquire) || payload > kMaxRecordBytes) return nullptr;
+        LogRing* ring = threadRing();
+        // 先公布预留再重新检查 running：写线程在 running 变为 false 之后等待所有 writing 清零才做最后的取空，
+        // 因此这里看到 true 的记录一定会被写出，看到 false 的记录改为同步写出
+        ring->writing.store(true, std::memory_order_seq_cst);
+        if (!running.load(std::memory_order_seq_cst)) {
+            ring->writing.store(false, std::memory_order_release);
+            return nullptr;
+        }
+        const size_t need = 4 + payload;
+        uint64_t pos = ring->head.load(std::memory_order_relaxed);
+        const size_t contiguous = LogRing::kCapacity - (size_t)(pos & kMask);
+        const size_t skip = contiguous < need ? contiguous : 0;
+        // 空间不足：唤醒写线程并让出 CPU，直到写线程取走足够的记录
+        while (pos + skip + need - ring->tail.load(std::memory_order_acquire) > LogRing::kCapacity) {
+            if (!running.load(std::memory_order_acquire)) {
+                ring->writing.store(false, std::memory_order_release);
+                return nullptr;
+            }
+            wakeCond.notify_one();
+            std::this_thread::yield();
         }
+        if (skip >= 4) {
+            const uint32_t marker = LogRing::kWrapMarker;
+            std::memcpy(ring->data + (pos & kMask), &marker, 4);
+        }
+        pos += skip;
+        ring->reserved = pos;
+        uint8_t* p = ring->data + (pos & kMask);
+        const uint32_t size = (uint32_t)(need - 4);
+        std::memcpy(p, &size, 4);
+        p += 4;
+        // 取序号之前公布其下界：写线程据此推迟序号更大的已提交记录，直到本记录提交
+        ring->reservedSeq.store(nextSeq.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+        const uint64_t seq = nextSeq.fetch_add(1, std::memory_order_seq_cst);
+        const int64_t timeUs = nowMicros();
+        *p++ = (uint8_t)level;
+        *p++ = argc;
+        std::memcpy(p, &seq, 8); p += 8;
+        std::memcpy(p, &timeUs, 8); p += 8;
+        std::memcpy(p, &fmt, sizeof(fmt)); p += sizeof(fmt);
+        return p;
     }
 
-    std::string Logger::getCurrentTimestamp() {
-        auto now = std::chrono::system_clock::now();
-        auto now_c = std::chrono::system_clock::to_time_t(now);
-        std::stringstream ss;
-        ss << std::put_time(std::localtime(&now_c), "%Y-%m-%d %H:%M:%S");
-        return ss.str();
+    void Logger::commitRecord(LogLevel level) {
+        LogRing* ring = tlsRing.ring.get();
+        uint32_t size;
+        std::memcpy(&size, ring->data + (ring->reserved & kMask), 4);
+        const uint64_t end = ring->reserved + 4 + size;
+        ring->head.store(end, std::memory_order_release);
+        ring->reservedSeq.store(~0ull, std::memory_order_release);
+        ring->writing.store(false, std::memory_order_release);
+        // 错误立即写出；缓冲过半时提前唤醒写线程
+        if (level >= LogLevel::LOG_ERROR || end - ring->tail.load(std::memory_order_relaxed) > LogRing::kCapacity / 2)
+            wakeCond.notify_one();
     }
 
-    std::string Logger::levelToString(LogLevel level) {
-        switch (level) {
-            case LogLevel::LOG_INFO:    return "INFO";
-            case LogLevel::LOG_WARNING: return "WARN"; // 使用 WARN 缩写
-            case LogLevel::LOG_ERROR:   return "ERROR";
-            default:                return "?????";
+    void Logger::writeSync(LogLevel level, const char* fmt, const uint8_t* args, uint8_t argc) {
+        std::string message;
+        formatMessage(message, fmt, args, argc);
+        char ts[32];
+        formatTimestamp(nowMicros() / 1000000, ts, sizeof(ts));
+        {
+            std::lock_guard<std::mutex> lock(fileMutex);
+            if (logFile) {
+                std::fprintf(logFile, "[%s] [%s] %s\n", ts, levelToString((int)level), message.c_str());
+                std::fflush(logFile);
+                return;
+            }
         }
+        // 如果未初始化或已关闭，输出到 cerr
+        std::cerr << "[" << ts << "] [" << levelToString((int)level) << "] " << message << " (Logger not initialized!)" << std::endl;
     }
 
-    void Logger::log(LogLevel level, const std::string& message) {
-        std::lock_guard<std::mutex> lock(logMutex);
-        if (!initialized || !logFile.is_open()) {
-            // 如果未初始化或文件未打开，尝试输出到 cerr
-            std::cerr << "[" << getCurrentTimestamp() << "] [" << levelToString(level) << "] " << message << " (Logger not initialized!)" << std::endl;
-            return;
+    size_t Logger::drainOnce(std::string& out, bool flushAll) {
+        // 可写出的序号上界：先取 nextSeq（之后注册的缓冲只会取到不小于它的序号），
+        // 再取各缓冲中预留中记录的序号下界。低于上界的序号都已提交，且其记录在下面的扫描中可见
+        uint64_t limit = nextSeq.load(std::memory_order_seq_cst);
+        std::vector<std::shared_ptr<LogRing>> snapshot;
+        {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            snapshot = rings;
+        }
+        for (const auto& ring : snapshot) limit = std::min(limit, ring->reservedSeq.load(std::memory_order_seq_cst));
+
+        // 先复制出各缓冲中已提交的记录，再按全局序号排序，保持跨线程的先后顺序。
+        // 序号不低于 limit 的记录留在 pending 中，与下一批一起排序写出
+        static thread_local std::vector<PendingRecord> pending;
+        static thread_local std::vector<uint8_t> argBytes;
+        bool anyRetired = false;
+        for (const auto& ring : snapshot) {
+            const bool retired = ring->retired.load(std::memory_order_acquire);
+            uint64_t t = ring->tail.load(std::memory_order_relaxed);
+            const uint64_t h = ring->head.load(std::memory_order_acquire);
+            while (t < h) {
+                const size_t off = (size_t)(t & kMask);
+                const size_t contiguous = LogRing::kCapacity - off;
+                uint32_t size = LogRing::kWrapMarker;
+                if (contiguous >= 4) std::memcpy(&size, ring->data + off, 4);
+                if (size == LogRing::kWrapMarker) { t += contiguous; continue; }
+                const uint8_t* p = ring->data + off + 4;
+                PendingRecord rec;
+                rec.level = p[0];
+                rec.argc = p[1];
+                std::memcpy(&rec.seq, p + 2, 8);
+                std::memcpy(&rec.timeUs, p + 10, 8);
+                std::memcpy(&rec.fmt, p + 18, sizeof(rec.fmt));
+                rec.argsOffset = argBytes.size();
+                rec.argsSize = size - kRecordHeaderBytes;
+                argBytes.insert(argBytes.end(), p + kRecordHeaderBytes, p + size);
+                pending.push_back(rec);
+                t += 4 + size;
+            }
+            ring->tail.store(t, std::memory_order_release);
+            if (retired) anyRetired = true;
+        }
+        if (anyRetired) {
+            // 退役且已取空的缓冲不再需要
+            std::lock_guard<std::mutex> lock(registryMutex);
+            rings.erase(std::remove_if(rings.begin(), rings.end(), [](const std::shared_ptr<LogRing>& r) {
+                return r->retired.load(std::memory_order_acquire) && r->tail.load() == r->head.load();
+            }), rings.end());
+        }
+        if (pending.empty()) return 0;
+
+        std::sort(pending.begin(), pending.end(), [](const PendingRecord& a, const PendingRecord& b) { return a.seq < b.seq; });
+        const size_t ready = flushAll ? pending.size()
+            : (size_t)(std::lower_bound(pending.begin(), pending.end(), limit,
+                                        [](const PendingRecord& r, uint64_t s) { return r.seq < s; }) - pending.begin());
+        if (ready == 0) return 0;
+        out.clear();
+        for (size_t i = 0; i < ready; ++i) {
+            const PendingRecord& rec = pending[i];
+            const int64_t second = rec.timeUs / 1000000;
+            if (second != cachedSecond) {
+                cachedSecond = second;
+                formatTimestamp(second, cachedTimestamp, sizeof(cachedTimestamp));
+            }
+            out += '[';
+            out += cachedTimestamp;
+            out += "] [";
+            out += levelToString(rec.level);
+            out += "] ";
+            formatMessage(out, rec.fmt, argBytes.data() + rec.argsOffset, rec.argc);
+            out += '\n';
+        }
+        // 一批记录一次写出
+        {
+            std::lock_guard<std::mutex> lock(fileMutex);
+            std::fwrite(out.data(), 1, out.size(), logFile);
+            std::fflush(logFile);
+        }
+        // 保留推迟的记录并压缩参数缓冲
+        if (ready == pending.size()) {
+            pending.clear();
+            argBytes.clear();
+        } else {
+            static thread_local std::vector<uint8_t> kept;
+            kept.clear();
+            for (size_t i = ready; i < pending.size(); ++i) {
+                PendingRecord& rec = pending[i];
+                const size_t offset = kept.size();
+                kept.insert(kept.end(), argBytes.begin() + (ptrdiff_t)rec.argsOffset, argBytes.begin() + (ptrdiff_t)(rec.argsOffset + rec.argsSize));
+                rec.argsOffset = offset;
+            }
+            pending.erase(pending.begin(), pending.begin() + (ptrdiff_t)ready);
+            argBytes.swap(kept);
+        }
+        return ready;
+    }
+
+    void Logger::writerLoop() {
+        std::string batch;
+        batch.reserve(64 * 1024);
+        while (running.load(std::memory_order_acquire)) {
+            if (drainOnce(batch) > 0) continue;
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            wakeCond.wait_for(lock, std::chrono::milliseconds(20));
+        }
+        // 停止前取空：running 变为 false 之后不会再开始新的预留（见 beginRecord），
+        // 但已经通过检查的生产者可能仍在写入，等它们提交或放弃之后再做最后的取空，并写出仍被推迟的记录
+        for (;;) {
+            drainOnce(batch);
+            bool writing = false;
+            {
+                std::lock_guard<std::mutex> lock(registryMutex);
+                for (const auto& ring : rings) writing = writing || ring->writing.load(std::memory_order_acquire);
+            }
+            if (!writing) break;
+            std::this_thread::yield();
         }
-        logFile << "[" << getCurrentTimestamp() << "] [" << levelToString(level) << "] " << message << std::endl;
+        while (drainOnce(batch) > 0) {}
+        drainOnce(batch, true);
     }
 
     void Logger::logInfo(const std::string& message) {
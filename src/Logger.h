@@ -2,35 +2,117 @@
 #ifndef PICCONVERTOR_LOGGER_H
 #define PICCONVERTOR_LOGGER_H
 
-#include <fstream>
-#include <string>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
 #include <mutex>
-#include <chrono>
-#include <iomanip> 
-#include <windows.h> 
-
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// 编译期日志级别：低于 PICCONV_LOG_LEVEL 的 PC_LOG_* 宏展开为空语句，参数表达式不会被求值
+// （CMake: -DPICCONV_LOG_LEVEL=INFO|WARNING|ERROR|OFF）
+#define PICCONV_LOG_LEVEL_INFO    0
+#define PICCONV_LOG_LEVEL_WARNING 1
+#define PICCONV_LOG_LEVEL_ERROR   2
+#define PICCONV_LOG_LEVEL_OFF     3
+#ifndef PICCONV_LOG_LEVEL
+#define PICCONV_LOG_LEVEL PICCONV_LOG_LEVEL_INFO
+#endif
 
 namespace PicConvertor {
 
     enum class LogLevel {
         LOG_INFO,
         LOG_WARNING,
-        LOG_ERROR
+        LOG_ERROR,
+        LOG_OFF // 仅用于 setLevel：关闭运行期日志
     };
 
+    // 结构化参数的二进制编码：调用线程只复制参数，格式化由后台写线程完成
+    namespace LogEncoding {
+        enum Tag : uint8_t { kInt = 1, kUInt, kDouble, kString };
+        constexpr size_t kMaxStringArg = 16 * 1024; // 更长的字符串参数被截断
+
+        template<typename T>
+        constexpr bool isNumeric = std::is_arithmetic_v<T> || std::is_enum_v<T>;
+
+        template<typename T>
+        size_t size(const T& v) {
+            if constexpr (isNumeric<T>) return 1 + 8;
+            else return 1 + 4 + std::min(std::string_view(v).size(), kMaxStringArg);
+        }
+
+        template<typename T>
+        uint8_t* put(uint8_t* p, const T& v) {
+            if constexpr (std::is_floating_point_v<T>) {
+                const double d = (double)v;
+                *p++ = kDouble; std::memcpy(p, &d, 8); return p + 8;
+            } else if constexpr (std::is_enum_v<T>) {
+                const int64_t i = (int64_t)v;
+                *p++ = kInt; std::memcpy(p, &i, 8); return p + 8;
+            } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+                const int64_t i = (int64_t)v;
+                *p++ = kInt; std::memcpy(p, &i, 8); return p + 8;
+            } else if constexpr (std::is_integral_v<T>) {
+                const uint64_t u = (uint64_t)v;
+                *p++ = kUInt; std::memcpy(p, &u, 8); return p + 8;
+            } else {
+                const std::string_view s(v);
+                const uint32_t n = (uint32_t)std::min(s.size(), kMaxStringArg);
+                *p++ = kString; std::memcpy(p, &n, 4); std::memcpy(p + 4, s.data(), n); return p + 4 + n;
+            }
+        }
+    }
+
+    class LogRing;
+
+    /**
+     * @brief 异步日志：调用线程把记录写入本线程的无锁 SPSC 环形缓冲后立即返回，
+     * 后台写线程批量取出、按全局序号排序、格式化后一次写入日志文件。已提交但序号大于某个尚未提交
+     * （已取序号、仍在写入参数）的记录会推迟到之后的批次，因此文件中的记录跨批次也严格按序号排列。
+     *
+     * logf 的 fmt 必须是字符串字面量（只保存指针），其中的 {} 依次替换为参数；整数、浮点、枚举
+     * 与字符串参数以二进制形式复制，格式化推迟到写线程。时间戳字符串按秒缓存。
+     * 环形缓冲满时调用线程让出 CPU 等待写线程腾出空间（不丢记录）。未初始化或 shutdown 之后
+     * 的记录同步写到 stderr。
+     */
     class Logger {
     public:
         // 获取 Logger 单例实例
         static Logger& getInstance();
 
-        // 初始化日志文件 (应在程序开始时调用)
+        // 打开日志文件并启动写线程 (应在程序开始时调用)；重复调用时先写完并关闭旧文件
         bool initialize(const std::string& filename = "picconvertor.log");
 
-        // 关闭日志文件 (应在程序结束时调用)
+        // 写完所有已提交的记录，停止写线程并关闭日志文件 (析构时也会调用)
         void shutdown();
 
+        // 运行期级别：低于该级别的记录在求值参数之前即被跳过
+        void setLevel(LogLevel level) { minLevel.store((int)level, std::memory_order_relaxed); }
+        bool enabled(LogLevel level) const { return (int)level >= minLevel.load(std::memory_order_relaxed); }
+
         // 记录日志消息
-        void log(LogLevel level, const std::string& message);
+        void log(LogLevel level, const std::string& message) { logf(level, "{}", message); }
+
+        // 结构化记录：fmt 为字符串字面量，参数为算术类型、枚举或可转换为 std::string_view 的字符串
+        template<typename... Args>
+        void logf(LogLevel level, const char* fmt, const Args&... args) {
+            const size_t payload = kRecordHeaderBytes + (size_t(0) + ... + LogEncoding::size(args));
+            uint8_t* p = beginRecord(level, fmt, (uint8_t)sizeof...(Args), payload);
+            if (!p) {
+                logSync(level, fmt, args...);
+                return;
+            }
+            ((p = LogEncoding::put(p, args)), ...);
+            commitRecord(level);
+        }
 
         // 便捷方法
         void logInfo(const std::string& message);
@@ -41,24 +123,84 @@ namespace PicConvertor {
         Logger(const Logger&) = delete;
         Logger& operator=(const Logger&) = delete;
 
+        // 记录头：level(1) argc(1) seq(8) time_us(8) fmt(指针)
+        static constexpr size_t kRecordHeaderBytes = 2 + 8 + 8 + sizeof(const char*);
+        static constexpr size_t kMaxRecordBytes = 64 * 1024;
+
     private:
         Logger() = default; // 私有构造函数
-        ~Logger() = default; // 私有析构函数 (通过 shutdown 管理)
-
-        std::ofstream logFile;
-        std::mutex logMutex;
-        bool initialized = false;
-
-        // 获取当前时间戳字符串
-        std::string getCurrentTimestamp();
-        // 获取日志级别字符串
-        std::string levelToString(LogLevel level);
+        ~Logger();
+
+        // 在本线程环形缓冲中预留 payload 字节并写入记录头，返回参数区起点；写线程未运行时返回 nullptr
+        uint8_t* beginRecord(LogLevel level, const char* fmt, uint8_t argc, size_t payload);
+        void commitRecord(LogLevel level);
+        LogRing* threadRing();
+
+        template<typename... Args>
+        void logSync(LogLevel level, const char* fmt, const Args&... args) {
+            // 就地编码后按与写线程相同的规则格式化
+            std::vector<uint8_t> buf((size_t(0) + ... + LogEncoding::size(args)) + 1);
+            uint8_t* p = buf.data();
+            ((p = LogEncoding::put(p, args)), ...);
+            writeSync(level, fmt, buf.data(), (uint8_t)sizeof...(Args));
+        }
+        // 未初始化或已关闭时写到 stderr；否则（超长记录）加锁直接写入日志文件
+        void writeSync(LogLevel level, const char* fmt, const uint8_t* args, uint8_t argc);
+        void closeFile();
+
+        void writerLoop();
+        // 取出所有环形缓冲中已提交的记录，写出序号低于仍在预留中的最小序号的部分（flushAll 时全部写出）；
+        // 返回写出的记录数
+        size_t drainOnce(std::string& out, bool flushAll = false);
+
+        std::atomic<int> minLevel{(int)LogLevel::LOG_INFO};
+        std::atomic<bool> running{false};
+        std::atomic<uint64_t> nextSeq{0};
+
+        std::mutex lifecycleMutex; // initialize / shutdown
+        std::mutex fileMutex;      // 写线程的批量写出与 writeSync 互斥
+        std::FILE* logFile = nullptr;
+        std::thread writer;
+        std::mutex wakeMutex;
+        std::condition_variable wakeCond;
+
+        std::mutex registryMutex;
+        std::vector<std::shared_ptr<LogRing>> rings;
+
+        // 写线程私有
+        int64_t cachedSecond = -1;
+        char cachedTimestamp[32] = {0};
     };
 
     // 全局便捷访问宏 (可选，但方便)
-    #define LOG_INFO(msg)    PicConvertor::Logger::getInstance().logInfo(msg)
-    #define LOG_WARNING(msg) PicConvertor::Logger::getInstance().logWarning(msg)
-    #define LOG_ERROR(msg)   PicConvertor::Logger::getInstance().logError(msg)
+    #define PC_LOG_AT(level, msg) \
+        do { auto& pcLogger_ = PicConvertor::Logger::getInstance(); \
+             if (pcLogger_.enabled(level)) pcLogger_.log(level, msg); } while (0)
+    #define PC_LOGF_AT(level, ...) \
+        do { auto& pcLogger_ = PicConvertor::Logger::getInstance(); \
+             if (pcLogger_.enabled(level)) pcLogger_.logf(level, __VA_ARGS__); } while (0)
+
+    #if PICCONV_LOG_LEVEL <= PICCONV_LOG_LEVEL_INFO
+        #define LOG_INFO(msg)      PC_LOG_AT(PicConvertor::LogLevel::LOG_INFO, msg)
+        #define PC_LOGF_INFO(...)  PC_LOGF_AT(PicConvertor::LogLevel::LOG_INFO, __VA_ARGS__)
+    #else
+        #define LOG_INFO(msg)      ((void)0)
+        #define PC_LOGF_INFO(...)  ((void)0)
+    #endif
+    #if PICCONV_LOG_LEVEL <= PICCONV_LOG_LEVEL_WARNING
+        #define LOG_WARNING(msg)     PC_LOG_AT(PicConvertor::LogLevel::LOG_WARNING, msg)
+        #define PC_LOGF_WARNING(...) PC_LOGF_AT(PicConvertor::LogLevel::LOG_WARNING, __VA_ARGS__)
+    #else
+        #define LOG_WARNING(msg)     ((void)0)
+        #define PC_LOGF_WARNING(...) ((void)0)
+    #endif
+    #if PICCONV_LOG_LEVEL <= PICCONV_LOG_LEVEL_ERROR
+        #define LOG_ERROR(msg)     PC_LOG_AT(PicConvertor::LogLevel::LOG_ERROR, msg)
+        #define PC_LOGF_ERROR(...) PC_LOGF_AT(PicConvertor::LogLevel::LOG_ERROR, __VA_ARGS__)
+    #else
+        #define LOG_ERROR(msg)     ((void)0)
+        #define PC_LOGF_ERROR(...) ((void)0)
+    #endif
 
     // 兼容性宏（用于改造自其他项目的日志调用）
     #define PC_LOG_INFO(msg)    LOG_INFO(msg)
@@ -0,0 +1,87 @@
+#include "MappedFile.h"
+#include <cerrno>
+#include <cstring>
+#include <utility>
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace PicConvertor {
+
+    MappedFile::~MappedFile() { close(); }
+
+    MappedFile::MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+
+    MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            close();
+            std::swap(ptr, other.ptr);
+            std::swap(length, other.length);
+#ifdef _WIN32
+            std::swap(mapping, other.mapping);
+#endif
+        }
+        return *this;
+    }
+
+#ifdef _WIN32
+    bool MappedFile::open(const std::string& path, std::string& error) {
+        close();
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) { error = "cannot open " + path; return false; }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size)) { CloseHandle(file); error = "cannot stat " + path; return false; }
+        if (size.QuadPart == 0) { CloseHandle(file); return true; }
+        HANDLE map = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file); // 映射对象持有文件引用
+        if (!map) { error = "cannot map " + path; return false; }
+        void* view = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+        if (!view) { CloseHandle(map); error = "cannot map " + path; return false; }
+        mapping = map;
+        ptr = static_cast<const uint8_t*>(view);
+        length = (size_t)size.QuadPart;
+        return true;
+    }
+
+    void MappedFile::close() {
+        if (ptr) UnmapViewOfFile(ptr);
+        if (mapping) CloseHandle(mapping);
+        ptr = nullptr;
+        mapping = nullptr;
+        length = 0;
+    }
+#else
+    bool MappedFile::open(const std::string& path, std::string& error) {
+        close();
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) { error = path + ": " + std::strerror(errno); return false; }
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            error = path + ": not a regular file";
+            ::close(fd);
+            return false;
+        }
+        if (st.st_size == 0) { ::close(fd); return true; }
+        void* p = ::mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // 映射保持有效
+        if (p == MAP_FAILED) { error = path + ": mmap: " + std::strerror(errno); return false; }
+        // 解码器顺序读取：请求内核积极预读
+        ::madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+        ptr = static_cast<const uint8_t*>(p);
+        length = (size_t)st.st_size;
+        return true;
+    }
+
+    void MappedFile::close() {
+        if (ptr) ::munmap(const_cast<uint8_t*>(ptr), length);
+        ptr = nullptr;
+        length = 0;
+    }
+#endif
+
+} // namespace PicConvertor
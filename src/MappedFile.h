@@ -0,0 +1,43 @@
+#pragma once
+#ifndef PICCONVERTOR_MAPPED_FILE_H
+#define PICCONVERTOR_MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace PicConvertor {
+
+    /**
+     * @brief 只读映射整个文件（POSIX mmap / Windows MapViewOfFile）。
+     *
+     * 映射期间文件内容直接来自 page cache，不经过 stdio 缓冲复制。空文件打开成功但 data() 为 nullptr。
+     * 只可移动，析构时解除映射。
+     */
+    class MappedFile {
+    public:
+        MappedFile() = default;
+        ~MappedFile();
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile& operator=(MappedFile&& other) noexcept;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        // 映射 path；失败时返回 false 并写入 error
+        bool open(const std::string& path, std::string& error);
+        void close();
+
+        const uint8_t* data() const { return ptr; }
+        size_t size() const { return length; }
+
+    private:
+        const uint8_t* ptr = nullptr;
+        size_t length = 0;
+#ifdef _WIN32
+        void* mapping = nullptr;
+#endif
+    };
+
+} // namespace PicConvertor
+
+#endif // PICCONVERTOR_MAPPED_FILE_H
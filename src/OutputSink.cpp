@@ -0,0 +1,179 @@
+#include "OutputSink.h"
+#include "timing.h"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#ifdef _WIN32
+    #include <io.h>
+#else
+    #include <sys/uio.h>
+    #include <unistd.h>
+    #include <climits>
+#endif
+
+namespace PicConvertor {
+
+#ifdef _WIN32
+    static bool write_all(int fd, const char* p, size_t n) {
+        while (n > 0) {
+            const unsigned part = (unsigned)std::min<size_t>(n, 1u << 30);
+            const int w = _write(fd, p, part);
+            if (w <= 0) return false;
+            p += w; n -= (size_t)w;
+        }
+        return true;
+    }
+#endif
+
+    FdSink::~FdSink() {
+        if (!ownsFd || fd < 0) return;
+#ifdef _WIN32
+        _close(fd);
+#else
+        ::close(fd);
+#endif
+    }
+
+    std::unique_ptr<FdSink> FdSink::openFile(const std::string& path) {
+#ifdef _WIN32
+        const int fd = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+        const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+        if (fd < 0) return nullptr;
+        return std::unique_ptr<FdSink>(new FdSink(fd, true));
+    }
+
+    FdSink& FdSink::standardOutput() {
+        static FdSink out(1, false);
+        return out;
+    }
+
+    bool FdSink::write(const OutputChunk* chunks, size_t count) {
+#ifdef _WIN32
+        for (size_t i = 0; i < count; ++i) {
+            if (!write_all(fd, chunks[i].data, chunks[i].size)) return false;
+        }
+        return true;
+#else
+        // writev 一次最多 IOV_MAX 段；部分写入时从中断处继续
+        iovec iov[64];
+        const size_t maxIov = std::min<size_t>(64, IOV_MAX);
+        size_t i = 0, offset = 0;
+        while (i < count) {
+            size_t n = 0;
+            for (size_t j = i; j < count && n < maxIov; ++j) {
+                const size_t skip = (j == i) ? offset : 0;
+                if (chunks[j].size == skip) continue;
+                iov[n].iov_base = const_cast<char*>(chunks[j].data + skip);
+                iov[n].iov_len = chunks[j].size - skip;
+                ++n;
+            }
+            if (n == 0) break;
+            const ssize_t w = ::writev(fd, iov, (int)n);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) return false;
+            size_t left = (size_t)w;
+            while (i < count && left >= chunks[i].size - offset) {
+                left -= chunks[i].size - offset;
+                offset = 0;
+                ++i;
+            }
+            offset += left;
+        }
+        return true;
+#endif
+    }
+
+    bool CallbackSink::write(const OutputChunk* chunks, size_t count) {
+        for (size_t i = 0; i < count; ++i) fn(chunks[i].data, chunks[i].size);
+        return true;
+    }
+
+    bool StringSink::write(const OutputChunk* chunks, size_t count) {
+        for (size_t i = 0; i < count; ++i) out.append(chunks[i].data, chunks[i].size);
+        return true;
+    }
+
+    bool TeeSink::write(const OutputChunk* chunks, size_t count) {
+        if (!first.write(chunks, count)) return false;
+        if (overflow) return true;
+        size_t total = copy.size();
+        for (size_t i = 0; i < count; ++i) total += chunks[i].size;
+        if (total > limit) {
+            overflow = true;
+            std::string().swap(copy);
+            return true;
+        }
+        for (size_t i = 0; i < count; ++i) copy.append(chunks[i].data, chunks[i].size);
+        return true;
+    }
+
+    OrderedWriter::OrderedWriter(OutputSink& sink, size_t chunkCount)
+        : sink(sink), slots(chunkCount), ready(chunkCount, 0), startTicks(HiResClock::ticks()) {
+        batch.reserve(chunkCount);
+        batchChunks.reserve(chunkCount);
+    }
+
+    std::string OrderedWriter::acquire() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (freeBuffers.empty()) return std::string();
+        std::string buf = std::move(freeBuffers.back());
+        freeBuffers.pop_back();
+        buf.clear();
+        return buf;
+    }
+
+    void OrderedWriter::submit(size_t seq, std::string&& chunk) {
+        std::unique_lock<std::mutex> lock(mutex);
+        pendingBytes += chunk.size();
+        peakPending = std::max(peakPending, pendingBytes);
+        slots[seq] = std::move(chunk);
+        ready[seq] = 1;
+        if (seq == next && !flushing) drain(lock);
+    }
+
+    // 调用时持有锁；写 sink 期间释放锁，写完后再检查是否有新的连续块就绪
+    void OrderedWriter::drain(std::unique_lock<std::mutex>& lock) {
+        flushing = true;
+        while (next < slots.size() && ready[next]) {
+            batch.clear();
+            batchChunks.clear();
+            size_t bytes = 0;
+            while (next < slots.size() && ready[next]) {
+                batch.push_back(std::move(slots[next]));
+                bytes += batch.back().size();
+                ++next;
+            }
+            const bool skip = failed;
+            lock.unlock();
+            bool ok = true;
+            if (!skip) {
+                for (const auto& s : batch) batchChunks.push_back(OutputChunk{s.data(), s.size()});
+                ok = sink.write(batchChunks.data(), batchChunks.size());
+            }
+            lock.lock();
+            if (!firstWriteTicks && !skip) firstWriteTicks = HiResClock::ticks();
+            if (!ok) failed = true;
+            pendingBytes -= bytes;
+            for (auto& s : batch) freeBuffers.push_back(std::move(s));
+        }
+        flushing = false;
+    }
+
+    bool OrderedWriter::complete() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return next == slots.size() && !failed;
+    }
+
+    uint64_t OrderedWriter::firstWriteUs() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return firstWriteTicks ? (uint64_t)HiResClock::to_us(firstWriteTicks - startTicks) : 0;
+    }
+
+    size_t OrderedWriter::peakPendingBytes() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return peakPending;
+    }
+
+} // namespace PicConvertor
@@ -0,0 +1,142 @@
+#pragma once
+#ifndef PICCONVERTOR_OUTPUT_SINK_H
+#define PICCONVERTOR_OUTPUT_SINK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace PicConvertor {
+
+    // 一段待写出的连续字节
+    struct OutputChunk {
+        const char* data;
+        size_t size;
+    };
+
+    /**
+     * @brief 渲染输出的目的地。
+     *
+     * write 按给定顺序写出一组 chunk（POSIX 下对文件描述符使用 writev 一次提交）。
+     * 由 OrderedWriter 串行调用，实现无需自行加锁。
+     */
+    class OutputSink {
+    public:
+        virtual ~OutputSink() = default;
+        // 返回 false 表示写入失败，此后的输出会被丢弃
+        virtual bool write(const OutputChunk* chunks, size_t count) = 0;
+    };
+
+    /**
+     * @brief 写入文件描述符（stdout 或 openFile 打开的文件）。
+     */
+    class FdSink : public OutputSink {
+    public:
+        explicit FdSink(int fd, bool ownsFd = false) : fd(fd), ownsFd(ownsFd) {}
+        ~FdSink() override;
+
+        // 以截断方式创建/打开输出文件；失败时返回 nullptr
+        static std::unique_ptr<FdSink> openFile(const std::string& path);
+        static FdSink& standardOutput();
+
+        bool write(const OutputChunk* chunks, size_t count) override;
+
+        FdSink(const FdSink&) = delete;
+        FdSink& operator=(const FdSink&) = delete;
+
+    private:
+        int fd;
+        bool ownsFd;
+    };
+
+    /**
+     * @brief 把每个 chunk 交给回调（例如写入 socket 或测试缓冲区）。
+     */
+    class CallbackSink : public OutputSink {
+    public:
+        explicit CallbackSink(std::function<void(const char*, size_t)> fn) : fn(std::move(fn)) {}
+        bool write(const OutputChunk* chunks, size_t count) override;
+
+    private:
+        std::function<void(const char*, size_t)> fn;
+    };
+
+    /**
+     * @brief 追加到 std::string，供仍需要完整输出字符串的调用方使用。
+     */
+    class StringSink : public OutputSink {
+    public:
+        explicit StringSink(std::string& out) : out(out) {}
+        bool write(const OutputChunk* chunks, size_t count) override;
+
+    private:
+        std::string& out;
+    };
+
+    /**
+     * @brief 写入 first 的同时把成功写出的字节追加到 copy（例如在流式输出时收集结果以写入渲染缓存）。
+     *
+     * 副本超过 limit 字节时释放 copy 并停止复制（overflowed() 为 true），输出照常写入 first。
+     */
+    class TeeSink : public OutputSink {
+    public:
+        TeeSink(OutputSink& first, std::string& copy, size_t limit = SIZE_MAX) : first(first), copy(copy), limit(limit) {}
+        bool write(const OutputChunk* chunks, size_t count) override;
+        bool overflowed() const { return overflow; }
+
+    private:
+        OutputSink& first;
+        std::string& copy;
+        size_t limit;
+        bool overflow = false;
+    };
+
+    /**
+     * @brief 有序重排缓冲：工作线程以任意顺序提交编号为 [0, chunkCount) 的输出块，
+     * 连续就绪的块按编号顺序批量写入 sink，写出后的缓冲区回收复用。
+     *
+     * 同一时刻只有一个线程在写 sink（不持锁），其余线程提交后立即返回；
+     * 因此完整输出从不在内存中拼接，驻留的只有尚未轮到的乱序块。
+     */
+    class OrderedWriter {
+    public:
+        OrderedWriter(OutputSink& sink, size_t chunkCount);
+
+        // 取得一个已清空的缓冲区（复用已写出块的容量）
+        std::string acquire();
+        // 提交第 seq 块；若它恰好是下一个待写块，则由当前线程写出所有连续就绪的块
+        void submit(size_t seq, std::string&& chunk);
+
+        // 全部块都已写出且 sink 未报告错误
+        bool complete() const;
+        // 自构造起到第一块写出的微秒数；尚未写出时为 0
+        uint64_t firstWriteUs() const;
+        // 等待写出的乱序块在任一时刻占用的最大字节数
+        size_t peakPendingBytes() const;
+
+    private:
+        void drain(std::unique_lock<std::mutex>& lock);
+
+        OutputSink& sink;
+        mutable std::mutex mutex;
+        std::vector<std::string> slots;
+        std::vector<uint8_t> ready;
+        std::vector<std::string> freeBuffers;
+        std::vector<std::string> batch;        // 正在写出的块（仅 drain 线程访问）
+        std::vector<OutputChunk> batchChunks;
+        size_t next = 0;
+        bool flushing = false;
+        bool failed = false;
+        size_t pendingBytes = 0;
+        size_t peakPending = 0;
+        uint64_t startTicks;
+        uint64_t firstWriteTicks = 0;
+    };
+
+} // namespace PicConvertor
+
+#endif // PICCONVERTOR_OUTPUT_SINK_H
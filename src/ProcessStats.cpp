@@ -0,0 +1,27 @@
+#include "ProcessStats.h"
+#ifdef _WIN32
+    #include <windows.h>
+    #include <psapi.h>
+#else
+    #include <sys/resource.h>
+#endif
+
+namespace PicConvertor {
+
+    size_t peakRssBytes() {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS pmc;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return (size_t)pmc.PeakWorkingSetSize;
+        return 0;
+#else
+        rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#if defined(__APPLE__)
+        return (size_t)usage.ru_maxrss;          // macOS 以字节为单位
+#else
+        return (size_t)usage.ru_maxrss * 1024;   // Linux 以 KB 为单位
+#endif
+#endif
+    }
+
+} // namespace PicConvertor
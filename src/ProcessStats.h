@@ -0,0 +1,16 @@
+#pragma once
+#ifndef PICCONVERTOR_PROCESS_STATS_H
+#define PICCONVERTOR_PROCESS_STATS_H
+
+#include <cstddef>
+
+namespace PicConvertor {
+
+    /**
+     * @brief 进程迄今为止的峰值常驻内存（字节）；平台不支持时返回 0。
+     */
+    size_t peakRssBytes();
+
+} // namespace PicConvertor
+
+#endif // PICCONVERTOR_PROCESS_STATS_H
@@ -0,0 +1,382 @@
+#include "RenderCache.h"
+#include "MappedFile.h"
+#include "OutputSink.h"
+#include "timing.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/file.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace PicConvertor {
+
+    static constexpr uint32_t kIndexMagic = 0x58444352;  // "RCDX"
+    static constexpr uint32_t kRecordMagic = 0x43455243; // "RCEC"
+    static constexpr uint32_t kIndexVersion = 1;
+    static constexpr int kProbeLimit = 32;
+
+    // 索引文件头；所有字段只在持有 flock 时读写
+    struct RenderCache::Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t slotCount;
+        uint32_t segments;
+        uint64_t segmentLimit;  // 每个数据段的字节上限
+        uint32_t currentGen;    // 正在追加的数据段
+        uint32_t oldestGen;     // 仍存在的最旧数据段；gen 更小的槽位已失效
+        uint64_t currentSize;   // 当前数据段已提交的字节数
+        uint64_t reserved[4];
+    };
+
+    // gen == 0 表示从未使用；探测在空槽处停止，槽位只会被覆盖、不会被清空
+    struct RenderCache::Slot {
+        uint64_t contentHash;
+        uint64_t contentSize;
+        uint64_t optionsHash;
+        uint64_t offset;        // 记录头在数据段中的偏移
+        uint32_t length;        // 输出字节数（不含记录头）
+        uint32_t gen;
+    };
+
+    // 数据段中每条记录的头部，查找时与槽位交叉校验
+    struct RecordHeader {
+        uint32_t magic;
+        uint32_t length;
+        uint64_t contentHash;
+        uint64_t contentSize;
+        uint64_t optionsHash;
+    };
+
+    static_assert(sizeof(RecordHeader) == 32, "record header layout");
+
+    static bool sameKey(const RenderCacheKey& key, uint64_t contentHash, uint64_t contentSize, uint64_t optionsHash) {
+        return key.contentHash == contentHash && key.contentSize == contentSize && key.optionsHash == optionsHash;
+    }
+
+    // ---- 哈希 ----
+
+    static constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ull;
+    static constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4Full;
+    static constexpr uint64_t kPrime3 = 0x165667B19E3779F9ull;
+    static constexpr uint64_t kPrime4 = 0x85EBCA77C2B2AE63ull;
+    static constexpr uint64_t kPrime5 = 0x27D4EB2F165667C5ull;
+
+    static inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+    static inline uint64_t load64(const uint8_t* p) { uint64_t v; std::memcpy(&v, p, 8); return v; }
+    static inline uint32_t load32(const uint8_t* p) { uint32_t v; std::memcpy(&v, p, 4); return v; }
+    static inline uint64_t mixRound(uint64_t acc, uint64_t input) { return rotl(acc + input * kPrime2, 31) * kPrime1; }
+    static inline uint64_t merge(uint64_t acc, uint64_t val) { return (acc ^ mixRound(0, val)) * kPrime1 + kPrime4; }
+
+    uint64_t RenderCache::hashBytes(const void* data, size_t size, uint64_t seed) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        const uint8_t* const end = p + size;
+        uint64_t h;
+        if (size >= 32) {
+            // 4 条独立的累加链，每轮消费 32 字节
+            uint64_t v1 = seed + kPrime1 + kPrime2, v2 = seed + kPrime2, v3 = seed, v4 = seed - kPrime1;
+            const uint8_t* const limit = end - 32;
+            do {
+                v1 = mixRound(v1, load64(p));
+                v2 = mixRound(v2, load64(p + 8));
+                v3 = mixRound(v3, load64(p + 16));
+                v4 = mixRound(v4, load64(p + 24));
+                p += 32;
+            } while (p <= limit);
+            h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+            h = merge(merge(merge(merge(h, v1), v2), v3), v4);
+        } else {
+            h = seed + kPrime5;
+        }
+        h += (uint64_t)size;
+        for (; p + 8 <= end; p += 8) h = rotl(h ^ mixRound(0, load64(p)), 27) * kPrime1 + kPrime4;
+        if (p + 4 <= end) { h = rotl(h ^ (uint64_t)load32(p) * kPrime1, 23) * kPrime2 + kPrime3; p += 4; }
+        for (; p < end; ++p) h = rotl(h ^ (uint64_t)*p * kPrime5, 11) * kPrime1;
+        h ^= h >> 33; h *= kPrime2;
+        h ^= h >> 29; h *= kPrime3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    RenderCacheKey RenderCache::makeKey(const uint8_t* content, size_t size, uint64_t optionsHash) {
+        RenderCacheKey key;
+        key.contentHash = hashBytes(content, size);
+        key.contentSize = size;
+        key.optionsHash = optionsHash;
+        return key;
+    }
+
+    // ---- 统计 ----
+
+    RenderCache::Stats RenderCache::stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return counters;
+    }
+
+    std::string RenderCache::formatStats() const {
+        const Stats s = stats();
+        const auto avg = [](uint64_t us, uint64_t n) { return std::to_string(n ? us / n : 0); };
+        return "Render cache: " + std::to_string(s.hits) + " hits (avg " + avg(s.hitUs, s.hits) + "us), "
+             + std::to_string(s.misses) + " misses (avg " + avg(s.missUs, s.misses) + "us), "
+             + std::to_string(s.stores) + " stores, " + std::to_string(s.promotions) + " promotions, "
+             + std::to_string(s.evictedSegments) + " evicted segments, " + std::to_string(s.bytesServed / 1024) + " KB served";
+    }
+
+    RenderCache::~RenderCache() { close(); }
+
+#ifndef _WIN32
+    void RenderCache::lockFile(bool exclusive) {
+        while (::flock(fd, exclusive ? LOCK_EX : LOCK_SH) != 0 && errno == EINTR) {}
+    }
+
+    void RenderCache::unlockFile() { ::flock(fd, LOCK_UN); }
+
+    std::string RenderCache::packPath(uint32_t gen) const { return opts.dir + "/pack." + std::to_string(gen); }
+
+    bool RenderCache::open(const Options& options, std::string& error) {
+        close();
+        opts = options;
+        opts.segments = std::max(1, opts.segments);
+        opts.slots = std::max<uint32_t>(opts.slots, kProbeLimit);
+        if (::mkdir(opts.dir.c_str(), 0755) != 0 && errno != EEXIST) {
+            error = opts.dir + ": " + std::strerror(errno);
+            return false;
+        }
+        const std::string path = opts.dir + "/index";
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) { error = path + ": " + std::strerror(errno); return false; }
+
+        // 在排他锁下检查/初始化索引，避免两个进程同时创建
+        lockFile(true);
+        struct stat st;
+        bool ok = ::fstat(fd, &st) == 0;
+        if (ok && st.st_size == 0) {
+            Header h{};
+            h.magic = kIndexMagic;
+            h.version = kIndexVersion;
+            h.slotCount = opts.slots;
+            h.segments = (uint32_t)opts.segments;
+            h.segmentLimit = std::max<uint64_t>(opts.maxBytes / (uint64_t)opts.segments, 4096);
+            h.currentGen = 1;
+            h.oldestGen = 1;
+            const off_t bytes = (off_t)(sizeof(Header) + (size_t)h.slotCount * sizeof(Slot));
+            ok = ::ftruncate(fd, bytes) == 0 && ::pwrite(fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h);
+            st.st_size = bytes;
+            if (!ok) error = path + ": " + std::strerror(errno);
+        } else if (!ok) {
+            error = path + ": " + std::strerror(errno);
+        }
+        Header h{};
+        if (ok && (::pread(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) || h.magic != kIndexMagic || h.version != kIndexVersion
+                   || h.slotCount < (uint32_t)kProbeLimit || h.segments == 0 || h.segmentLimit == 0
+                   || (off_t)(sizeof(Header) + (size_t)h.slotCount * sizeof(Slot)) != st.st_size)) {
+            error = path + ": not a compatible render cache index";
+            ok = false;
+        }
+        if (ok) {
+            void* p = ::mmap(nullptr, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (p == MAP_FAILED) {
+                error = path + ": mmap: " + std::strerror(errno);
+                ok = false;
+            } else {
+                index = static_cast<uint8_t*>(p);
+                indexBytes = (size_t)st.st_size;
+                // 已有索引的参数以文件为准
+                opts.segments = (int)h.segments;
+                opts.maxBytes = h.segmentLimit * h.segments;
+            }
+        }
+        unlockFile();
+        if (!ok) { ::close(fd); fd = -1; }
+        return ok;
+    }
+
+    void RenderCache::close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        packs.clear();
+        if (index) ::munmap(index, indexBytes);
+        index = nullptr;
+        indexBytes = 0;
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+    }
+
+    int64_t RenderCache::findSlot(const RenderCacheKey& key) const {
+        const Header* h = reinterpret_cast<const Header*>(index);
+        const Slot* slots = reinterpret_cast<const Slot*>(index + sizeof(Header));
+        const uint32_t start = (uint32_t)(key.contentHash ^ key.optionsHash) % h->slotCount;
+        for (int i = 0; i < kProbeLimit; ++i) {
+            const uint32_t idx = (start + (uint32_t)i) % h->slotCount;
+            const Slot& s = slots[idx];
+            if (s.gen == 0) break;
+            if (s.gen >= h->oldestGen && sameKey(key, s.contentHash, s.contentSize, s.optionsHash)) return idx;
+        }
+        return -1;
+    }
+
+    std::shared_ptr<MappedFile> RenderCache::packMapping(uint32_t gen, uint64_t end) {
+        auto it = packs.find(gen);
+        if (it != packs.end() && it->second->size() >= end) return it->second;
+        // 数据段在映射之后又有追加：重新映射（旧映射由仍在写出的调用方持有，直到其释放）
+        auto mapped = std::make_shared<MappedFile>();
+        std::string error;
+        if (!mapped->open(packPath(gen), error) || mapped->size() < end) return nullptr;
+        packs[gen] = mapped;
+        return mapped;
+    }
+
+    bool RenderCache::lookup(const RenderCacheKey& key, OutputSink& sink, bool* sinkOk) {
+        if (!index) return false;
+        Stopwatch sw;
+        std::shared_ptr<MappedFile> pack;
+        const uint8_t* data = nullptr;
+        uint32_t length = 0;
+        bool promote = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            lockFile(false);
+            const Header* h = reinterpret_cast<const Header*>(index);
+            // 其他共享目录的进程淘汰（unlink）的数据段：释放本进程的映射，否则其磁盘空间一直无法回收
+            packs.erase(packs.begin(), packs.lower_bound(h->oldestGen));
+            const int64_t idx = findSlot(key);
+            if (idx >= 0) {
+                const Slot s = reinterpret_cast<const Slot*>(index + sizeof(Header))[idx];
+                pack = packMapping(s.gen, s.offset + sizeof(RecordHeader) + s.length);
+                if (pack) {
+                    RecordHeader rec;
+                    std::memcpy(&rec, pack->data() + s.offset, sizeof(rec));
+                    if (rec.magic == kRecordMagic && rec.length == s.length
+                        && sameKey(key, rec.contentHash, rec.contentSize, rec.optionsHash)) {
+                        data = pack->data() + s.offset + sizeof(RecordHeader);
+                        length = s.length;
+                        // 位于较旧一半数据段中的条目重新追加到当前段，避免被优先淘汰
+                        promote = s.gen + (h->segments + 1) / 2 <= h->currentGen;
+                    }
+                }
+            }
+            unlockFile();
+            if (!data) { ++counters.misses; return false; }
+        }
+        // 数据段只追加、淘汰时只 unlink，映射在写出期间保持有效，无需持锁
+        const OutputChunk chunk{reinterpret_cast<const char*>(data), length};
+        const bool ok = sink.write(&chunk, 1);
+        if (sinkOk) *sinkOk = ok;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (promote) {
+            lockFile(true);
+            if (appendLocked(key, data, length)) ++counters.promotions;
+            unlockFile();
+        }
+        ++counters.hits;
+        counters.hitUs += sw.elapsed_us();
+        counters.bytesServed += length;
+        return true;
+    }
+
+    bool RenderCache::store(const RenderCacheKey& key, const std::string& output, uint64_t missUs) {
+        std::lock_guard<std::mutex> lock(mutex);
+        counters.missUs += missUs;
+        if (!index) return false;
+        const Header* h = reinterpret_cast<const Header*>(index);
+        if (output.size() + sizeof(RecordHeader) > h->segmentLimit || output.size() > UINT32_MAX) return false;
+        lockFile(true);
+        // 其他进程可能已经保存了同一结果
+        const bool ok = findSlot(key) >= 0 || appendLocked(key, reinterpret_cast<const uint8_t*>(output.data()), output.size());
+        unlockFile();
+        if (ok) ++counters.stores;
+        return ok;
+    }
+
+    size_t RenderCache::maxEntryBytes() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!index) return 0;
+        const Header* h = reinterpret_cast<const Header*>(index);
+        return (size_t)std::min<uint64_t>(h->segmentLimit - sizeof(RecordHeader), UINT32_MAX);
+    }
+
+    bool RenderCache::rotateLocked() {
+        Header* h = reinterpret_cast<Header*>(index);
+        ++h->currentGen;
+        h->currentSize = 0;
+        while (h->currentGen - h->oldestGen >= h->segments) {
+            ::unlink(packPath(h->oldestGen).c_str());
+            packs.erase(h->oldestGen);
+            ++h->oldestGen;
+            ++counters.evictedSegments;
+        }
+        return true;
+    }
+
+    static bool writeAt(int fd, const uint8_t* p, size_t n, uint64_t offset) {
+        while (n > 0) {
+            const ssize_t w = ::pwrite(fd, p, n, (off_t)offset);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) return false;
+            p += w; n -= (size_t)w; offset += (uint64_t)w;
+        }
+        return true;
+    }
+
+    bool RenderCache::appendLocked(const RenderCacheKey& key, const uint8_t* data, size_t size) {
+        Header* h = reinterpret_cast<Header*>(index);
+        Slot* slots = reinterpret_cast<Slot*>(index + sizeof(Header));
+        const uint64_t recordBytes = sizeof(RecordHeader) + size;
+        if (recordBytes > h->segmentLimit) return false;
+        if (h->currentSize > 0 && h->currentSize + recordBytes > h->segmentLimit) rotateLocked();
+
+        // 记录先写入数据段，再发布到槽位：中途失败的写入不会被任何槽位引用，下一次追加直接覆盖
+        const int pfd = ::open(packPath(h->currentGen).c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (pfd < 0) return false;
+        const RecordHeader rec{kRecordMagic, (uint32_t)size, key.contentHash, key.contentSize, key.optionsHash};
+        const uint64_t offset = h->currentSize;
+        const bool ok = writeAt(pfd, reinterpret_cast<const uint8_t*>(&rec), sizeof(rec), offset)
+                        && writeAt(pfd, data, size, offset + sizeof(rec));
+        ::close(pfd);
+        if (!ok) return false;
+
+        // 槽位优先级：同一键 > 空槽或已失效的槽 > 探测窗口内最旧的条目
+        const uint32_t start = (uint32_t)(key.contentHash ^ key.optionsHash) % h->slotCount;
+        int64_t free = -1, victim = -1, match = -1;
+        for (int i = 0; i < kProbeLimit && match < 0; ++i) {
+            const uint32_t idx = (start + (uint32_t)i) % h->slotCount;
+            const Slot& s = slots[idx];
+            if (s.gen == 0) { if (free < 0) free = idx; break; }
+            if (s.gen < h->oldestGen) { if (free < 0) free = idx; continue; }
+            if (sameKey(key, s.contentHash, s.contentSize, s.optionsHash)) match = idx;
+            else if (victim < 0 || s.gen < slots[victim].gen) victim = idx;
+        }
+        const int64_t idx = match >= 0 ? match : free >= 0 ? free : victim;
+        Slot& s = slots[idx];
+        s.contentHash = key.contentHash;
+        s.contentSize = key.contentSize;
+        s.optionsHash = key.optionsHash;
+        s.offset = offset;
+        s.length = (uint32_t)size;
+        s.gen = h->currentGen;
+        h->currentSize = offset + recordBytes;
+        return true;
+    }
+#else
+    void RenderCache::lockFile(bool) {}
+    void RenderCache::unlockFile() {}
+    std::string RenderCache::packPath(uint32_t gen) const { return opts.dir + "/pack." + std::to_string(gen); }
+
+    bool RenderCache::open(const Options&, std::string& error) {
+        error = "--cache-dir is not supported on Windows";
+        return false;
+    }
+
+    void RenderCache::close() {}
+    int64_t RenderCache::findSlot(const RenderCacheKey&) const { return -1; }
+    std::shared_ptr<MappedFile> RenderCache::packMapping(uint32_t, uint64_t) { return nullptr; }
+    bool RenderCache::lookup(const RenderCacheKey&, OutputSink&, bool*) { return false; }
+    bool RenderCache::store(const RenderCacheKey&, const std::string&, uint64_t) { return false; }
+    bool RenderCache::rotateLocked() { return false; }
+    bool RenderCache::appendLocked(const RenderCacheKey&, const uint8_t*, size_t) { return false; }
+#endif
+
+} // namespace PicConvertor
@@ -0,0 +1,106 @@
+#pragma once
+#ifndef PICCONVERTOR_RENDER_CACHE_H
+#define PICCONVERTOR_RENDER_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace PicConvertor {
+
+    class OutputSink;
+    class MappedFile;
+
+    // 缓存键：输入字节的哈希与长度 + 影响输出的转换选项的哈希
+    struct RenderCacheKey {
+        uint64_t contentHash = 0;
+        uint64_t contentSize = 0;
+        uint64_t optionsHash = 0;
+    };
+
+    /**
+     * @brief 按内容寻址的磁盘渲染缓存（--cache-dir）。
+     *
+     * 目录中为一个定长槽位的索引文件 index（MAP_SHARED 映射，开放寻址）与若干只追加的数据段 pack.<gen>。
+     * 查找在共享锁下探测映射的索引，命中后直接从映射的数据段写入 sink，不经过读缓冲；
+     * 写入在排他锁下把记录追加到当前段并更新槽位。跨进程用 flock 加锁，进程内另有互斥量。
+     *
+     * 淘汰按段进行：当前段写满后开启新段，段数超过 segments 时删除最旧的段（其中的条目随之失效）；
+     * 命中较旧段中的条目时把它重新追加到当前段，因此长期未被访问的条目先被淘汰（近似 LRU），
+     * 数据段总大小不超过 maxBytes；超过单段上限的输出不缓存。
+     * 仅支持 POSIX；Windows 下 open 返回 false。
+     */
+    class RenderCache {
+    public:
+        struct Options {
+            std::string dir;
+            uint64_t maxBytes = 256ull << 20;
+            int segments = 4;               // 同时保留的数据段数
+            uint32_t slots = 1u << 14;      // 索引槽位数（仅在创建索引时使用）
+        };
+
+        struct Stats {
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            uint64_t stores = 0;
+            uint64_t promotions = 0;        // 命中旧段后重新追加到当前段的条目
+            uint64_t evictedSegments = 0;   // 本进程删除的数据段
+            uint64_t bytesServed = 0;
+            uint64_t hitUs = 0;             // 命中：查找 + 写出的累计耗时
+            uint64_t missUs = 0;            // 未命中：调用方报告的解码 + 重采样 + 渲染累计耗时
+        };
+
+        RenderCache() = default;
+        ~RenderCache();
+        RenderCache(const RenderCache&) = delete;
+        RenderCache& operator=(const RenderCache&) = delete;
+
+        // 打开（必要时创建）缓存目录；失败时返回 false 并写入 error
+        bool open(const Options& options, std::string& error);
+        void close();
+        bool isOpen() const { return index != nullptr; }
+
+        // 64 位非加密哈希（xxHash64 风格的 4 路 32 字节条带），用于输入内容与选项
+        static uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0);
+        static RenderCacheKey makeKey(const uint8_t* content, size_t size, uint64_t optionsHash);
+
+        // 命中时把缓存的输出写入 sink 并返回 true；*sinkOk 为 sink 的写入结果
+        bool lookup(const RenderCacheKey& key, OutputSink& sink, bool* sinkOk = nullptr);
+        // 保存一次未命中的渲染结果；missUs 为其解码到写出的耗时（计入统计）
+        bool store(const RenderCacheKey& key, const std::string& output, uint64_t missUs);
+        // 可以保存的最大输出字节数（单段上限减去记录头）；未打开时为 0
+        size_t maxEntryBytes() const;
+
+        Stats stats() const;
+        std::string formatStats() const;
+
+    private:
+        struct Header;
+        struct Slot;
+
+        // 在已持有锁时查找；返回槽位下标或 -1
+        int64_t findSlot(const RenderCacheKey& key) const;
+        // 在排他锁下追加记录并更新槽位
+        bool appendLocked(const RenderCacheKey& key, const uint8_t* data, size_t size);
+        bool rotateLocked();
+        // 取得 gen 段至少覆盖 [0, end) 的映射（必要时重新映射）
+        std::shared_ptr<MappedFile> packMapping(uint32_t gen, uint64_t end);
+        std::string packPath(uint32_t gen) const;
+        void lockFile(bool exclusive);
+        void unlockFile();
+
+        Options opts;
+        int fd = -1;
+        uint8_t* index = nullptr;   // 映射的索引文件
+        size_t indexBytes = 0;
+        mutable std::mutex mutex;   // 进程内串行化（flock 属于打开的文件描述，线程间不互斥）
+        std::map<uint32_t, std::shared_ptr<MappedFile>> packs;
+        Stats counters;
+    };
+
+} // namespace PicConvertor
+
+#endif // PICCONVERTOR_RENDER_CACHE_H
@@ -0,0 +1,173 @@
+#include "ServeProtocol.h"
+#include "OutputSink.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#ifndef _WIN32
+    #include <sys/socket.h>
+    #include <sys/uio.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+#endif
+
+namespace PicConvertor {
+
+    static void putU32(std::string& out, uint32_t v) {
+        const char b[4] = {(char)(v & 0xFF), (char)((v >> 8) & 0xFF), (char)((v >> 16) & 0xFF), (char)((v >> 24) & 0xFF)};
+        out.append(b, 4);
+    }
+
+    static uint32_t getU32(const uint8_t* p) {
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    static constexpr size_t kRequestHeaderBytes = 4 + 4 + 4 * 4 + 4;
+
+    std::string encodeServeRequest(const ServeRequest& request) {
+        std::string out;
+        out.reserve(4 + kRequestHeaderBytes + request.data.size());
+        putU32(out, (uint32_t)(kRequestHeaderBytes + request.data.size()));
+        putU32(out, kServeMagic);
+        const uint8_t flags = (uint8_t)((request.inlineData ? 1 : 0) | (request.lowDirect ? 2 : 0) | (request.tiled ? 4 : 0));
+        out.push_back((char)flags);
+        out.push_back((char)(request.high ? 1 : 0));
+        out.append(2, '\0');
+        putU32(out, (uint32_t)request.width);
+        putU32(out, (uint32_t)request.height);
+        putU32(out, (uint32_t)request.prune);
+        putU32(out, (uint32_t)request.memo);
+        putU32(out, (uint32_t)request.data.size());
+        out += request.data;
+        return out;
+    }
+
+    bool decodeServeRequest(const uint8_t* payload, size_t size, ServeRequest& out) {
+        if (size < kRequestHeaderBytes || getU32(payload) != kServeMagic) return false;
+        const uint8_t flags = payload[4];
+        out.inlineData = (flags & 1) != 0;
+        out.lowDirect = (flags & 2) != 0;
+        out.tiled = (flags & 4) != 0;
+        out.high = payload[5] != 0;
+        out.width = (int32_t)getU32(payload + 8);
+        out.height = (int32_t)getU32(payload + 12);
+        out.prune = (int32_t)getU32(payload + 16);
+        out.memo = (int32_t)getU32(payload + 20);
+        const uint32_t dataLen = getU32(payload + 24);
+        if (dataLen != size - kRequestHeaderBytes) return false;
+        out.data.assign((const char*)payload + kRequestHeaderBytes, dataLen);
+        return true;
+    }
+
+#ifndef _WIN32
+    bool readFull(int fd, void* buf, size_t n) {
+        char* p = static_cast<char*>(buf);
+        while (n > 0) {
+            const ssize_t r = ::read(fd, p, n);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) return false;
+            p += r; n -= (size_t)r;
+        }
+        return true;
+    }
+
+    bool writeFull(int fd, const void* buf, size_t n) {
+        const char* p = static_cast<const char*>(buf);
+        while (n > 0) {
+            const ssize_t w = ::write(fd, p, n);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) return false;
+            p += w; n -= (size_t)w;
+        }
+        return true;
+    }
+
+    bool writeServeFrames(int fd, const char* const* data, const size_t* sizes, size_t count) {
+        // 帧头与数据交替排列，交给 FdSink 一次 writev（含部分写入的续写）
+        constexpr size_t kBatch = 32;
+        char headers[kBatch][4];
+        OutputChunk chunks[kBatch * 2];
+        FdSink sink(fd, false);
+        size_t i = 0;
+        while (i < count) {
+            size_t n = 0, h = 0;
+            for (; i < count && h < kBatch; ++i) {
+                if (sizes[i] == 0) continue;
+                const uint32_t len = (uint32_t)sizes[i];
+                headers[h][0] = (char)(len & 0xFF); headers[h][1] = (char)((len >> 8) & 0xFF);
+                headers[h][2] = (char)((len >> 16) & 0xFF); headers[h][3] = (char)((len >> 24) & 0xFF);
+                chunks[n++] = OutputChunk{headers[h], 4};
+                chunks[n++] = OutputChunk{data[i], sizes[i]};
+                ++h;
+            }
+            if (n > 0 && !sink.write(chunks, n)) return false;
+        }
+        return true;
+    }
+
+    bool writeServeTrailer(int fd, ServeStatus status, const std::string& message) {
+        std::string out;
+        putU32(out, 0);
+        putU32(out, (uint32_t)status);
+        putU32(out, (uint32_t)message.size());
+        out += message;
+        return writeFull(fd, out.data(), out.size());
+    }
+
+    ServeClient::~ServeClient() { close(); }
+
+    bool ServeClient::connect(const std::string& socketPath, std::string& error) {
+        close();
+        sockaddr_un addr{};
+        if (socketPath.size() >= sizeof(addr.sun_path)) { error = "socket path too long"; return false; }
+        addr.sun_family = AF_UNIX;
+        std::memcpy(addr.sun_path, socketPath.c_str(), socketPath.size() + 1);
+        fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) { error = std::strerror(errno); return false; }
+        if (::connect(fd, (const sockaddr*)&addr, sizeof(addr)) != 0) {
+            error = std::string("connect ") + socketPath + ": " + std::strerror(errno);
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void ServeClient::close() {
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+    }
+
+    bool ServeClient::request(const ServeRequest& request, OutputSink& out, ServeResult& result) {
+        result = ServeResult{};
+        const std::string frame = encodeServeRequest(request);
+        if (fd < 0 || !writeFull(fd, frame.data(), frame.size())) { close(); return false; }
+        for (;;) {
+            uint8_t hdr[4];
+            if (!readFull(fd, hdr, 4)) { close(); return false; }
+            const uint32_t len = getU32(hdr);
+            if (len == 0) break;
+            buffer.resize(len);
+            if (!readFull(fd, &buffer[0], len)) { close(); return false; }
+            result.bytes += len;
+            const OutputChunk chunk{buffer.data(), buffer.size()};
+            if (result.outputOk) result.outputOk = out.write(&chunk, 1);
+        }
+        uint8_t trailer[8];
+        if (!readFull(fd, trailer, 8)) { close(); return false; }
+        result.status = (ServeStatus)getU32(trailer);
+        result.message.resize(getU32(trailer + 4));
+        if (!result.message.empty() && !readFull(fd, &result.message[0], result.message.size())) { close(); return false; }
+        return true;
+    }
+#else
+    // Windows 构建不提供 --serve（AF_UNIX 仅在部分 Windows 10 版本可用）
+    bool readFull(int, void*, size_t) { return false; }
+    bool writeFull(int, const void*, size_t) { return false; }
+    bool writeServeFrames(int, const char* const*, const size_t*, size_t) { return false; }
+    bool writeServeTrailer(int, ServeStatus, const std::string&) { return false; }
+    ServeClient::~ServeClient() {}
+    bool ServeClient::connect(const std::string&, std::string& error) { error = "--serve is not supported on Windows"; return false; }
+    void ServeClient::close() {}
+    bool ServeClient::request(const ServeRequest&, OutputSink&, ServeResult& result) { result = ServeResult{}; return false; }
+#endif
+
+} // namespace PicConvertor
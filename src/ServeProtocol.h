@@ -0,0 +1,89 @@
+#pragma once
+#ifndef PICCONVERTOR_SERVE_PROTOCOL_H
+#define PICCONVERTOR_SERVE_PROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace PicConvertor {
+
+    class OutputSink;
+
+    // --serve 的线路协议（所有整数为小端）。
+    //
+    // 请求：[u32 长度][载荷]，载荷为
+    //   u32 magic "PCR1" | u8 flags | u8 charset | u16 保留 | i32 width | i32 height | i32 prune | i32 memo | u32 数据长度 | 数据
+    //   flags：bit0 数据为内联的已编码图像（否则为服务端可读的文件路径），bit1 low 直接采样，bit2 tiled 布局
+    // 响应：若干 [u32 长度 > 0][输出字节] 帧（渲染过程中按行带顺序写出），
+    //   以长度为 0 的帧结束，随后为 [u32 status][u32 消息长度][消息]。
+    // 一个连接上可以顺序发送多个请求。
+    constexpr uint32_t kServeMagic = 0x31524350u; // "PCR1"
+
+    enum class ServeStatus : uint32_t {
+        Ok = 0,
+        BadRequest = 1,
+        LoadFailed = 2,
+        RenderFailed = 3,
+        Unavailable = 4, // 客户端侧：连接失败或连接中断
+    };
+
+    struct ServeRequest {
+        bool inlineData = false;
+        std::string data;      // 文件路径或已编码的图像字节
+        int32_t width = 80;
+        int32_t height = 0;    // <= 0 按纵横比推算
+        bool high = false;     // charset：false 为 low
+        int32_t prune = -1;    // < 0 使用服务端默认值（或其调优文件）
+        int32_t memo = -1;
+        bool lowDirect = false;
+        bool tiled = false;
+    };
+
+    struct ServeResult {
+        ServeStatus status = ServeStatus::Unavailable;
+        std::string message;
+        uint64_t bytes = 0;    // 收到的输出字节数
+        bool outputOk = true;  // 输出 sink 写入失败时为 false（其余帧照常读完，连接仍可复用）
+    };
+
+    // 编码完整的请求帧（含长度前缀）
+    std::string encodeServeRequest(const ServeRequest& request);
+    // 解码请求载荷（不含长度前缀）；格式错误时返回 false
+    bool decodeServeRequest(const uint8_t* payload, size_t size, ServeRequest& out);
+
+    // 阻塞式完整读写；对端关闭或出错时返回 false（EINTR 自动重试）
+    bool readFull(int fd, void* buf, size_t n);
+    bool writeFull(int fd, const void* buf, size_t n);
+
+    /**
+     * @brief 把输出块编码为响应帧写入 socket（空块跳过，避免与结束帧混淆）。
+     */
+    bool writeServeFrames(int fd, const char* const* data, const size_t* sizes, size_t count);
+    bool writeServeTrailer(int fd, ServeStatus status, const std::string& message);
+
+    /**
+     * @brief --serve 的客户端：保持一个连接，顺序发送请求，输出帧写入调用方的 sink。
+     */
+    class ServeClient {
+    public:
+        ServeClient() = default;
+        ~ServeClient();
+        ServeClient(const ServeClient&) = delete;
+        ServeClient& operator=(const ServeClient&) = delete;
+
+        bool connect(const std::string& socketPath, std::string& error);
+        void close();
+        bool connected() const { return fd >= 0; }
+
+        // 返回 false 表示连接层面的失败（result.status 为 Unavailable），此后需要重新 connect
+        bool request(const ServeRequest& request, OutputSink& out, ServeResult& result);
+
+    private:
+        int fd = -1;
+        std::string buffer;
+    };
+
+} // namespace PicConvertor
+
+#endif // PICCONVERTOR_SERVE_PROTOCOL_H
@@ -0,0 +1,375 @@
+#include "Server.h"
+#include "ServeProtocol.h"
+#include "OutputSink.h"
+#include "TaskSystem.h"
+#include "Logger.h"
+#include "timing.h"
+#include "convert.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <cerrno>
+#include <exception>
+#include <cstring>
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <sys/time.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+#endif
+
+namespace PicConvertor {
+
+    ConversionServer::ConversionServer(TaskSystem& pool, Options options) : pool(pool), options(std::move(options)) {}
+
+    ConversionServer::~ConversionServer() { stop(); }
+
+#ifndef _WIN32
+    namespace {
+        // 把渲染输出按响应帧写入连接
+        class FrameSink : public OutputSink {
+        public:
+            explicit FrameSink(int fd) : fd(fd) {}
+            bool write(const OutputChunk* chunks, size_t count) override {
+                const char* data[32];
+                size_t sizes[32];
+                for (size_t i = 0; i < count;) {
+                    size_t n = 0;
+                    for (; i < count && n < 32; ++i, ++n) { data[n] = chunks[i].data; sizes[n] = chunks[i].size; }
+                    if (!writeServeFrames(fd, data, sizes, n)) return false;
+                }
+                return true;
+            }
+
+        private:
+            int fd;
+        };
+
+        constexpr int kMaxDimension = 4096;
+        // 请求发送到一半、或发出请求后不读取回复的客户端不会无限占用处理线程
+        constexpr int kSocketTimeoutSec = 30;
+    }
+
+    bool ConversionServer::start(std::string& error) {
+        sockaddr_un addr{};
+        if (options.socketPath.empty() || options.socketPath.size() >= sizeof(addr.sun_path)) {
+            error = "invalid socket path";
+            return false;
+        }
+        addr.sun_family = AF_UNIX;
+        std::memcpy(addr.sun_path, options.socketPath.c_str(), options.socketPath.size() + 1);
+
+        if (!options.cacheDir.empty()) {
+            RenderCache::Options cacheOptions;
+            cacheOptions.dir = options.cacheDir;
+            cacheOptions.maxBytes = options.cacheBytes;
+            if (!cache.open(cacheOptions, error)) return false;
+        }
+
+        // 已存在的 socket 文件：能连上说明另一个实例仍在服务，否则视为残留文件删除
+        {
+            ServeClient probe;
+            std::string ignored;
+            if (probe.connect(options.socketPath, ignored)) {
+                error = options.socketPath + " is already served by another process";
+                return false;
+            }
+            ::unlink(options.socketPath.c_str());
+        }
+
+        listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listenFd < 0 || ::bind(listenFd, (const sockaddr*)&addr, sizeof(addr)) != 0 || ::listen(listenFd, 128) != 0) {
+            error = std::string("bind ") + options.socketPath + ": " + std::strerror(errno);
+            if (listenFd >= 0) ::close(listenFd);
+            listenFd = -1;
+            return false;
+        }
+        ::fcntl(listenFd, F_SETFL, ::fcntl(listenFd, F_GETFL) | O_NONBLOCK);
+        if (::pipe(wakePipe) != 0) {
+            error = std::string("pipe: ") + std::strerror(errno);
+            ::close(listenFd);
+            listenFd = -1;
+            return false;
+        }
+        ::fcntl(wakePipe[0], F_SETFL, ::fcntl(wakePipe[0], F_GETFL) | O_NONBLOCK);
+        ::fcntl(wakePipe[1], F_SETFL, ::fcntl(wakePipe[1], F_GETFL) | O_NONBLOCK);
+
+        stopping.store(false);
+        const int handlerCount = std::max(1, options.maxConcurrent);
+        for (int i = 0; i < handlerCount; ++i) handlers.emplace_back(&ConversionServer::handlerLoop, this);
+        poller = std::thread(&ConversionServer::pollLoop, this);
+        PC_LOG_INFO("Serving on " + options.socketPath + " (concurrency=" + std::to_string(handlerCount) + ", queue="
+                    + std::to_string(options.maxQueued) + ", pool workers=" + std::to_string(pool.workerCount()) + ")");
+        return true;
+    }
+
+    void ConversionServer::stop() {
+        if (listenFd < 0) return;
+        stopping.store(true);
+        wake();
+        readyCond.notify_all();
+        if (poller.joinable()) poller.join();
+        for (auto& t : handlers) t.join();
+        handlers.clear();
+        for (int fd : ready) ::close(fd);
+        for (int fd : returned) ::close(fd);
+        for (const IdleConnection& c : idle) ::close(c.fd);
+        ready.clear(); returned.clear(); idle.clear();
+        ::close(listenFd);
+        ::close(wakePipe[0]);
+        ::close(wakePipe[1]);
+        listenFd = wakePipe[0] = wakePipe[1] = -1;
+        ::unlink(options.socketPath.c_str());
+        PC_LOG_INFO("Server stopped: " + std::to_string(requestsServed()) + " requests served, " + std::to_string(requestsFailed()) + " failed");
+        if (cache.isOpen()) PC_LOG_INFO(cache.formatStats());
+    }
+
+    void ConversionServer::wake() {
+        const char b = 1;
+        if (wakePipe[1] >= 0) (void)!::write(wakePipe[1], &b, 1); // 管道已满时已有未处理的唤醒，忽略
+    }
+
+    void ConversionServer::pollLoop() {
+        std::vector<pollfd> fds;
+        std::vector<int> readable;
+        const size_t maxQueued = (size_t)std::max(1, options.maxQueued);
+        using Clock = std::chrono::steady_clock;
+        const Clock::duration idleTimeout = std::chrono::seconds(kSocketTimeoutSec);
+        while (!stopping.load()) {
+            bool queueFull;
+            Clock::time_point now = Clock::now();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (int fd : returned) idle.push_back(IdleConnection{fd, now});
+                returned.clear();
+                queueFull = ready.size() >= maxQueued;
+            }
+            const int live = connectionCount - closedCount.load();
+            const bool acceptOn = !queueFull && live < options.maxConnections;
+
+            fds.clear();
+            fds.push_back(pollfd{wakePipe[0], POLLIN, 0});
+            if (acceptOn) fds.push_back(pollfd{listenFd, POLLIN, 0});
+            const size_t idleBase = fds.size();
+            // 就绪队列满时不再读取空闲连接：它们的请求留在 socket 缓冲区中
+            // 有被监视的空闲连接时按最早到期的一个设定超时，到期后关闭
+            int timeoutMs = -1;
+            if (!queueFull) {
+                Clock::time_point earliest = Clock::time_point::max();
+                for (const IdleConnection& c : idle) {
+                    fds.push_back(pollfd{c.fd, POLLIN, 0});
+                    earliest = std::min(earliest, c.since);
+                }
+                if (!idle.empty()) {
+                    const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(earliest + idleTimeout - now).count();
+                    timeoutMs = (int)std::max<int64_t>(0, left) + 1;
+                }
+            }
+
+            if (::poll(fds.data(), (nfds_t)fds.size(), timeoutMs) < 0) {
+                if (errno == EINTR) continue;
+                PC_LOG_ERROR(std::string("poll failed: ") + std::strerror(errno));
+                break;
+            }
+            if (fds[0].revents) {
+                char buf[64];
+                while (::read(wakePipe[0], buf, sizeof(buf)) > 0) {}
+            }
+
+            readable.clear();
+            for (size_t i = idleBase; i < fds.size(); ++i) {
+                if (fds[i].revents) readable.push_back(fds[i].fd);
+            }
+            if (!readable.empty()) {
+                idle.erase(std::remove_if(idle.begin(), idle.end(), [&](const IdleConnection& c) {
+                    return std::find(readable.begin(), readable.end(), c.fd) != readable.end();
+                }), idle.end());
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    ready.insert(ready.end(), readable.begin(), readable.end());
+                }
+                for (size_t i = 0; i < readable.size(); ++i) readyCond.notify_one();
+            }
+            // 只关闭本轮确实被监视且仍未发出请求的连接：就绪队列满时连接的请求可能正留在 socket 缓冲区中
+            if (!queueFull) {
+                now = Clock::now();
+                idle.erase(std::remove_if(idle.begin(), idle.end(), [&](const IdleConnection& c) {
+                    if (now - c.since < idleTimeout) return false;
+                    ::close(c.fd);
+                    closedCount.fetch_add(1);
+                    return true;
+                }), idle.end());
+            }
+
+            if (acceptOn && (fds[1].revents & POLLIN)) {
+                for (;;) {
+                    const int fd = ::accept(listenFd, nullptr, nullptr);
+                    if (fd < 0) break; // EAGAIN：已全部取出
+                    timeval tv{kSocketTimeoutSec, 0};
+                    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+                    ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+                    idle.push_back(IdleConnection{fd, Clock::now()});
+                    ++connectionCount;
+                }
+            }
+        }
+    }
+
+    void ConversionServer::handlerLoop() {
+        const size_t maxQueued = (size_t)std::max(1, options.maxQueued);
+        for (;;) {
+            int fd;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                readyCond.wait(lock, [&] { return stopping.load() || !ready.empty(); });
+                if (stopping.load()) return;
+                const bool wasFull = ready.size() >= maxQueued;
+                fd = ready.front();
+                ready.pop_front();
+                if (wasFull) wake(); // 队列有了空位，poll 线程恢复 accept/读取
+            }
+            if (serveOne(fd)) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    returned.push_back(fd);
+                }
+                wake();
+            } else {
+                ::close(fd);
+                closedCount.fetch_add(1);
+            }
+        }
+    }
+
+    bool ConversionServer::serveOne(int fd) {
+        // 请求缓冲与缓存副本在处理线程内复用；图像每次由解码器新分配，请求结束即释放，
+        // 不在请求之间占用整幅图像的内存
+        static thread_local std::vector<uint8_t> payload;
+        static thread_local std::string cacheCopy;
+        Image img;
+        Stopwatch sw;
+
+        uint8_t hdr[4];
+        if (!readFull(fd, hdr, 4)) return false; // 对端关闭或超时
+        const uint32_t len = (uint32_t)hdr[0] | ((uint32_t)hdr[1] << 8) | ((uint32_t)hdr[2] << 16) | ((uint32_t)hdr[3] << 24);
+        if (len > options.maxRequestBytes) {
+            failed.fetch_add(1);
+            writeServeTrailer(fd, ServeStatus::BadRequest, "request too large");
+            return false; // 无法跳过未读的载荷，关闭连接
+        }
+        payload.resize(len);
+        if (len > 0 && !readFull(fd, payload.data(), len)) return false;
+
+        ServeRequest request;
+        if (!decodeServeRequest(payload.data(), payload.size(), request)) {
+            failed.fetch_add(1);
+            return writeServeTrailer(fd, ServeStatus::BadRequest, "malformed request");
+        }
+        if (request.width <= 0 || request.width > kMaxDimension || request.height > kMaxDimension) {
+            failed.fetch_add(1);
+            return writeServeTrailer(fd, ServeStatus::BadRequest, "width/height out of range");
+        }
+        ConvertOptions opt;
+        opt.out_w = request.width;
+        opt.out_h = request.height;
+        opt.charset = request.high ? Charset::high : Charset::low;
+        opt.prune_given = request.prune >= 0 || options.tuneFile.empty();
+        opt.prune_threshold = request.prune >= 0 ? request.prune : options.defaultPrune;
+        opt.tune_file = options.tuneFile;
+        opt.memo_quant = request.memo < 0 ? -1 : std::min(7, (int)request.memo);
+        opt.layout = request.tiled ? PlaneLayout::Tiled8x8 : PlaneLayout::Linear;
+        opt.low_direct = request.lowDirect;
+
+        // 路径请求先映射文件：解码前要从文件头检查尺寸，渲染缓存以图像字节为键，解码也从该映射读取
+        MappedFile mapped;
+        const uint8_t* bytes = request.inlineData ? (const uint8_t*)request.data.data() : nullptr;
+        size_t byteCount = request.inlineData ? request.data.size() : 0;
+        if (!request.inlineData) {
+            std::string error;
+            if (!mapped.open(request.data, error)) {
+                failed.fetch_add(1);
+                PC_LOG_ERROR("Failed to load image: " + error);
+                return writeServeTrailer(fd, ServeStatus::LoadFailed, "failed to load " + request.data);
+            }
+            bytes = mapped.data();
+            byteCount = mapped.size();
+        }
+        RenderCacheKey cacheKey;
+        const bool cached = cache.isOpen();
+        if (cached) {
+            cacheKey = RenderCache::makeKey(bytes, byteCount, render_options_hash(opt));
+            FrameSink sink(fd);
+            bool sinkOk = true;
+            if (cache.lookup(cacheKey, sink, &sinkOk)) {
+                if (!sinkOk) {
+                    failed.fetch_add(1);
+                    return false;
+                }
+                served.fetch_add(1, std::memory_order_relaxed);
+                PC_LOG_INFO("Served " + std::to_string(request.width) + (request.high ? " high" : " low") + " from cache in " + std::to_string(sw.elapsed_us()) + "us");
+                return writeServeTrailer(fd, ServeStatus::Ok, std::string());
+            }
+        }
+
+        // 解码或渲染中的异常（如分配失败）只让本次请求失败，不能终止整个守护进程
+        RenderStreamStats stats;
+        bool storable = cached;
+        try {
+            // 几百字节的请求就可能声明数 GB 的像素：在解码器分配之前按文件头中的尺寸拒绝
+            int srcW = 0, srcH = 0;
+            if (!probe_image_size(bytes, byteCount, srcW, srcH)) {
+                failed.fetch_add(1);
+                return writeServeTrailer(fd, ServeStatus::LoadFailed, request.inlineData ? "unrecognized inline image" : "unrecognized image " + request.data);
+            }
+            if ((uint64_t)srcW * (uint64_t)srcH > options.maxImagePixels) {
+                failed.fetch_add(1);
+                return writeServeTrailer(fd, ServeStatus::BadRequest, "image size " + std::to_string(srcW) + "x" + std::to_string(srcH) + " exceeds the server limit");
+            }
+            // 未指定高度时按原始纵横比推算（与解码后的推算相同），重采样平面的大小同样在解码前检查
+            if (opt.out_h <= 0) opt.out_h = default_out_height(ImageView(nullptr, srcW, srcH), opt.out_w);
+            const double sub = sampling_grid_scale(opt);
+            if (opt.out_h > kMaxDimension || (double)opt.out_w * sub * opt.out_h * sub * 3 > (double)options.maxPlaneBytes) {
+                failed.fetch_add(1);
+                return writeServeTrailer(fd, ServeStatus::BadRequest, "output size " + std::to_string(opt.out_w) + "x" + std::to_string(opt.out_h) + " exceeds the server limit");
+            }
+
+            if (!img.load_from_memory(bytes, byteCount, decode_hint(opt, &pool))) {
+                failed.fetch_add(1);
+                return writeServeTrailer(fd, ServeStatus::LoadFailed, request.inlineData ? "failed to decode inline image" : "failed to load " + request.data);
+            }
+
+            FrameSink sink(fd);
+            cacheCopy.clear();
+            TeeSink tee(sink, cacheCopy, cache.maxEntryBytes());
+            stats = convert_image(img, opt, pool, storable ? static_cast<OutputSink&>(tee) : sink);
+            storable = storable && !tee.overflowed(); // 超过单条上限的输出不会被复制，也不保存
+        } catch (const std::exception& e) {
+            failed.fetch_add(1);
+            PC_LOG_ERROR(std::string("Request failed: ") + e.what());
+            // 已写出部分输出时客户端按协议读到 RenderFailed 尾帧
+            return writeServeTrailer(fd, ServeStatus::RenderFailed, std::string("render failed: ") + e.what());
+        }
+        if (!stats.ok) {
+            failed.fetch_add(1);
+            return false; // 写入连接失败，客户端已断开
+        }
+        if (storable) cache.store(cacheKey, cacheCopy, sw.elapsed_us());
+        served.fetch_add(1, std::memory_order_relaxed);
+        PC_LOG_INFO("Served " + std::to_string(img.width) + "x" + std::to_string(img.height) + " -> " + std::to_string(opt.out_w) + "x" + std::to_string(opt.out_h)
+                    + (request.high ? " high" : " low") + " in " + std::to_string(sw.elapsed_us()) + "us (first row +" + std::to_string(stats.first_row_us) + "us)");
+        return writeServeTrailer(fd, ServeStatus::Ok, std::string());
+    }
+#else
+    bool ConversionServer::start(std::string& error) {
+        error = "--serve is not supported on Windows";
+        return false;
+    }
+    void ConversionServer::stop() {}
+    void ConversionServer::pollLoop() {}
+    void ConversionServer::handlerLoop() {}
+    bool ConversionServer::serveOne(int) { return false; }
+    void ConversionServer::wake() {}
+#endif
+
+} // namespace PicConvertor
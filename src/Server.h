@@ -0,0 +1,94 @@
+#pragma once
+#ifndef PICCONVERTOR_SERVER_H
+#define PICCONVERTOR_SERVER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "RenderCache.h"
+
+namespace PicConvertor {
+
+    class TaskSystem;
+
+    /**
+     * @brief --serve 守护进程：在 Unix domain socket 上接受转换请求（协议见 ServeProtocol.h）。
+     *
+     * 进程内保留已预热的 TaskSystem、kernel 表、日志文件与各线程的 thread_local 缓冲区，
+     * 每个请求只做解码 + 重采样 + 渲染。一个 poll 线程负责 accept 与监视空闲连接，
+     * 可读的连接进入有界就绪队列，由 maxConcurrent 个处理线程各自执行一个请求后交回 poll 线程。
+     * 就绪队列满时 poll 线程不再 accept、也不再读取空闲连接，压力由内核的 listen backlog 与 socket 缓冲区反馈给客户端。
+     * 连接设有收发超时：请求发送不完整或不读取回复的客户端在超时后被断开，不会一直占用处理线程；
+     * 空闲连接超过同一时限未发出请求时由 poll 线程关闭，不会长期占满 maxConnections。
+     */
+    class ConversionServer {
+    public:
+        struct Options {
+            std::string socketPath;
+            int maxConcurrent = 2;              // 同时执行的请求数（共享同一个 TaskSystem）
+            int maxQueued = 32;                 // 就绪但尚未开始处理的连接数上限
+            int maxConnections = 256;
+            size_t maxRequestBytes = 64u << 20; // 单个请求（含内联图像）的上限
+            size_t maxPlaneBytes = 512u << 20;  // 单个请求的重采样平面上限（out_w*8 x out_h*8 x 3），超出的请求以 BadRequest 拒绝
+            uint64_t maxImagePixels = 1ull << 26; // 输入图像的像素上限，解码前按文件头中的尺寸检查
+            int defaultPrune = 24;
+            std::string tuneFile;               // 请求未指定 prune 时按图像类别取阈值
+            std::string cacheDir;               // 非空时在解码前查找渲染缓存（见 RenderCache.h）
+            uint64_t cacheBytes = 256ull << 20;
+        };
+
+        ConversionServer(TaskSystem& pool, Options options);
+        ~ConversionServer();
+        ConversionServer(const ConversionServer&) = delete;
+        ConversionServer& operator=(const ConversionServer&) = delete;
+
+        // 绑定 socket 并启动线程；失败时返回 false 并写入 error
+        bool start(std::string& error);
+        // 停止接受请求，等待进行中的请求完成，关闭所有连接并删除 socket 文件
+        void stop();
+
+        uint64_t requestsServed() const { return served.load(std::memory_order_relaxed); }
+        uint64_t requestsFailed() const { return failed.load(std::memory_order_relaxed); }
+
+    private:
+        void pollLoop();
+        void handlerLoop();
+        // 处理连接上的一个请求；返回 false 表示连接应关闭
+        bool serveOne(int fd);
+        void wake();
+
+        TaskSystem& pool;
+        Options options;
+        RenderCache cache;
+        int listenFd = -1;
+        int wakePipe[2] = {-1, -1};
+        std::atomic<bool> stopping{false};
+        std::thread poller;
+        std::vector<std::thread> handlers;
+
+        std::mutex mutex;
+        std::condition_variable readyCond;
+        std::deque<int> ready;     // 可读、等待处理的连接
+        std::vector<int> returned; // 处理完一个请求、交回 poll 线程的连接
+        struct IdleConnection {
+            int fd;
+            std::chrono::steady_clock::time_point since; // 交回 poll 线程（或 accept）的时刻
+        };
+        std::vector<IdleConnection> idle; // 仅 poll 线程访问
+        int connectionCount = 0;   // 仅 poll 线程访问（关闭数经 closedCount 汇总）
+        std::atomic<int> closedCount{0};
+
+        std::atomic<uint64_t> served{0};
+        std::atomic<uint64_t> failed{0};
+    };
+
+} // namespace PicConvertor
+
+#endif // PICCONVERTOR_SERVER_H
@@ -1,19 +1,42 @@
 #include "TaskSystem.h"
 #include "Logger.h"
+#include "Tracer.h"
 #include <algorithm>
+#include <chrono>
 
 namespace PicConvertor {
 
+    // 当前线程所属的 TaskSystem 与工作线程序号（非工作线程为 -1）
+    static thread_local TaskSystem* tls_owner = nullptr;
+    static thread_local int tls_index = -1;
+
+    // 选择窃取起点用的 xorshift，避免所有线程按同一顺序扫描 victim
+    static inline uint32_t next_random() {
+        static thread_local uint32_t state = (uint32_t)std::hash<std::thread::id>{}(std::this_thread::get_id()) | 1u;
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    int TaskSystem::currentWorkerIndex() const {
+        return tls_owner == this ? tls_index : -1;
+    }
+
     TaskSystem::TaskSystem(int threadCount) {
         if (threadCount <= 0) {
-            // 保留一个核心给主线程
+            // 保留一个核心给主线程（主线程在等待时也会参与执行任务）
             threadCount = std::max(1u, std::thread::hardware_concurrency() - 1);
         }
 
-        PC_LOG_INFO("Initializing TaskSystem with " + std::to_string(threadCount) + " worker threads.");
+        PC_LOGF_INFO("Initializing TaskSystem with {} worker threads.", threadCount);
 
+        // 先创建全部 deque 再启动线程，窃取时 workers 不会再变化
+        for (int i = 0; i < threadCount; ++i) {
+            workers.emplace_back(new Worker());
+        }
         for (int i = 0; i < threadCount; ++i) {
-            workers.emplace_back(&TaskSystem::workerThread, this);
+            workers[i]->thread = std::thread(&TaskSystem::workerThread, this, i);
         }
     }
 
@@ -21,17 +44,186 @@ namespace PicConvertor {
         stop();
     }
 
-    void TaskSystem::submit(std::function<void()> task) {
+    // 每次从全局池搬运/归还的节点数，以及 slab 大小
+    static constexpr int kNodeBatch = 64;
+    static constexpr int kNodeSlab = 256;
+
+    TaskNode* TaskSystem::take_central(int maxCount) {
+        std::lock_guard<std::mutex> lock(nodeMutex);
+        if (!centralFree) {
+            slabs.emplace_back(new TaskNode[kNodeSlab]);
+            TaskNode* slab = slabs.back().get();
+            for (int i = 0; i < kNodeSlab - 1; ++i) slab[i].next = &slab[i + 1];
+            slab[kNodeSlab - 1].next = nullptr;
+            centralFree = slab;
+            ++nodeSlabCount;
+        }
+        // 摘下最多 maxCount 个节点组成的链表
+        TaskNode* head = centralFree;
+        TaskNode* tail = head;
+        for (int i = 1; i < maxCount && tail->next; ++i) tail = tail->next;
+        centralFree = tail->next;
+        tail->next = nullptr;
+        return head;
+    }
+
+    TaskNode* TaskSystem::alloc_node() {
+        if (tls_owner == this && tls_index >= 0) {
+            Worker& w = *workers[tls_index];
+            if (!w.freeNodes) {
+                w.freeNodes = take_central(kNodeBatch);
+                w.freeCount = 0;
+                for (TaskNode* n = w.freeNodes; n; n = n->next) ++w.freeCount;
+            }
+            TaskNode* node = w.freeNodes;
+            w.freeNodes = node->next;
+            --w.freeCount;
+            return node;
+        }
+        return take_central(1);
+    }
+
+    void TaskSystem::free_node(TaskNode* node) {
+        if (tls_owner == this && tls_index >= 0) {
+            Worker& w = *workers[tls_index];
+            node->next = w.freeNodes;
+            w.freeNodes = node;
+            if (++w.freeCount < 4 * kNodeBatch) return;
+            // 本地缓存过多时归还一批到全局池
+            TaskNode* tail = w.freeNodes;
+            for (int i = 1; i < kNodeBatch; ++i) tail = tail->next;
+            TaskNode* batch = w.freeNodes;
+            w.freeNodes = tail->next;
+            w.freeCount -= kNodeBatch;
+            std::lock_guard<std::mutex> lock(nodeMutex);
+            tail->next = centralFree;
+            centralFree = batch;
+            return;
+        }
+        std::lock_guard<std::mutex> lock(nodeMutex);
+        node->next = centralFree;
+        centralFree = node;
+    }
+
+    void TaskSystem::enqueue(TaskNode* node) {
+        pending.fetch_add(1);
+        if (tls_owner == this && tls_index >= 0) {
+            workers[tls_index]->deque.push(node);
+        } else {
+            node->next = nullptr;
+            std::lock_guard<std::mutex> lock(injectMutex);
+            if (injectTail) injectTail->next = node; else injectHead = node;
+            injectTail = node;
+            injectedCount.fetch_add(1);
+        }
+        queued.fetch_add(1);
+
+        // 与 workerThread 中 "sleepers++ 后检查 queued" 配对（均为 seq_cst），不会丢失唤醒
+        if (sleepers.load() > 0) {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            sleepCond.notify_one();
+        }
+        notify_idle_waiters();
+    }
+
+    TaskNode* TaskSystem::find_task(int self) {
+        TaskNode* t = nullptr;
+        if (self >= 0 && workers[self]->deque.pop(t)) {
+            queued.fetch_sub(1);
+            return t;
+        }
+        if (injectedCount.load(std::memory_order_relaxed) > 0) {
+            std::lock_guard<std::mutex> lock(injectMutex);
+            if (injectHead) {
+                t = injectHead;
+                injectHead = t->next;
+                if (!injectHead) injectTail = nullptr;
+                injectedCount.fetch_sub(1);
+                queued.fetch_sub(1);
+                return t;
+            }
+        }
+        int n = (int)workers.size();
+        if (n == 0) return nullptr;
+        int start = (int)(next_random() % (uint32_t)n);
+        for (int k = 0; k < n; ++k) {
+            int victim = (start + k) % n;
+            if (victim == self) continue;
+            if (workers[victim]->deque.steal(t)) {
+                queued.fetch_sub(1);
+                return t;
+            }
+        }
+        return nullptr;
+    }
+
+    void TaskSystem::execute(TaskNode* node) {
+        TaskGroup* group = node->group;
+        // 每个任务记录为一个 span，span 间的空隙即排队/空闲时间
+        try {
+            PC_TRACE_SCOPE_CAT("task", "TaskSystem");
+            node->fn();
+        } catch (const std::exception& e) {
+            if (group) group->fail(std::current_exception());
+            else PC_LOGF_ERROR("Exception in TaskSystem worker thread: {}", e.what());
+        } catch (...) {
+            if (group) group->fail(std::current_exception());
+            else PC_LOG_ERROR("Unknown exception in TaskSystem worker thread.");
+        }
+        // 先销毁可调用对象再通知完成：等待方返回后其捕获的栈对象即失效
+        node->fn.reset();
+        free_node(node);
+        if (group) group->pending.fetch_sub(1);
+        pending.fetch_sub(1);
+        notify_idle_waiters();
+    }
+
+    void TaskSystem::notify_idle_waiters() {
+        if (idleWaiters.load() > 0) {
+            std::lock_guard<std::mutex> lock(idleMutex);
+            idleCond.notify_all();
+        }
+    }
+
+    bool TaskSystem::run_one() {
+        TaskNode* t = find_task(tls_owner == this ? tls_index : -1);
+        if (!t) return false;
+        execute(t);
+        return true;
+    }
+
+    void TaskSystem::wait_for_progress(const std::function<bool()>& done) {
+        idleWaiters.fetch_add(1);
         {
-            std::lock_guard<std::mutex> lock(queueMutex);
-            tasks.emplace(std::move(task));
+            std::unique_lock<std::mutex> lock(idleMutex);
+            // 任务完成或新任务入队都会通知；超时仅作兜底
+            idleCond.wait_for(lock, std::chrono::milliseconds(1), [&]() {
+                return done() || queued.load() > 0;
+            });
+        }
+        idleWaiters.fetch_sub(1);
+    }
+
+    TaskGroup::~TaskGroup() {
+        wait_all();
+    }
+
+    void TaskGroup::wait_all() {
+        pool.help_until([this]() { return pending.load() == 0; });
+    }
+
+    void TaskGroup::wait() {
+        wait_all();
+        if (failed.load()) {
+            std::exception_ptr e = error;
+            error = nullptr;
+            failed.store(false);
+            std::rethrow_exception(e);
         }
-        condition.notify_one();
     }
 
     void TaskSystem::wait_idle() {
-        std::unique_lock<std::mutex> lock(queueMutex);
-        condition.wait(lock, [this] { return tasks.empty() && activeTasks.load() == 0; });
+        help_until([this]() { return pending.load() == 0; });
     }
 
     void TaskSystem::preheat() {
@@ -42,54 +234,49 @@ namespace PicConvertor {
             submit([](){});
         }
         wait_idle();
-        PC_LOG_INFO("TaskSystem preheated with " + std::to_string(n) + " tasks.");
+        PC_LOGF_INFO("TaskSystem preheated with {} tasks.", n);
     }
 
     void TaskSystem::stop() {
         {
-            std::lock_guard<std::mutex> lock(queueMutex);
+            std::lock_guard<std::mutex> lock(sleepMutex);
             if (stopFlag) return; // 已经停止
             stopFlag = true;
         }
-        condition.notify_all();
+        sleepCond.notify_all();
 
         for (auto& worker : workers) {
-            if (worker.joinable()) {
-                worker.join();
+            if (worker->thread.joinable()) {
+                worker->thread.join();
             }
         }
-        PC_LOG_INFO("TaskSystem stopped.");
+        PC_LOGF_INFO("TaskSystem stopped ({} task nodes pooled).", nodeSlabCount * kNodeSlab);
     }
 
-    void TaskSystem::workerThread() {
+    void TaskSystem::workerThread(int index) {
+        tls_owner = this;
+        tls_index = index;
+        Tracer::getInstance().setThreadName("worker " + std::to_string(index));
         while (true) {
-            std::function<void()> task;
-            {
-                std::unique_lock<std::mutex> lock(queueMutex);
-                condition.wait(lock, [this] { return stopFlag || !tasks.empty(); });
-
-                if (stopFlag && tasks.empty()) {
-                    return;
-                }
-
-                if (tasks.empty()) continue;
-
-                task = std::move(tasks.front());
-                tasks.pop();
-                activeTasks.fetch_add(1);
+            TaskNode* task = find_task(index);
+            // 短暂自旋后再休眠，避免细粒度任务之间频繁进出内核
+            for (int spin = 0; !task && spin < 64; ++spin) {
+                std::this_thread::yield();
+                task = find_task(index);
             }
-
-            // 执行任务
-            try {
-                task();
-            } catch (const std::exception& e) {
-                PC_LOG_ERROR("Exception in TaskSystem worker thread: " + std::string(e.what()));
-            } catch (...) {
-                PC_LOG_ERROR("Unknown exception in TaskSystem worker thread.");
+            if (task) {
+                execute(task);
+                continue;
             }
 
-            activeTasks.fetch_sub(1);
-            condition.notify_all();
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleepers.fetch_add(1);
+            sleepCond.wait(lock, [this] { return stopFlag.load() || queued.load() > 0; });
+            sleepers.fetch_sub(1);
+            // 停止时先取完剩余任务再退出
+            if (stopFlag && queued.load() == 0) {
+                return;
+            }
         }
     }
 
@@ -3,21 +3,242 @@
 #define TILELANDWORLD_TASKSYSTEM_H
 
 #include <vector>
-#include <queue>
+#include <memory>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <functional>
 #include <atomic>
 #include <future>
+#include <exception>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <new>
+#include <type_traits>
 
 namespace PicConvertor {
 
     /**
-     * @brief 通用多线程任务系统（微改造以方便项目集成）。
-     * 
-     * 维护一个固定数量的工作线程池，处理所有类型的异步任务。
-     * 任务以 std::function<void()> 的形式提交；也支持模板 submit 返回 future。
+     * @brief Chase-Lev work-stealing deque（Lê et al. 2013 的 C++11 内存序版本）。
+     *
+     * 仅 owner 线程调用 push/pop（LIFO 端），任意线程可调用 steal（FIFO 端）。
+     * T 必须是可原子存取的平凡类型（这里用任务指针）。扩容后的旧数组保留到析构时再释放，
+     * 以免与并发 steal 产生 use-after-free。
+     */
+    template<typename T>
+    class WorkStealingDeque {
+    public:
+        explicit WorkStealingDeque(int64_t capacity = 256) {
+            int64_t cap = 1;
+            while (cap < capacity) cap <<= 1;
+            arrays.emplace_back(new Array(cap));
+            array.store(arrays.back().get(), std::memory_order_relaxed);
+        }
+
+        void push(T item) {
+            int64_t b = bottom.load(std::memory_order_relaxed);
+            int64_t t = top.load(std::memory_order_acquire);
+            Array* a = array.load(std::memory_order_relaxed);
+            if (b - t > a->capacity - 1) {
+                a = grow(a, b, t);
+            }
+            a->put(b, item);
+            std::atomic_thread_fence(std::memory_order_release);
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+
+        bool pop(T& out) {
+            int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+            Array* a = array.load(std::memory_order_relaxed);
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = top.load(std::memory_order_relaxed);
+            if (t > b) {
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return false;
+            }
+            out = a->get(b);
+            if (t == b) {
+                // 最后一个元素：与 steal 竞争
+                bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return won;
+            }
+            return true;
+        }
+
+        bool steal(T& out) {
+            int64_t t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t b = bottom.load(std::memory_order_acquire);
+            if (t >= b) return false;
+            Array* a = array.load(std::memory_order_acquire);
+            T item = a->get(t);
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                return false;
+            }
+            out = item;
+            return true;
+        }
+
+        bool empty() const {
+            return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+        }
+
+    private:
+        struct Array {
+            int64_t capacity;
+            std::unique_ptr<std::atomic<T>[]> slots;
+            explicit Array(int64_t cap) : capacity(cap), slots(new std::atomic<T>[cap]) {}
+            T get(int64_t i) const { return slots[i & (capacity - 1)].load(std::memory_order_relaxed); }
+            void put(int64_t i, T v) { slots[i & (capacity - 1)].store(v, std::memory_order_relaxed); }
+        };
+
+        Array* grow(Array* old, int64_t b, int64_t t) {
+            arrays.emplace_back(new Array(old->capacity * 2));
+            Array* a = arrays.back().get();
+            for (int64_t i = t; i < b; ++i) a->put(i, old->get(i));
+            array.store(a, std::memory_order_release);
+            return a;
+        }
+
+        alignas(64) std::atomic<int64_t> top{0};
+        alignas(64) std::atomic<int64_t> bottom{0};
+        std::atomic<Array*> array{nullptr};
+        std::vector<std::unique_ptr<Array>> arrays; // 仅 owner 修改
+    };
+
+    /**
+     * @brief 固定容量的 small-buffer 任务对象（替代 std::function<void()>）。
+     *
+     * 不超过 kInlineSize 字节且 nothrow-move 的可调用对象直接存放在内联缓冲区，无堆分配；
+     * 更大的可调用对象退化为一次堆分配。只可移动，不可拷贝。
+     */
+    class SmallTask {
+    public:
+        static constexpr size_t kInlineSize = 64;
+
+        SmallTask() = default;
+        template<typename F, typename = std::enable_if_t<!std::is_same<std::decay_t<F>, SmallTask>::value>>
+        SmallTask(F&& f) { emplace(std::forward<F>(f)); }
+        SmallTask(SmallTask&& other) noexcept { move_from(other); }
+        SmallTask& operator=(SmallTask&& other) noexcept {
+            if (this != &other) { reset(); move_from(other); }
+            return *this;
+        }
+        SmallTask(const SmallTask&) = delete;
+        SmallTask& operator=(const SmallTask&) = delete;
+        ~SmallTask() { reset(); }
+
+        template<typename F>
+        void emplace(F&& f) {
+            using D = std::decay_t<F>;
+            reset();
+            if constexpr (fits_inline<D>()) {
+                new (storage) D(std::forward<F>(f));
+                ops = &inline_ops<D>;
+            } else {
+                *reinterpret_cast<D**>(storage) = new D(std::forward<F>(f));
+                ops = &heap_ops<D>;
+            }
+        }
+
+        void operator()() { ops->invoke(storage); }
+        explicit operator bool() const { return ops != nullptr; }
+
+        void reset() {
+            if (ops) { ops->destroy(storage); ops = nullptr; }
+        }
+
+        template<typename F>
+        static constexpr bool fits_inline() {
+            return sizeof(F) <= kInlineSize && alignof(F) <= alignof(std::max_align_t)
+                && std::is_nothrow_move_constructible<F>::value;
+        }
+
+    private:
+        struct Ops {
+            void (*invoke)(void*);
+            void (*move)(void* dst, void* src); // 移动构造到 dst 并销毁 src
+            void (*destroy)(void*);
+        };
+
+        template<typename D>
+        static constexpr Ops inline_ops = {
+            [](void* p) { (*static_cast<D*>(p))(); },
+            [](void* dst, void* src) { new (dst) D(std::move(*static_cast<D*>(src))); static_cast<D*>(src)->~D(); },
+            [](void* p) { static_cast<D*>(p)->~D(); },
+        };
+        template<typename D>
+        static constexpr Ops heap_ops = {
+            [](void* p) { (**static_cast<D**>(p))(); },
+            [](void* dst, void* src) { *static_cast<D**>(dst) = *static_cast<D**>(src); },
+            [](void* p) { delete *static_cast<D**>(p); },
+        };
+
+        void move_from(SmallTask& other) noexcept {
+            if (other.ops) {
+                other.ops->move(storage, other.storage);
+                ops = other.ops;
+                other.ops = nullptr;
+            }
+        }
+
+        alignas(std::max_align_t) unsigned char storage[kInlineSize];
+        const Ops* ops = nullptr;
+    };
+
+    class TaskSystem;
+    struct TaskNode;
+
+    /**
+     * @brief 任务组 / countdown latch：run() 提交的任务全部完成后 wait() 返回。
+     *
+     * wait() 期间调用线程参与执行排队任务；组内任务抛出的第一个异常在 wait() 中重新抛出。
+     * 析构时会等待未完成的任务（不抛出）。
+     */
+    class TaskGroup {
+    public:
+        explicit TaskGroup(TaskSystem& pool) : pool(pool) {}
+        ~TaskGroup();
+
+        template<typename F>
+        void run(F&& f);
+
+        void wait();
+
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator=(const TaskGroup&) = delete;
+
+    private:
+        friend class TaskSystem;
+
+        void wait_all();
+        void fail(std::exception_ptr e) {
+            if (!failed.exchange(true)) error = e;
+        }
+
+        TaskSystem& pool;
+        std::atomic<int64_t> pending{0};
+        std::atomic<bool> failed{false};
+        std::exception_ptr error;
+    };
+
+    // 任务节点：由 TaskSystem 的节点池分配并复用，deque 中只存放节点指针
+    struct TaskNode {
+        SmallTask fn;
+        TaskGroup* group = nullptr;
+        TaskNode* next = nullptr; // 空闲链表 / 注入队列
+    };
+
+    /**
+     * @brief 通用多线程任务系统（work-stealing 版本）。
+     *
+     * 每个工作线程持有一个 Chase-Lev deque：任务内部再提交的任务压入本线程 deque，
+     * 空闲线程从其他 deque 窃取；非工作线程（如 main）提交的任务进入注入队列。
+     * 只有存在休眠线程时才唤醒，且每次只唤醒一个。等待方（wait_idle / parallel_for）
+     * 会在等待期间执行排队任务，而不是阻塞。
      */
     class TaskSystem {
     public:
@@ -29,12 +250,18 @@ namespace PicConvertor {
         ~TaskSystem();
 
         /**
-         * @brief 提交一个任务到队列（无返回值）。
+         * @brief 提交一个任务到队列（无返回值）。不超过 SmallTask::kInlineSize 的可调用对象不触发堆分配。
          */
-        void submit(std::function<void()> task);
+        template<typename F>
+        void submit(F&& task) {
+            TaskNode* node = alloc_node();
+            node->fn.emplace(std::forward<F>(task));
+            node->group = nullptr;
+            enqueue(node);
+        }
 
         /**
-         * @brief 提交可返回值的任务，返回 std::future<T>
+         * @brief 提交可返回值的任务，返回 std::future<T>（会分配 future 共享状态；只需 join 时用 TaskGroup）
          */
         template<typename F, typename... Args>
         auto submitTask(F&& f, Args&&... args) -> std::future<decltype(f(args...))> {
@@ -46,10 +273,70 @@ namespace PicConvertor {
         }
 
         /**
-         * @brief 等待当前任务队列处理完毕（不停止线程池）。
+         * @brief 将 [begin, end) 切成 grain 大小的块并行执行 fn(chunk_begin, chunk_end)。
+         *
+         * grain <= 0 时自动选择（约每线程 8 块）。调用线程同样领取块执行，
+         * 返回时所有块均已完成；任一块抛出的第一个异常会在调用线程重新抛出。
+         */
+        template<typename F>
+        void parallel_for(int64_t begin, int64_t end, int64_t grain, F&& fn) {
+            if (end <= begin) return;
+            const int64_t n = end - begin;
+            if (grain <= 0) grain = auto_grain(n);
+            const int64_t chunks = (n + grain - 1) / grain;
+            if (chunks == 1 || workers.empty()) {
+                fn(begin, end);
+                return;
+            }
+
+            // 声明顺序保证异常展开时 group 先析构（等待 helper 结束），再释放 next/body
+            std::atomic<int64_t> next{0};
+            auto body = [&]() {
+                for (;;) {
+                    int64_t c = next.fetch_add(1, std::memory_order_relaxed);
+                    if (c >= chunks) break;
+                    int64_t b = begin + c * grain;
+                    try {
+                        fn(b, std::min(end, b + grain));
+                    } catch (...) {
+                        next.store(chunks, std::memory_order_relaxed);
+                        throw;
+                    }
+                }
+            };
+            TaskGroup group(*this);
+            int helpers = (int)std::min<int64_t>(chunks - 1, (int64_t)workers.size());
+            for (int i = 0; i < helpers; ++i) {
+                group.run([&body]() { body(); });
+            }
+            body();
+            group.wait();
+        }
+
+        /**
+         * @brief 等待当前所有任务完成（不停止线程池）；等待期间调用线程参与执行任务。
          */
         void wait_idle();
 
+        /**
+         * @brief 在等待期间执行 done() 为 false 时可取得的任务；无任务时短暂休眠。
+         */
+        template<typename Pred>
+        void help_until(Pred done) {
+            int spins = 0;
+            while (!done()) {
+                if (run_one()) { spins = 0; continue; }
+                if (++spins < 64) { std::this_thread::yield(); continue; }
+                wait_for_progress([&done]() { return done(); });
+            }
+        }
+
+        /**
+         * @brief 取出并执行一个排队任务（优先本线程 deque，其次注入队列，最后窃取）。
+         * @return 没有可执行的任务时返回 false。
+         */
+        bool run_one();
+
         // 提交若干空任务并等待，以确保工作线程已启动
         void preheat();
 
@@ -58,18 +345,75 @@ namespace PicConvertor {
          */
         void stop();
 
+        int workerCount() const { return (int)workers.size(); }
+
+        // 调用线程在本线程池中的工作线程序号；非本池工作线程（例如调用 parallel_for 的主线程）返回 -1
+        int currentWorkerIndex() const;
+
     private:
-        std::vector<std::thread> workers;
-        std::queue<std::function<void()>> tasks;
-        
-        std::mutex queueMutex;
-        std::condition_variable condition;
+        friend class TaskGroup;
+
+        struct Worker {
+            WorkStealingDeque<TaskNode*> deque;
+            std::thread thread;
+            // 本线程的空闲节点缓存（仅本线程访问）
+            TaskNode* freeNodes = nullptr;
+            int freeCount = 0;
+        };
+
+        std::vector<std::unique_ptr<Worker>> workers;
+
+        // 全局节点池：按 slab 分配，生命周期与 TaskSystem 相同
+        std::mutex nodeMutex;
+        TaskNode* centralFree = nullptr;
+        std::vector<std::unique_ptr<TaskNode[]>> slabs;
+        size_t nodeSlabCount = 0;
+
+        // 非工作线程提交的任务：借用 TaskNode::next 组成的侵入式 FIFO
+        std::mutex injectMutex;
+        TaskNode* injectHead = nullptr;
+        TaskNode* injectTail = nullptr;
+        std::atomic<int64_t> injectedCount{0};
+
+        // 工作线程休眠/唤醒
+        std::mutex sleepMutex;
+        std::condition_variable sleepCond;
+        std::atomic<int> sleepers{0};
+
+        // 帮助等待方（wait_idle / parallel_for）的休眠/唤醒
+        std::mutex idleMutex;
+        std::condition_variable idleCond;
+        std::atomic<int> idleWaiters{0};
+
+        std::atomic<int64_t> queued{0};  // 已入队但尚未被取走
+        std::atomic<int64_t> pending{0}; // 已提交但尚未完成
         std::atomic<bool> stopFlag{false};
-        std::atomic<int> activeTasks{0};
 
-        void workerThread();
+        int64_t auto_grain(int64_t n) const {
+            int64_t parts = 8 * ((int64_t)workers.size() + 1);
+            return std::max<int64_t>(1, n / parts);
+        }
+
+        TaskNode* alloc_node();
+        void free_node(TaskNode* node);
+        TaskNode* take_central(int maxCount);
+        void enqueue(TaskNode* node);
+        TaskNode* find_task(int self);
+        void execute(TaskNode* node);
+        void notify_idle_waiters();
+        void wait_for_progress(const std::function<bool()>& done);
+        void workerThread(int index);
     };
 
+    template<typename F>
+    void TaskGroup::run(F&& f) {
+        pending.fetch_add(1);
+        TaskNode* node = pool.alloc_node();
+        node->fn.emplace(std::forward<F>(f));
+        node->group = this;
+        pool.enqueue(node);
+    }
+
 } // namespace PicConvertor
 
 #endif // TILELANDWORLD_TASKSYSTEM_H
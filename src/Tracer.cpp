@@ -0,0 +1,89 @@
+#include "Tracer.h"
+#include "Logger.h"
+#include <cstdio>
+#include <fstream>
+
+namespace PicConvertor {
+
+    Tracer& Tracer::getInstance() {
+        static Tracer instance;
+        return instance;
+    }
+
+    void Tracer::enable() {
+        originTicks = HiResClock::ticks();
+        enabledFlag.store(true, std::memory_order_release);
+    }
+
+    Tracer::ThreadBuffer& Tracer::localBuffer() {
+        // 缓冲区由 Tracer 持有，线程退出后仍可导出
+        thread_local ThreadBuffer* tls = nullptr;
+        if (!tls) {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            buffers.push_back(std::make_unique<ThreadBuffer>());
+            tls = buffers.back().get();
+            tls->tid = (uint32_t)buffers.size();
+            tls->events.reserve(1024);
+        }
+        return *tls;
+    }
+
+    void Tracer::record(const char* name, const char* cat, uint64_t startTicks, uint64_t endTicks) {
+        if (!enabled()) return;
+        localBuffer().events.push_back(Event{name, cat, startTicks, endTicks});
+    }
+
+    void Tracer::setThreadName(const std::string& name) {
+        if (!enabled()) return;
+        ThreadBuffer& buf = localBuffer();
+        std::lock_guard<std::mutex> lock(registryMutex);
+        buf.name = name;
+    }
+
+    // 事件名均为内部字面量，只需处理引号与反斜杠
+    static void write_json_string(std::ofstream& ofs, const std::string& s) {
+        ofs << '"';
+        for (char c : s) {
+            if (c == '"' || c == '\\') ofs << '\\';
+            ofs << c;
+        }
+        ofs << '"';
+    }
+
+    bool Tracer::writeChromeJson(const std::string& path) {
+        std::ofstream ofs(path, std::ios::binary);
+        if (!ofs) {
+            PC_LOG_ERROR("Failed to open trace file: " + path);
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(registryMutex);
+        size_t total = 0;
+        bool first = true;
+        auto sep = [&]() { if (!first) ofs << ",\n"; first = false; };
+        char num[64];
+        ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        for (const auto& buf : buffers) {
+            std::string tname = buf->name.empty() ? ("thread " + std::to_string(buf->tid)) : buf->name;
+            sep();
+            ofs << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buf->tid << ",\"args\":{\"name\":";
+            write_json_string(ofs, tname);
+            ofs << "}}";
+            for (const auto& e : buf->events) {
+                if (e.start < originTicks) continue;
+                sep();
+                std::snprintf(num, sizeof(num), "\"ts\":%.3f,\"dur\":%.3f",
+                              HiResClock::to_us(e.start - originTicks), HiResClock::to_us(e.end - e.start));
+                ofs << "{\"name\":";
+                write_json_string(ofs, e.name);
+                ofs << ",\"cat\":";
+                write_json_string(ofs, e.cat);
+                ofs << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buf->tid << ',' << num << '}';
+                ++total;
+            }
+        }
+        ofs << "\n]}\n";
+        PC_LOG_INFO("Trace written to " + path + " (" + std::to_string(total) + " events, " + std::to_string(buffers.size()) + " threads)");
+        return (bool)ofs;
+    }
+
+} // namespace PicConvertor
@@ -0,0 +1,88 @@
+#pragma once
+#ifndef PICCONVERTOR_TRACER_H
+#define PICCONVERTOR_TRACER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "timing.h"
+
+namespace PicConvertor {
+
+    /**
+     * @brief 轻量级 span 记录器，导出 Chrome trace-event JSON（chrome://tracing / Perfetto 可直接打开）。
+     *
+     * 每个线程写入自己的事件缓冲区（仅在首次记录时加锁注册），未启用时 TraceScope 只做一次原子读取。
+     * name/cat 必须是静态生命周期字符串（通常为字面量）。
+     */
+    class Tracer {
+    public:
+        static Tracer& getInstance();
+
+        // 开始记录（以当前时刻为时间原点）
+        void enable();
+        bool enabled() const { return enabledFlag.load(std::memory_order_relaxed); }
+
+        // 记录一个完整 span（时间单位为 HiResClock tick）
+        void record(const char* name, const char* cat, uint64_t startTicks, uint64_t endTicks);
+
+        // 为当前线程命名（显示为时间线上的轨道名）
+        void setThreadName(const std::string& name);
+
+        // 写出所有线程已记录的事件；应在工作线程空闲后调用
+        bool writeChromeJson(const std::string& path);
+
+        Tracer(const Tracer&) = delete;
+        Tracer& operator=(const Tracer&) = delete;
+
+    private:
+        Tracer() = default;
+
+        struct Event {
+            const char* name;
+            const char* cat;
+            uint64_t start;
+            uint64_t end;
+        };
+        struct ThreadBuffer {
+            uint32_t tid = 0;
+            std::string name;
+            std::vector<Event> events;
+        };
+
+        ThreadBuffer& localBuffer();
+
+        std::atomic<bool> enabledFlag{false};
+        uint64_t originTicks = 0;
+        std::mutex registryMutex;
+        std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    };
+
+    // RAII span：构造时取起点，析构时记录
+    class TraceScope {
+    public:
+        explicit TraceScope(const char* name, const char* cat = "stage")
+            : name(name), cat(cat), start(Tracer::getInstance().enabled() ? HiResClock::ticks() : 0) {}
+        ~TraceScope() {
+            if (start) Tracer::getInstance().record(name, cat, start, HiResClock::ticks());
+        }
+        TraceScope(const TraceScope&) = delete;
+        TraceScope& operator=(const TraceScope&) = delete;
+
+    private:
+        const char* name;
+        const char* cat;
+        uint64_t start;
+    };
+
+    #define PC_TRACE_CONCAT_INNER(a, b) a##b
+    #define PC_TRACE_CONCAT(a, b) PC_TRACE_CONCAT_INNER(a, b)
+    #define PC_TRACE_SCOPE(name) PicConvertor::TraceScope PC_TRACE_CONCAT(pc_trace_scope_, __LINE__)(name)
+    #define PC_TRACE_SCOPE_CAT(name, cat) PicConvertor::TraceScope PC_TRACE_CONCAT(pc_trace_scope_, __LINE__)(name, cat)
+
+} // namespace PicConvertor
+
+#endif // PICCONVERTOR_TRACER_H
@@ -0,0 +1,148 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// 零分配的 ANSI/UTF-8 输出：直接写入调用方提供的字节缓冲区。
+// 0-255 的十进制串、字形的 UTF-8 编码都是 constexpr 表；fg/bg 同时变化时合并为一条
+// ESC[38;2;r;g;b;48;2;r;g;bm。调用方按 ansi_row_bound 预留每行的精确上界后顺序写入。
+
+// 十进制串（最多 3 位），len 为有效长度
+struct AnsiDec { char s[3]; uint8_t len; };
+
+struct AnsiDecTable {
+    AnsiDec v[256];
+    constexpr AnsiDecTable() : v{} {
+        for (int i = 0; i < 256; ++i) {
+            AnsiDec d{{'0', '0', '0'}, 1};
+            if (i >= 100) { d.s[0] = char('0' + i / 100); d.s[1] = char('0' + i / 10 % 10); d.s[2] = char('0' + i % 10); d.len = 3; }
+            else if (i >= 10) { d.s[0] = char('0' + i / 10); d.s[1] = char('0' + i % 10); d.len = 2; }
+            else { d.s[0] = char('0' + i); }
+            v[i] = d;
+        }
+    }
+};
+inline constexpr AnsiDecTable kAnsiDec{};
+
+// 码位的 UTF-8 编码（最多 4 字节）
+struct Utf8Glyph { char s[4]; uint8_t len; };
+
+constexpr Utf8Glyph encode_utf8(int code) {
+    Utf8Glyph g{{0, 0, 0, 0}, 0};
+    if (code <= 0x7F) { g.s[0] = (char)code; g.len = 1; }
+    else if (code <= 0x7FF) {
+        g.s[0] = (char)(0xC0 | ((code >> 6) & 0x1F));
+        g.s[1] = (char)(0x80 | (code & 0x3F));
+        g.len = 2;
+    } else if (code <= 0xFFFF) {
+        g.s[0] = (char)(0xE0 | ((code >> 12) & 0x0F));
+        g.s[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+        g.s[2] = (char)(0x80 | (code & 0x3F));
+        g.len = 3;
+    } else {
+        g.s[0] = (char)(0xF0 | ((code >> 18) & 0x07));
+        g.s[1] = (char)(0x80 | ((code >> 12) & 0x3F));
+        g.s[2] = (char)(0x80 | ((code >> 6) & 0x3F));
+        g.s[3] = (char)(0x80 | (code & 0x3F));
+        g.len = 4;
+    }
+    return g;
+}
+
+// render_high 的全部字形都在 Block Elements 区 U+2580..U+259F（外加空格）
+constexpr int kBlockGlyphFirst = 0x2580;
+constexpr int kBlockGlyphCount = 32;
+
+struct BlockGlyphTable {
+    Utf8Glyph v[kBlockGlyphCount];
+    constexpr BlockGlyphTable() : v{} {
+        for (int i = 0; i < kBlockGlyphCount; ++i) v[i] = encode_utf8(kBlockGlyphFirst + i);
+    }
+};
+inline constexpr BlockGlyphTable kBlockGlyphUtf8{};
+
+inline Utf8Glyph glyph_utf8(int code) {
+    const unsigned idx = (unsigned)(code - kBlockGlyphFirst);
+    if (idx < (unsigned)kBlockGlyphCount) return kBlockGlyphUtf8.v[idx];
+    return encode_utf8(code); // 空格及表外码位
+}
+
+// 单条 SGR 的最大长度：ESC[38;2;255;255;255;48;2;255;255;255m
+constexpr size_t kAnsiMaxSgr = 2 + 5 + 11 + 1 + 5 + 11 + 1;
+constexpr char kAnsiReset[] = "\x1b[0m";
+constexpr size_t kAnsiResetLen = sizeof(kAnsiReset) - 1;
+
+// 一行 out_w 个单元（每个单元至多一条 SGR 与一个 UTF-8 字形）加上 reset 与换行的上界
+constexpr size_t ansi_row_bound(int out_w) {
+    return (size_t)out_w * (kAnsiMaxSgr + 4) + kAnsiResetLen + 1;
+}
+
+// 按行写入：记录当前 fg/bg，仅在颜色变化时输出 SGR。颜色分量须在 0..255 内
+class AnsiRowWriter {
+public:
+    explicit AnsiRowWriter(char* dst) : p_(dst) {}
+
+    char* pos() const { return p_; }
+
+    // 新的一行：此前已输出 reset，颜色状态失效
+    void begin_row() { fr_ = fg_ = fb_ = br_ = bg_ = bb_ = -1; }
+
+    // 仅背景色的单元（render_low）
+    void bg_cell(int br, int bg, int bb, char c) {
+        if (br != br_ || bg != bg_ || bb != bb_) {
+            put("\x1b[48;2;", 7);
+            put_rgb(br, bg, bb);
+            *p_++ = 'm';
+            br_ = br; bg_ = bg; bb_ = bb;
+        }
+        *p_++ = c;
+    }
+
+    // fg/bg 与字形（render_high）；两者都变化时合并为一条 SGR
+    void cell(int code, int fr, int fg, int fb, int br, int bg, int bb) {
+        const bool fch = fr != fr_ || fg != fg_ || fb != fb_;
+        const bool bch = br != br_ || bg != bg_ || bb != bb_;
+        if (fch | bch) {
+            put("\x1b[", 2);
+            if (fch) {
+                put("38;2;", 5);
+                put_rgb(fr, fg, fb);
+                fr_ = fr; fg_ = fg; fb_ = fb;
+                if (bch) *p_++ = ';';
+            }
+            if (bch) {
+                put("48;2;", 5);
+                put_rgb(br, bg, bb);
+                br_ = br; bg_ = bg; bb_ = bb;
+            }
+            *p_++ = 'm';
+        }
+        const Utf8Glyph g = glyph_utf8(code);
+        std::memcpy(p_, g.s, 4); // 固定拷贝 4 字节，多出的部分由后续写入覆盖（在行上界之内）
+        p_ += g.len;
+    }
+
+    void end_row() {
+        put(kAnsiReset, kAnsiResetLen);
+        *p_++ = '\n';
+    }
+
+    void newline() { *p_++ = '\n'; }
+
+private:
+    void put(const char* s, size_t n) { std::memcpy(p_, s, n); p_ += n; }
+    void put_dec(int v) {
+        const AnsiDec &d = kAnsiDec.v[(uint8_t)v];
+        std::memcpy(p_, d.s, 3);
+        p_ += d.len;
+    }
+    void put_rgb(int r, int g, int b) {
+        put_dec(r); *p_++ = ';';
+        put_dec(g); *p_++ = ';';
+        put_dec(b);
+    }
+
+    char* p_;
+    int fr_ = -1, fg_ = -1, fb_ = -1;
+    int br_ = -1, bg_ = -1, bb_ = -1;
+};
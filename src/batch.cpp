@@ -0,0 +1,349 @@
+#include "batch.h"
+#include "OutputSink.h"
+#include "TaskSystem.h"
+#include "timing.h"
+#include "Logger.h"
+#include "Tracer.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+static bool wildcard_match(const char *pattern, const char *name) {
+    // 只支持 * 与 ?；回溯到最近一个 * 的位置
+    const char *star = nullptr, *resume = nullptr;
+    while (*name) {
+        if (*pattern == '?' || *pattern == *name) { ++pattern; ++name; }
+        else if (*pattern == '*') { star = pattern++; resume = name; }
+        else if (star) { pattern = star + 1; name = ++resume; }
+        else return false;
+    }
+    while (*pattern == '*') ++pattern;
+    return *pattern == '\0';
+}
+
+static bool has_image_extension(const fs::path &p) {
+    std::string ext = p.extension().string();
+    for (char &c : ext) c = (char)std::tolower((unsigned char)c);
+    static const char *kExtensions[] = {".jpg", ".jpeg", ".png", ".bmp", ".tga", ".gif", ".psd", ".hdr", ".pic", ".ppm", ".pgm", ".pnm"};
+    for (const char *e : kExtensions) if (ext == e) return true;
+    return false;
+}
+
+bool expand_batch_input(const std::string &arg, std::vector<std::string> &out) {
+    std::error_code ec;
+    const fs::path path(arg);
+    const std::string name = path.filename().string();
+    const bool wildcard = name.find_first_of("*?") != std::string::npos;
+    if (!wildcard && !fs::is_directory(path, ec)) {
+        out.push_back(arg);
+        return true;
+    }
+    const fs::path dir = wildcard ? (path.has_parent_path() ? path.parent_path() : fs::path(".")) : path;
+    std::vector<std::string> found;
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        if (!it->is_regular_file(ec)) continue;
+        const fs::path entry = it->path();
+        const bool match = wildcard ? wildcard_match(name.c_str(), entry.filename().string().c_str()) : has_image_extension(entry);
+        if (match) found.push_back(wildcard && !path.has_parent_path() ? entry.filename().string() : entry.string());
+    }
+    if (ec || found.empty()) return false;
+    std::sort(found.begin(), found.end());
+    out.insert(out.end(), found.begin(), found.end());
+    return true;
+}
+
+bool read_batch_list(const std::string &path, std::vector<std::string> &out) {
+    std::ifstream in(path);
+    if (!in) return false;
+    std::string line;
+    while (std::getline(in, line)) {
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' ' || line.back() == '\t')) line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+        out.push_back(line);
+    }
+    return true;
+}
+
+namespace {
+    // 级间有界队列：满时 push 阻塞、空时 pop 阻塞，并记录等待时间与峰值深度。
+    // close 之后 pop 取完剩余元素再返回 false；cancel 之后 push/pop 立即返回 false
+    template<typename T>
+    class BoundedQueue {
+    public:
+        explicit BoundedQueue(size_t capacity) : capacity(std::max<size_t>(1, capacity)) {}
+
+        bool push(T item, uint64_t &blocked_us) {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (items.size() >= capacity && !cancelled) {
+                Stopwatch sw;
+                notFull.wait(lock, [&] { return items.size() < capacity || cancelled; });
+                blocked_us += sw.elapsed_us();
+            }
+            if (cancelled) return false;
+            items.push_back(std::move(item));
+            peak = std::max(peak, items.size());
+            notEmpty.notify_one();
+            return true;
+        }
+
+        bool pop(T &item, uint64_t &starved_us) {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (items.empty() && !closed && !cancelled) {
+                Stopwatch sw;
+                notEmpty.wait(lock, [&] { return !items.empty() || closed || cancelled; });
+                starved_us += sw.elapsed_us();
+            }
+            if (cancelled || items.empty()) return false;
+            item = std::move(items.front());
+            items.pop_front();
+            notFull.notify_one();
+            return true;
+        }
+
+        void close() {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+            notEmpty.notify_all();
+        }
+
+        void cancel() {
+            std::lock_guard<std::mutex> lock(mutex);
+            cancelled = true;
+            notEmpty.notify_all();
+            notFull.notify_all();
+        }
+
+        size_t peakDepth() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return peak;
+        }
+
+    private:
+        std::mutex mutex;
+        std::condition_variable notFull, notEmpty;
+        std::deque<T> items;
+        size_t capacity;
+        size_t peak = 0;
+        bool closed = false;
+        bool cancelled = false;
+    };
+
+    struct DecodedItem {
+        size_t index = 0;
+        bool ok = false;
+        Image img;
+    };
+
+    struct FrameItem {
+        size_t index = 0;
+        PreparedFrame frame;
+    };
+
+    // 统计写出的字节数后转发
+    class CountingSink : public PicConvertor::OutputSink {
+    public:
+        explicit CountingSink(PicConvertor::OutputSink &inner) : inner(inner) {}
+        bool write(const PicConvertor::OutputChunk *chunks, size_t count) override {
+            for (size_t i = 0; i < count; ++i) bytes += chunks[i].size;
+            return inner.write(chunks, count);
+        }
+        uint64_t bytes = 0;
+
+    private:
+        PicConvertor::OutputSink &inner;
+    };
+
+    // out_dir 模式下每个输入的输出路径；同名输入追加序号避免互相覆盖
+    std::vector<std::string> output_paths(const std::vector<std::string> &inputs, const std::string &out_dir) {
+        std::vector<std::string> paths;
+        std::unordered_map<std::string, int> seen;
+        paths.reserve(inputs.size());
+        for (const std::string &in : inputs) {
+            std::string stem = fs::path(in).stem().string();
+            if (stem.empty()) stem = "image";
+            const int n = seen[stem]++;
+            if (n > 0) stem += "_" + std::to_string(n);
+            paths.push_back((fs::path(out_dir) / (stem + ".txt")).string());
+        }
+        return paths;
+    }
+}
+
+BatchStats run_batch(const std::vector<std::string> &inputs, const ConvertOptions &opt, const BatchOptions &bopt,
+                     PicConvertor::TaskSystem &pool, PicConvertor::OutputSink *shared_sink) {
+    BatchStats stats;
+    stats.decode.name = "decode";
+    stats.resample.name = "resample";
+    stats.render.name = "render";
+    Stopwatch wall;
+
+    std::vector<std::string> out_paths;
+    if (!bopt.out_dir.empty()) {
+        std::error_code ec;
+        fs::create_directories(bopt.out_dir, ec);
+        out_paths = output_paths(inputs, bopt.out_dir);
+    }
+
+    const size_t inflight = (size_t)(bopt.decode_inflight > 0 ? bopt.decode_inflight : std::max(1, pool.workerCount()));
+    BoundedQueue<DecodedItem> decoded((size_t)std::max(1, bopt.decoded_depth));
+    BoundedQueue<FrameItem> frames((size_t)std::max(1, bopt.frame_depth));
+    std::atomic<uint64_t> decode_busy_us{0};
+    std::atomic<bool> abort{false};
+
+    const DecodeHint hint = decode_hint(opt, &pool);
+    // 解码：最多 inflight 个解码任务在线程池上执行，按输入顺序取回结果
+    std::thread decoder([&]() {
+        PicConvertor::Tracer::getInstance().setThreadName("batch decode");
+        std::deque<std::future<DecodedItem>> pending;
+        size_t next = 0;
+        size_t next_result = 0; // pending 按提交顺序取回，队首即该输入
+        while (!abort.load(std::memory_order_relaxed) && (next < inputs.size() || !pending.empty())) {
+            while (next < inputs.size() && pending.size() < inflight) {
+                const size_t index = next++;
+                pending.push_back(pool.submitTask([&inputs, &decode_busy_us, &hint, index]() {
+                    PC_TRACE_SCOPE("decode");
+                    Stopwatch sw;
+                    DecodedItem item;
+                    item.index = index;
+                    item.ok = item.img.load_from_file(inputs[index], hint);
+                    decode_busy_us.fetch_add(sw.elapsed_us(), std::memory_order_relaxed);
+                    return item;
+                }));
+            }
+            // 解码任务中的异常（分配失败、解码器错误）经 future 重新抛出：只让该输入失败
+            DecodedItem item;
+            const size_t index = next_result++;
+            try {
+                item = pending.front().get();
+            } catch (const std::exception &e) {
+                item.index = index;
+                item.ok = false;
+                PC_LOG_ERROR("Batch: exception while decoding " + inputs[index] + ": " + e.what());
+            }
+            pending.pop_front();
+            if (!item.ok) {
+                ++stats.decode.failed;
+                PC_LOG_ERROR("Batch: failed to load " + inputs[item.index]);
+                continue;
+            }
+            ++stats.decode.items;
+            stats.decode.bytes += item.img.pixels.size();
+            if (!decoded.push(std::move(item), stats.decode.blocked_us)) break;
+        }
+        // 提前终止时仍需等待已提交的任务：它们引用本函数的局部变量
+        for (auto &f : pending) f.wait();
+        decoded.close();
+    });
+
+    // 重采样：逐帧执行，每帧内部由 parallel_for 并行
+    std::thread resampler([&]() {
+        PicConvertor::Tracer::getInstance().setThreadName("batch resample");
+        DecodedItem item;
+        while (decoded.pop(item, stats.resample.starved_us)) {
+            Stopwatch sw;
+            FrameItem frame;
+            frame.index = item.index;
+            try {
+                frame.frame = prepare_frame(item.img, opt, pool);
+            } catch (const std::exception &e) {
+                ++stats.resample.failed;
+                PC_LOG_ERROR("Batch: failed to resample " + inputs[item.index] + ": " + e.what());
+                item.img = Image();
+                continue;
+            }
+            item.img = Image(); // 释放像素，使驻留内存受队列深度约束
+            stats.resample.busy_us += sw.elapsed_us();
+            ++stats.resample.items;
+            stats.resample.bytes += frame.frame.bytes();
+            if (!frames.push(std::move(frame), stats.resample.blocked_us)) break;
+        }
+        frames.close();
+    });
+
+    // 渲染与写出：在调用线程上按输入顺序执行
+    FrameItem frame;
+    while (frames.pop(frame, stats.render.starved_us)) {
+        Stopwatch sw;
+        std::unique_ptr<PicConvertor::FdSink> file_sink;
+        if (!out_paths.empty()) {
+            file_sink = PicConvertor::FdSink::openFile(out_paths[frame.index]);
+            if (!file_sink) {
+                ++stats.render.failed;
+                PC_LOG_ERROR("Batch: failed to open " + out_paths[frame.index]);
+                continue;
+            }
+        }
+        CountingSink sink(file_sink ? *file_sink : *shared_sink);
+        RenderStreamStats rs;
+        try {
+            rs = render_frame(frame.frame, opt, pool, sink);
+        } catch (const std::exception &e) {
+            // sink 本身仍然可用：只让该输入失败，继续后面的输入
+            file_sink.reset();
+            ++stats.render.failed;
+            PC_LOG_ERROR("Batch: failed to render " + inputs[frame.index] + ": " + e.what());
+            continue;
+        }
+        file_sink.reset();
+        stats.render.busy_us += sw.elapsed_us();
+        stats.render.bytes += sink.bytes;
+        if (!rs.ok) {
+            ++stats.render.failed;
+            PC_LOG_ERROR("Batch: failed to write output for " + inputs[frame.index]);
+            if (out_paths.empty()) {
+                // 共享输出已失效，后续输入无处可写
+                stats.ok = false;
+                abort.store(true);
+                decoded.cancel();
+                frames.cancel();
+                break;
+            }
+            continue;
+        }
+        ++stats.render.items;
+    }
+    decoder.join();
+    resampler.join();
+
+    stats.decode.busy_us = decode_busy_us.load();
+    stats.decode.peak_queued = decoded.peakDepth();
+    stats.resample.peak_queued = frames.peakDepth();
+    stats.converted = stats.render.items;
+    stats.failed = stats.decode.failed + stats.resample.failed + stats.render.failed;
+    stats.wall_us = wall.elapsed_us();
+    return stats;
+}
+
+std::string format_batch_stats(const BatchStats &stats) {
+    char line[256];
+    const double wall_s = (double)stats.wall_us / 1e6;
+    std::string out;
+    std::snprintf(line, sizeof(line), "Batch: %llu converted, %llu failed in %.3f s (%.1f images/s)%s\n",
+                  (unsigned long long)stats.converted, (unsigned long long)stats.failed, wall_s,
+                  wall_s > 0 ? (double)stats.converted / wall_s : 0.0, stats.ok ? "" : " - aborted: output write failed");
+    out += line;
+    std::snprintf(line, sizeof(line), "  %-9s %7s %6s %10s %9s %12s %11s %11s %6s %10s\n",
+                  "stage", "items", "failed", "busy ms", "busy/wall", "items/s busy", "starved ms", "blocked ms", "peakq", "MB");
+    out += line;
+    for (const BatchStageStats *s : {&stats.decode, &stats.resample, &stats.render}) {
+        const double busy_s = (double)s->busy_us / 1e6;
+        std::snprintf(line, sizeof(line), "  %-9s %7llu %6llu %10.1f %8.0f%% %12.1f %11.1f %11.1f %6s %10.1f\n",
+                      s->name, (unsigned long long)s->items, (unsigned long long)s->failed, (double)s->busy_us / 1e3,
+                      wall_s > 0 ? 100.0 * busy_s / wall_s : 0.0, busy_s > 0 ? (double)s->items / busy_s : 0.0,
+                      (double)s->starved_us / 1e3, (double)s->blocked_us / 1e3,
+                      s == &stats.render ? "-" : std::to_string(s->peak_queued).c_str(), (double)s->bytes / (1024.0 * 1024.0));
+        out += line;
+    }
+    return out;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "convert.h"
+#include <string>
+#include <vector>
+
+// 批处理：多个输入按 解码 -> 重采样 -> 渲染/写出 三级流水线转换。
+// 解码以任务形式提交到共享的 TaskSystem，重采样与渲染各自由一个驱动线程执行（内部仍使用 parallel_for），
+// 因此图像 N+2 的解码、N+1 的重采样与 N 的渲染可以重叠；级间为有界队列，限制同时驻留的图像与平面数量。
+
+// 展开一个 -i 参数并追加到 out：目录取其中的图像文件；文件名部分含 * 或 ? 时匹配同一目录下的文件
+// （两者均按名称排序），其余原样追加。目录不存在或没有匹配项时返回 false
+bool expand_batch_input(const std::string &arg, std::vector<std::string> &out);
+// 逐行读取文件列表追加到 out（忽略空行与 # 开头的行）
+bool read_batch_list(const std::string &path, std::vector<std::string> &out);
+
+struct BatchOptions {
+    std::string out_dir;      // 非空时每个输入写入 out_dir/<文件名>.txt；否则按输入顺序依次写入同一个 sink
+    int decode_inflight = 0;  // 同时进行的解码任务数，<= 0 时为 max(1, 工作线程数)
+    int decoded_depth = 2;    // 已解码、等待重采样的图像数上限
+    int frame_depth = 2;      // 已重采样、等待渲染的帧数上限
+};
+
+struct BatchStageStats {
+    const char *name = "";
+    uint64_t items = 0;       // 成功处理的输入数
+    uint64_t failed = 0;
+    uint64_t busy_us = 0;     // 处理时间（decode 为各解码任务之和，可能超过墙钟时间）
+    uint64_t starved_us = 0;  // 等待上游的时间（decode 无上游，为 0）
+    uint64_t blocked_us = 0;  // 下游队列满而等待的时间
+    uint64_t bytes = 0;       // decode: 像素字节；resample: 平面字节；render: 输出字节
+    size_t peak_queued = 0;   // 本级输出队列的峰值深度
+};
+
+struct BatchStats {
+    BatchStageStats decode, resample, render;
+    uint64_t wall_us = 0;
+    uint64_t converted = 0;
+    uint64_t failed = 0;
+    bool ok = true;           // false 表示共享输出写入失败，批处理已提前终止
+};
+
+BatchStats run_batch(const std::vector<std::string> &inputs, const ConvertOptions &opt, const BatchOptions &bopt,
+                     PicConvertor::TaskSystem &pool, PicConvertor::OutputSink *shared_sink);
+
+// 每级吞吐、利用率与等待时间的汇总表（多行文本）
+std::string format_batch_stats(const BatchStats &stats);
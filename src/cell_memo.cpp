@@ -0,0 +1,45 @@
+#include "cell_memo.h"
+#include <algorithm>
+#include <cstring>
+
+void CellMemo::begin_frame(uint64_t frame) {
+    if (tags_.empty()) {
+        tags_.assign(kEntries, 0);
+        keys_.resize((size_t)kEntries * kCellKeyBytes);
+        choices_.resize(kEntries);
+    } else if (frame != frame_) {
+        std::fill(tags_.begin(), tags_.end(), 0);
+    }
+    frame_ = frame;
+}
+
+uint64_t CellMemo::hash_key(const uint8_t* key) {
+    // 4 路独立的乘法混合（避免一条长依赖链），最后合并；最低位置 1 以区分空槽
+    uint64_t h[4] = {0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full, 0x165667B19E3779F9ull, 0x27D4EB2F165667C5ull};
+    for (int i = 0; i < kCellKeyBytes; i += 32) {
+        for (int j = 0; j < 4; ++j) {
+            uint64_t w;
+            std::memcpy(&w, key + i + 8 * j, 8);
+            h[j] = (h[j] ^ w) * 0xFF51AFD7ED558CCDull;
+            h[j] ^= h[j] >> 29;
+        }
+    }
+    uint64_t r = h[0] ^ (h[1] * 0x9E3779B97F4A7C15ull) ^ (h[2] * 0xC2B2AE3D27D4EB4Full) ^ (h[3] * 0x165667B19E3779F9ull);
+    r ^= r >> 32;
+    return r | 1;
+}
+
+bool CellMemo::lookup(const uint8_t* key, uint64_t hash, CellChoice &choice) const {
+    const size_t slot = (size_t)(hash >> 32) & (kEntries - 1);
+    if (tags_[slot] != hash) return false;
+    if (std::memcmp(&keys_[slot * kCellKeyBytes], key, kCellKeyBytes) != 0) return false;
+    choice = choices_[slot];
+    return true;
+}
+
+void CellMemo::insert(const uint8_t* key, uint64_t hash, const CellChoice &choice) {
+    const size_t slot = (size_t)(hash >> 32) & (kEntries - 1);
+    tags_[slot] = hash;
+    std::memcpy(&keys_[slot * kCellKeyBytes], key, kCellKeyBytes);
+    choices_[slot] = choice;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "resample.h"
+#include "glyph_eval.h"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// render_high 的单元级 memo：以单元 8×8×3 的（量化）内容为键复用 glyph search 的结果，
+// 适合重复纹理（平铺图案、截图中的 UI 元素等）。键逐字节比较，哈希只用于定位槽位，不会误命中。
+
+constexpr int kCellKeyBytes = 3 * 64;
+
+// 把单元 (cx, cy) 的内容按 R、G、B 各 64 字节（单元内行主序）收集到 key。
+// quant_bits > 0 时丢弃每个值的低 quant_bits 位并取量化区间的中点，相近的单元得到相同的键；
+// 渲染随后直接使用重建后的内容求值，因此同键单元的结果与求值顺序无关，输出保持确定
+template<PlaneLayout L>
+inline void gather_cell_key(const BlockPlanesT<L> &planes, int cx, int cy, int quant_bits, uint8_t* key) {
+    for (int dy = 0; dy < 8; ++dy) {
+        const size_t row = planes.cell_row(cx, cy, dy);
+        std::memcpy(key + dy * 8, &planes.r[row], 8);
+        std::memcpy(key + 64 + dy * 8, &planes.g[row], 8);
+        std::memcpy(key + 128 + dy * 8, &planes.b[row], 8);
+    }
+    if (quant_bits <= 0) return;
+    const uint8_t mask = (uint8_t)(0xFFu << quant_bits);
+    const uint8_t half = (uint8_t)(1u << (quant_bits - 1));
+    for (int i = 0; i < kCellKeyBytes; ++i) key[i] = (uint8_t)((key[i] & mask) | half);
+}
+
+// 直接映射的 memo 表（每个线程一张，按帧清空）
+class CellMemo {
+public:
+    static constexpr int kEntries = 1024;
+
+    // frame 与上次不同时清空全部槽位
+    void begin_frame(uint64_t frame);
+    bool lookup(const uint8_t* key, uint64_t hash, CellChoice &choice) const;
+    void insert(const uint8_t* key, uint64_t hash, const CellChoice &choice);
+
+    static uint64_t hash_key(const uint8_t* key);
+
+private:
+    uint64_t frame_ = 0;
+    std::vector<uint64_t> tags_;  // 0 表示空槽
+    std::vector<uint8_t> keys_;
+    std::vector<CellChoice> choices_;
+};
@@ -0,0 +1,167 @@
+#include "cell_moments.h"
+#include "simd_kernels.h"
+#if PICCONV_KERNEL_ISA >= PICCONV_ISA_AVX2
+    #include <immintrin.h>
+#elif PICCONV_KERNEL_ISA >= PICCONV_ISA_SSE41
+    #include <emmintrin.h>
+#endif
+
+// 多版本 kernel TU（见 simd_kernels.h）：scalar 构建使用标量路径，其余级别使用 SSE2 指令的两行一组路径。
+// cell_means_row 在 Linear 布局下按 ISA 宽度一次处理 2/4/8 个相邻单元（每个单元行恰为 8 字节，正好对应一个 SAD 分组）
+namespace PICCONV_ISA_NS {
+
+// 由每行/每列之和与 2×2 象限和导出前缀矩
+static inline void finish_moments(const uint32_t rows[8], const uint32_t cols[8], const uint32_t quad[4],
+                                  uint32_t sq, ChannelMoments &m) {
+    uint32_t acc = 0;
+    for (int k = 0; k < 8; ++k) { acc += rows[7 - k]; m.bottom_rows[k] = acc; }
+    m.total = acc;
+    acc = 0;
+    for (int k = 0; k < 8; ++k) { acc += cols[k]; m.left_cols[k] = acc; }
+    for (int q = 0; q < 4; ++q) m.quad[q] = quad[q];
+    m.total_sq = sq;
+}
+
+static inline void channel_moments_scalar(const uint8_t* p, size_t row_stride, ChannelMoments &m) {
+    uint32_t rows[8] = {0}, cols[8] = {0}, quad[4] = {0};
+    uint32_t sq = 0;
+    for (int dy = 0; dy < 8; ++dy) {
+        const uint8_t* row = p + (size_t)dy * row_stride;
+        for (int dx = 0; dx < 8; ++dx) {
+            uint32_t v = row[dx];
+            rows[dy] += v;
+            cols[dx] += v;
+            quad[(dy >> 2) * 2 + (dx >> 2)] += v;
+            sq += v * v;
+        }
+    }
+    finish_moments(rows, cols, quad, sq, m);
+}
+
+#if PICCONV_KERNEL_ISA >= PICCONV_ISA_SSE41
+// 每次处理两行（16 字节）：SAD 得到两行之和，零扩展到 u16 后累加列和并用 madd 求平方和
+static inline void channel_moments_sse2(const uint8_t* p, size_t row_stride, ChannelMoments &m) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i col_top = zero, col_bot = zero, sq = zero;
+    alignas(16) uint32_t rows[8];
+    for (int pair = 0; pair < 4; ++pair) {
+        const uint8_t* r0 = p + (size_t)(2 * pair) * row_stride;
+        __m128i v = (row_stride == 8)
+            ? _mm_loadu_si128((const __m128i*)r0)
+            : _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)r0), _mm_loadl_epi64((const __m128i*)(r0 + row_stride)));
+        __m128i sad = _mm_sad_epu8(v, zero);
+        rows[2 * pair] = (uint32_t)_mm_cvtsi128_si32(sad);
+        rows[2 * pair + 1] = (uint32_t)_mm_extract_epi16(sad, 4);
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        sq = _mm_add_epi32(sq, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+        __m128i cols = _mm_add_epi16(lo, hi); // 每列最多 8×255，u16 不会溢出
+        if (pair < 2) col_top = _mm_add_epi16(col_top, cols);
+        else col_bot = _mm_add_epi16(col_bot, cols);
+    }
+    alignas(16) uint16_t top[8], bot[8];
+    alignas(16) uint32_t sq4[4];
+    _mm_store_si128((__m128i*)top, col_top);
+    _mm_store_si128((__m128i*)bot, col_bot);
+    _mm_store_si128((__m128i*)sq4, sq);
+    uint32_t cols[8];
+    for (int k = 0; k < 8; ++k) cols[k] = (uint32_t)top[k] + bot[k];
+    uint32_t quad[4] = {
+        (uint32_t)top[0] + top[1] + top[2] + top[3],
+        (uint32_t)top[4] + top[5] + top[6] + top[7],
+        (uint32_t)bot[0] + bot[1] + bot[2] + bot[3],
+        (uint32_t)bot[4] + bot[5] + bot[6] + bot[7],
+    };
+    finish_moments(rows, cols, quad, sq4[0] + sq4[1] + sq4[2] + sq4[3], m);
+}
+#endif
+
+void cell_moments_row(const uint8_t* r, const uint8_t* g, const uint8_t* b,
+                      size_t cell_step, size_t row_stride, int count, CellMoments* out) {
+    for (int i = 0; i < count; ++i) {
+        const size_t off = (size_t)i * cell_step;
+#if PICCONV_KERNEL_ISA >= PICCONV_ISA_SSE41
+        channel_moments_sse2(r + off, row_stride, out[i].ch[0]);
+        channel_moments_sse2(g + off, row_stride, out[i].ch[1]);
+        channel_moments_sse2(b + off, row_stride, out[i].ch[2]);
+#else
+        channel_moments_scalar(r + off, row_stride, out[i].ch[0]);
+        channel_moments_scalar(g + off, row_stride, out[i].ch[1]);
+        channel_moments_scalar(b + off, row_stride, out[i].ch[2]);
+#endif
+    }
+}
+
+static inline uint32_t cell_sum_scalar(const uint8_t* p, size_t row_stride) {
+    uint32_t sum = 0;
+    for (int dy = 0; dy < 8; ++dy) {
+        const uint8_t* row = p + (size_t)dy * row_stride;
+        for (int dx = 0; dx < 8; ++dx) sum += row[dx];
+    }
+    return sum;
+}
+
+// 单个平面的一行单元均值；返回已处理的单元数，其余由调用方用标量路径补齐
+static inline int plane_means_simd(const uint8_t* p, size_t cell_step, size_t row_stride, int count, uint8_t* out) {
+    int i = 0;
+#if PICCONV_KERNEL_ISA >= PICCONV_ISA_SSE41
+    if (cell_step == 8) {
+        // Linear：单元行在平面行内相邻，SAD 的每个 64 位分组恰为一个单元的一行之和
+#if PICCONV_KERNEL_ISA >= PICCONV_ISA_AVX512BW
+        const __m512i zero512 = _mm512_setzero_si512();
+        for (; i + 8 <= count; i += 8) {
+            __m512i acc = zero512;
+            for (int dy = 0; dy < 8; ++dy)
+                acc = _mm512_add_epi64(acc, _mm512_sad_epu8(_mm512_loadu_si512(p + (size_t)dy * row_stride + (size_t)i * 8), zero512));
+            _mm_storel_epi64((__m128i*)(out + i), _mm512_cvtepi64_epi8(_mm512_srli_epi64(acc, 6)));
+        }
+#endif
+#if PICCONV_KERNEL_ISA >= PICCONV_ISA_AVX2
+        const __m256i zero256 = _mm256_setzero_si256();
+        for (; i + 4 <= count; i += 4) {
+            __m256i acc = zero256;
+            for (int dy = 0; dy < 8; ++dy)
+                acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*)(p + (size_t)dy * row_stride + (size_t)i * 8)), zero256));
+            alignas(32) uint64_t s4[4];
+            _mm256_store_si256((__m256i*)s4, acc);
+            for (int k = 0; k < 4; ++k) out[i + k] = (uint8_t)(s4[k] >> 6);
+        }
+#endif
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 2 <= count; i += 2) {
+            __m128i acc = zero;
+            for (int dy = 0; dy < 8; ++dy)
+                acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(p + (size_t)dy * row_stride + (size_t)i * 8)), zero));
+            out[i] = (uint8_t)(_mm_cvtsi128_si32(acc) >> 6);
+            out[i + 1] = (uint8_t)(_mm_extract_epi16(acc, 4) >> 6);
+        }
+    } else if (row_stride == 8) {
+        // Tiled8x8：单元为连续的 64 字节
+        const __m128i zero = _mm_setzero_si128();
+        for (; i < count; ++i) {
+            const uint8_t* c = p + (size_t)i * cell_step;
+            __m128i acc = _mm_sad_epu8(_mm_loadu_si128((const __m128i*)c), zero);
+            acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(c + 16)), zero));
+            acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(c + 32)), zero));
+            acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(c + 48)), zero));
+            out[i] = (uint8_t)((_mm_cvtsi128_si32(acc) + _mm_extract_epi16(acc, 4)) >> 6);
+        }
+    }
+#else
+    (void)p; (void)cell_step; (void)row_stride; (void)count; (void)out;
+#endif
+    return i;
+}
+
+void cell_means_row(const uint8_t* r, const uint8_t* g, const uint8_t* b,
+                    size_t cell_step, size_t row_stride, int count,
+                    uint8_t* outR, uint8_t* outG, uint8_t* outB) {
+    const uint8_t* planes[3] = {r, g, b};
+    uint8_t* outs[3] = {outR, outG, outB};
+    for (int c = 0; c < 3; ++c) {
+        for (int i = plane_means_simd(planes[c], cell_step, row_stride, count, outs[c]); i < count; ++i)
+            outs[c][i] = (uint8_t)(cell_sum_scalar(planes[c] + (size_t)i * cell_step, row_stride) >> 6);
+    }
+}
+
+} // namespace PICCONV_ISA_NS
@@ -0,0 +1,55 @@
+#pragma once
+#include "resample.h"
+#include "CpuDispatch.h"
+#include <cstddef>
+#include <cstdint>
+
+// render_high 的单元级矩 kernel：每个字形都是固定 8×8 单元内的轴对齐矩形或象限，
+// 因此只需要单元内的行/列前缀和与象限和（平方和只用到整单元总量），无需整幅 summed-area table。
+
+// 单个通道在一个 8×8 单元内的矩
+struct ChannelMoments {
+    uint32_t total;          // 64 个子像素之和
+    uint32_t total_sq;       // 64 个子像素的平方和
+    uint32_t bottom_rows[8]; // bottom_rows[k]：最下方 k+1 行之和（水平字形）
+    uint32_t left_cols[8];   // left_cols[k]：最左侧 k+1 列之和（垂直字形）
+    uint32_t quad[4];        // 象限和：左上、右上、左下、右下
+};
+
+struct CellMoments {
+    ChannelMoments ch[3]; // R, G, B
+};
+
+// 计算一行连续 count 个单元的矩。cell_step 为相邻单元首子像素的下标差，row_stride 为单元内相邻行的下标差。
+// 实现按 ISA 多版本编译（cell_moments.cpp），经 CpuDispatch 的 kernel 表分派
+inline void compute_cell_moments_row(const uint8_t* r, const uint8_t* g, const uint8_t* b,
+                                     size_t cell_step, size_t row_stride, int count, CellMoments* out) {
+    PicConvertor::kernels().cell_moments_row(r, g, b, cell_step, row_stride, count, out);
+}
+
+// 按平面布局计算第 cy 行单元中 [cx0, cx0+count) 的矩
+template<PlaneLayout L>
+inline void compute_cell_moments_row(const BlockPlanesT<L> &planes, int cx0, int cy, int count, CellMoments* out) {
+    const size_t base = planes.cell_row(cx0, cy, 0);
+    const size_t cell_step = (L == PlaneLayout::Linear) ? 8 : 64;
+    const size_t row_stride = (L == PlaneLayout::Linear) ? (size_t)planes.width : 8;
+    compute_cell_moments_row(planes.r.data() + base, planes.g.data() + base, planes.b.data() + base,
+                             cell_step, row_stride, count, out);
+}
+
+// render_low 的单元均值：每个单元 64 个子像素之和右移 6 位（与逐个累加后整除 64 相同），各通道分别写入 outR/outG/outB
+inline void compute_cell_means_row(const uint8_t* r, const uint8_t* g, const uint8_t* b,
+                                   size_t cell_step, size_t row_stride, int count,
+                                   uint8_t* outR, uint8_t* outG, uint8_t* outB) {
+    PicConvertor::kernels().cell_means_row(r, g, b, cell_step, row_stride, count, outR, outG, outB);
+}
+
+template<PlaneLayout L>
+inline void compute_cell_means_row(const BlockPlanesT<L> &planes, int cx0, int cy, int count,
+                                   uint8_t* outR, uint8_t* outG, uint8_t* outB) {
+    const size_t base = planes.cell_row(cx0, cy, 0);
+    const size_t cell_step = (L == PlaneLayout::Linear) ? 8 : 64;
+    const size_t row_stride = (L == PlaneLayout::Linear) ? (size_t)planes.width : 8;
+    compute_cell_means_row(planes.r.data() + base, planes.g.data() + base, planes.b.data() + base,
+                           cell_step, row_stride, count, outR, outG, outB);
+}
@@ -0,0 +1,148 @@
+#include "convert.h"
+#include "prune_tuner.h"
+#include "timing.h"
+#include "Logger.h"
+#include "Tracer.h"
+#include "RenderCache.h"
+#include "TaskSystem.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+
+int default_out_height(ImageView img, int out_w) {
+    // 近似字符单元纵横比：高度约为宽度的两倍 -> 使用 0.5
+    const double aspect = 0.5;
+    // 按原始尺寸推算，DCT 域缩小解码不改变结果
+    if (img.source_width <= 0) return 1;
+    return std::max(1, (int)std::round((double)img.source_height * out_w * aspect / img.source_width));
+}
+
+int sampling_grid_scale(const ConvertOptions &opt) {
+    return (opt.charset == Charset::low && opt.low_direct) ? 1 : 8;
+}
+
+DecodeHint decode_hint(const ConvertOptions &opt, PicConvertor::TaskSystem *pool) {
+    const int sub = sampling_grid_scale(opt);
+    DecodeHint hint;
+    hint.pool = pool;
+    if (opt.full_decode) return hint;
+    hint.min_width = opt.out_w * sub;
+    hint.min_height = opt.out_h > 0 ? opt.out_h * sub : 0;
+    return hint;
+}
+
+uint64_t render_options_hash(const ConvertOptions &opt) {
+    // 逐字段写入定长缓冲区再哈希，避免结构体填充字节参与
+    const int64_t fields[] = {kRenderOutputVersion, opt.out_w, std::max(0, opt.out_h), (int64_t)opt.charset,
+                              opt.prune_threshold, opt.prune_given, opt.memo_quant, opt.low_direct, opt.full_decode};
+    uint64_t h = PicConvertor::RenderCache::hashBytes(fields, sizeof(fields));
+    // 按类别取阈值时结果取决于 tune 文件的内容（-P 会改写它）
+    if (opt.charset == Charset::high && !opt.prune_given && !opt.tune_file.empty()) {
+        std::ifstream in(opt.tune_file, std::ios::binary);
+        const std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        h = PicConvertor::RenderCache::hashBytes(text.data(), text.size(), h);
+    }
+    return h;
+}
+
+PreparedFrame prepare_frame(ImageView img, const ConvertOptions &opt, PicConvertor::TaskSystem &pool) {
+    PreparedFrame frame;
+    frame.out_w = opt.out_w;
+    frame.out_h = opt.out_h > 0 ? opt.out_h : default_out_height(img, opt.out_w);
+    Stopwatch sw;
+    if (opt.charset == Charset::low && opt.low_direct) {
+        frame.cells = true;
+        // low 只需要每单元的平均色：直接按单元分辨率采样，不生成 8x8 子像素平面
+        frame.linear = resample_to_cells(img, frame.out_w, frame.out_h, pool, opt.tile_h);
+        PC_LOGF_INFO("Resample (cell resolution) completed in {}us", sw.elapsed_us());
+        return frame;
+    }
+    // 两种模式均对每字符使用 8x8 high-res 采样
+    frame.layout = opt.layout;
+    if (opt.layout == PlaneLayout::Tiled8x8)
+        frame.tiled = resample_to_planes_fast<PlaneLayout::Tiled8x8>(img, frame.out_w*8, frame.out_h*8, pool, opt.tile_h);
+    else
+        frame.linear = resample_to_planes_fast<PlaneLayout::Linear>(img, frame.out_w*8, frame.out_h*8, pool, opt.tile_h);
+    PC_LOGF_INFO("Resample completed in {}us", sw.elapsed_us());
+    return frame;
+}
+
+template<PlaneLayout L>
+static RenderStreamStats render_planes(const BlockPlanesT<L> &high_planes, int out_w, int out_h, const ConvertOptions &opt,
+                                       PicConvertor::TaskSystem &pool, PicConvertor::OutputSink &sink) {
+    RenderStreamStats stats;
+    Stopwatch tr;
+    if (opt.charset == Charset::high) {
+        PC_TRACE_SCOPE("render_high");
+        int prune_thresh = opt.prune_threshold;
+        if (!opt.prune_given && !opt.tune_file.empty()) {
+            const char* image_class = classify_planes(high_planes);
+            if (load_tuned_threshold(opt.tune_file, image_class, prune_thresh))
+                PC_LOGF_INFO("Using tuned prune threshold for class '{}': {}", image_class, prune_thresh);
+        }
+        PruneStats prune_stats;
+        stats = render_high(high_planes, out_w, out_h, pool, sink, prune_thresh, &prune_stats, opt.memo_quant);
+        PC_LOGF_INFO("render_high completed in {}us (prune={})", tr.elapsed_us(), prune_thresh);
+        PC_LOG_INFO(format_prune_stats(prune_stats));
+    } else {
+        PC_TRACE_SCOPE("render_low");
+        stats = render_low(high_planes, out_w, out_h, pool, sink);
+        PC_LOGF_INFO("render_low completed in {}us", tr.elapsed_us());
+    }
+    return stats;
+}
+
+RenderStreamStats render_frame(const PreparedFrame &frame, const ConvertOptions &opt, PicConvertor::TaskSystem &pool, PicConvertor::OutputSink &sink) {
+    if (opt.charset == Charset::low && opt.low_direct) {
+        PC_TRACE_SCOPE("render_low");
+        Stopwatch tr;
+        RenderStreamStats stats = render_low_cells(frame.linear, pool, sink);
+        PC_LOGF_INFO("render_low completed in {}us", tr.elapsed_us());
+        return stats;
+    }
+    if (opt.layout == PlaneLayout::Tiled8x8) return render_planes(frame.tiled, frame.out_w, frame.out_h, opt, pool, sink);
+    return render_planes(frame.linear, frame.out_w, frame.out_h, opt, pool, sink);
+}
+
+RenderStreamStats convert_image(ImageView img, const ConvertOptions &opt, PicConvertor::TaskSystem &pool, PicConvertor::OutputSink &sink) {
+    Stopwatch since_call;
+    PreparedFrame frame = prepare_frame(img, opt, pool);
+    const uint64_t render_start_us = since_call.elapsed_us();
+    RenderStreamStats stats = render_frame(frame, opt, pool, sink);
+    // first_row_us 由渲染开始改为相对本次调用开始
+    stats.first_row_us += render_start_us;
+    return stats;
+}
+
+std::vector<RenderStreamStats> convert_image_multi(ImageView img, const ConvertOptions &opt, const std::vector<RenderTarget> &targets,
+                                                   PicConvertor::TaskSystem &pool) {
+    PC_TRACE_SCOPE("convert_multi");
+    const int sub = sampling_grid_scale(opt);
+    // 每个目标的采样网格；金字塔只需要构建到最小的网格仍能被覆盖为止
+    std::vector<ConvertOptions> target_opts(targets.size(), opt);
+    int min_w = INT_MAX, min_h = INT_MAX;
+    for (size_t i = 0; i < targets.size(); ++i) {
+        target_opts[i].out_w = targets[i].out_w;
+        target_opts[i].out_h = targets[i].out_h > 0 ? targets[i].out_h : default_out_height(img, targets[i].out_w);
+        min_w = std::min(min_w, target_opts[i].out_w * sub);
+        min_h = std::min(min_h, target_opts[i].out_h * sub);
+    }
+    std::vector<RenderStreamStats> stats(targets.size());
+    if (targets.empty()) return stats;
+    const ImagePyramid pyramid = build_pyramid(img, min_w, min_h, pool);
+
+    // 每个目标一个块（调用线程也参与）；目标内部的 parallel_for 嵌套在同一个 pool 上
+    Stopwatch sw;
+    pool.parallel_for(0, (int64_t)targets.size(), 1, [&](int64_t i0, int64_t i1) {
+        for (int64_t i = i0; i < i1; ++i) {
+            const ConvertOptions &o = target_opts[(size_t)i];
+            const int level = pyramid.best_level(o.out_w * sub, o.out_h * sub);
+            PC_LOGF_INFO("Target {}x{} resampled from pyramid level {}", o.out_w, o.out_h, level);
+            stats[(size_t)i] = convert_image(pyramid.level(level), o, pool, *targets[(size_t)i].sink);
+        }
+    });
+    PC_LOGF_INFO("{} targets rendered in {}us", targets.size(), sw.elapsed_us());
+    return stats;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "image.h"
+#include "renderer.h"
+#include <string>
+
+// 一次完整的转换（重采样 + 渲染 + 流式写出），供命令行、批处理流水线与 --serve 守护进程共用
+
+struct ConvertOptions {
+    int out_w = 80;
+    int out_h = 0;                 // <= 0 时按字符单元纵横比由 out_w 推算
+    Charset charset = Charset::low;
+    int prune_threshold = 24;
+    bool prune_given = true;       // false 且 tune_file 非空时按图像类别从 tune_file 取阈值
+    std::string tune_file;
+    int memo_quant = -1;
+    PlaneLayout layout = PlaneLayout::Linear;
+    bool low_direct = false;
+    int tile_h = 0;
+    bool full_decode = false;      // 关闭 JPEG 的 DCT 域缩小解码
+};
+
+// 字符单元高度约为宽度的两倍
+int default_out_height(ImageView img, int out_w);
+
+// 重采样所需的最小源分辨率（8x8 子像素网格，low_direct 时为单元网格），供解码器在 DCT 域缩小解码。
+// out_h <= 0 时高度不作约束：推算出的高度只有宽度网格的一半左右，按宽度选出的比例已经足够
+DecodeHint decode_hint(const ConvertOptions &opt, PicConvertor::TaskSystem *pool);
+
+// 影响输出字节的选项（含 kRenderOutputVersion）的哈希，作为 --cache-dir 缓存键的一部分。
+// out_h 为请求值（<= 0 表示推算，推算结果只取决于输入）；layout 与 tile_h 不改变输出，不参与哈希
+uint64_t render_options_hash(const ConvertOptions &opt);
+
+// 重采样后的一帧（渲染阶段的输入）。按选项只填充一种平面：
+// Linear 布局的 8x8 子像素平面（low_direct 时为单元分辨率平面）或 Tiled8x8 平面
+struct PreparedFrame {
+    int out_w = 0;
+    int out_h = 0;
+    PlaneLayout layout = PlaneLayout::Linear; // 填充的是哪一种平面
+    bool cells = false;                       // linear 为单元分辨率平面（low_direct）
+    BlockPlanes linear;
+    TiledBlockPlanes tiled;
+
+    size_t bytes() const { return linear.r.size() * 3 + tiled.r.size() * 3; }
+};
+
+PreparedFrame prepare_frame(ImageView img, const ConvertOptions &opt, PicConvertor::TaskSystem &pool);
+// first_row_us 相对于本次调用开始
+RenderStreamStats render_frame(const PreparedFrame &frame, const ConvertOptions &opt, PicConvertor::TaskSystem &pool, PicConvertor::OutputSink &sink);
+
+// prepare_frame + render_frame。返回的 first_row_us 相对于本次调用开始（包含重采样）
+RenderStreamStats convert_image(ImageView img, const ConvertOptions &opt, PicConvertor::TaskSystem &pool, PicConvertor::OutputSink &sink);
+
+// 同一图像的一个输出尺寸；out_h <= 0 时按 out_w 推算。各目标的 sink 互不相同
+struct RenderTarget {
+    int out_w = 0;
+    int out_h = 0;
+    PicConvertor::OutputSink *sink = nullptr;
+};
+
+// 一次渲染多个尺寸（opt 的 out_w/out_h 被各目标覆盖）：构建一次 ImagePyramid，每个目标从仍不小于其采样网格的最小一级重采样，
+// 所有目标作为任务同时提交到 pool（各自的重采样与渲染行带在同一批工作线程上交错执行）。
+// 除最大的目标外通常不再读取全分辨率源图像；结果与逐个 convert_image 相比只有盒边界与舍入带来的细微差异
+std::vector<RenderStreamStats> convert_image_multi(ImageView img, const ConvertOptions &opt, const std::vector<RenderTarget> &targets,
+                                                   PicConvertor::TaskSystem &pool);
+
+// 采样网格尺寸：8x8 子像素网格，或 low_direct 时的单元网格
+int sampling_grid_scale(const ConvertOptions &opt);
@@ -0,0 +1,329 @@
+#include "glyph_eval.h"
+#include "simd_kernels.h"
+#include <cmath>
+#include <limits>
+#if PICCONV_KERNEL_ISA >= PICCONV_ISA_AVX2
+    #include <immintrin.h>
+#elif PICCONV_KERNEL_ISA >= PICCONV_ISA_SSE41
+    #include <smmintrin.h>
+#endif
+
+// 字形误差：对每个通道，err_c = total2 - fg²/nf - bg²/nb（平方和技巧），总误差为 (err_R + err_G) + err_B。
+//
+// full(F)、space(S)、8/8 水平与 8/8 垂直的前景或背景为空，剪枝差值与误差都完全相同；
+// 由于比较为严格 <，其中只有排在最前的 F 可能胜出，因此只单独计算 F。
+// 其余 18 个两区域字形按搜索顺序放入 SoA 常量表，按 kernel 的 ISA 以 2、4 或 8 个字形为一组向量化求值（多版本编译，见 simd_kernels.h）。
+//
+// 剪枝用的整除 floor(s / n) 以乘倒数代替除法：s ≤ 64×255 且 n ≤ 64 时 s * (1/n) 的误差远小于 1/n，
+// 截断结果只可能在 s/n 恰为整数时偏小 1，用一次 (q+1)*n <= s 的比较修正即可得到精确商。
+// 误差项仍使用真正的除法，保证与逐字形实现逐位一致。
+
+namespace {
+
+enum class Region : uint8_t { Quad, Bottom, Left };
+
+struct GlyphGeom {
+    int code;
+    Region region; // 前景区域的来源：象限和 / 底部 k+1 行 / 左侧 k+1 列
+    uint8_t k;
+    uint8_t fg_cnt;
+};
+
+constexpr int kTwoRegion = 18;
+constexpr int kLanes = 24; // 补齐到 8 的倍数；padding lane 始终视为被剪枝
+
+// 与原搜索顺序一致：象限 0..3、水平 7/8..1/8、垂直 1/8..7/8（码位沿用原表）
+constexpr GlyphGeom kGlyphs[kTwoRegion] = {
+    {0x2598, Region::Quad, 0, 16}, {0x259D, Region::Quad, 1, 16},
+    {0x2596, Region::Quad, 2, 16}, {0x259E, Region::Quad, 3, 16},
+    {0x2587, Region::Bottom, 6, 56}, {0x2586, Region::Bottom, 5, 48},
+    {0x2585, Region::Bottom, 4, 40}, {0x2584, Region::Bottom, 3, 32},
+    {0x2583, Region::Bottom, 2, 24}, {0x2582, Region::Bottom, 1, 16},
+    {0x2581, Region::Bottom, 0, 8},
+    {0x2588, Region::Left, 0, 8},  {0x2589, Region::Left, 1, 16},
+    {0x258A, Region::Left, 2, 24}, {0x258B, Region::Left, 3, 32},
+    {0x258C, Region::Left, 4, 40}, {0x258D, Region::Left, 5, 48},
+    {0x258E, Region::Left, 6, 56},
+};
+
+template<typename F>
+struct LaneTable {
+    alignas(64) double v[kLanes];
+    constexpr explicit LaneTable(F f) : v{} {
+        for (int i = 0; i < kLanes; ++i) v[i] = f(i);
+    }
+};
+
+constexpr double fg_count(int i) { return i < kTwoRegion ? kGlyphs[i].fg_cnt : 1.0; }
+constexpr double bg_count(int i) { return i < kTwoRegion ? 64.0 - kGlyphs[i].fg_cnt : 1.0; }
+
+[[maybe_unused]] constexpr LaneTable kFgCnt(fg_count);
+[[maybe_unused]] constexpr LaneTable kBgCnt(bg_count);
+[[maybe_unused]] constexpr LaneTable kFgInv([](int i) { return 1.0 / fg_count(i); });
+[[maybe_unused]] constexpr LaneTable kBgInv([](int i) { return 1.0 / bg_count(i); });
+[[maybe_unused]] constexpr LaneTable kLaneIndex([](int i) { return (double)i; });
+
+inline uint32_t region_sum(const ChannelMoments &m, const GlyphGeom &g) {
+    switch (g.region) {
+        case Region::Quad: return m.quad[g.k];
+        case Region::Bottom: return m.bottom_rows[g.k];
+        default: return m.left_cols[g.k];
+    }
+}
+
+// 单元的前景和（SoA：fg[c][lane]）
+struct alignas(64) CellLanes {
+    double fg[3][kLanes];
+    double total[3];
+    double total_sq[3];
+};
+
+inline void load_lanes(const CellMoments &cm, CellLanes &L) {
+    for (int c = 0; c < 3; ++c) {
+        const ChannelMoments &m = cm.ch[c];
+        for (int i = 0; i < kTwoRegion; ++i) L.fg[c][i] = (double)region_sum(m, kGlyphs[i]);
+        for (int i = kTwoRegion; i < kLanes; ++i) L.fg[c][i] = 0.0;
+        L.total[c] = (double)m.total;
+        L.total_sq[c] = (double)m.total_sq;
+    }
+}
+
+inline int popcount8(unsigned m) {
+    m = m - ((m >> 1) & 0x55u);
+    m = (m & 0x33u) + ((m >> 2) & 0x33u);
+    return (int)((m + (m >> 4)) & 0x0Fu);
+}
+
+constexpr double kInf = std::numeric_limits<double>::infinity();
+
+// 两区域字形中的最佳者：err 为 +inf 表示全部被剪枝；kept 为未被剪枝的字形数
+struct Best { double err; int idx; int kept; };
+
+#if PICCONV_KERNEL_ISA >= PICCONV_ISA_AVX512BW
+
+inline __m512d floor_div_512(__m512d s, __m512d n, __m512d inv) {
+    const __m512d one = _mm512_set1_pd(1.0);
+    __m512d q = _mm512_roundscale_pd(_mm512_mul_pd(s, inv), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    const __mmask8 low = _mm512_cmp_pd_mask(_mm512_mul_pd(_mm512_add_pd(q, one), n), s, _CMP_LE_OQ);
+    return _mm512_mask_add_pd(q, low, q, one);
+}
+
+inline Best best_two_region(const CellLanes &L, double thresh) {
+    const __m512d vthr = _mm512_set1_pd(thresh);
+    __m512d best = _mm512_set1_pd(kInf);
+    __m512d best_idx = _mm512_setzero_pd();
+    int kept = 0;
+    for (int v = 0; v < kLanes / 8; ++v) {
+        const __m512d nf = _mm512_load_pd(kFgCnt.v + 8 * v);
+        const __m512d nb = _mm512_load_pd(kBgCnt.v + 8 * v);
+        const __m512d inf_ = _mm512_load_pd(kFgInv.v + 8 * v);
+        const __m512d inb = _mm512_load_pd(kBgInv.v + 8 * v);
+        __m512d diff = _mm512_setzero_pd();
+        __m512d e[3];
+        for (int c = 0; c < 3; ++c) {
+            const __m512d f = _mm512_load_pd(L.fg[c] + 8 * v);
+            const __m512d b = _mm512_sub_pd(_mm512_set1_pd(L.total[c]), f);
+            const __m512d fq = floor_div_512(f, nf, inf_);
+            const __m512d bq = floor_div_512(b, nb, inb);
+            diff = _mm512_add_pd(diff, _mm512_abs_pd(_mm512_sub_pd(fq, bq)));
+            e[c] = _mm512_sub_pd(_mm512_sub_pd(_mm512_set1_pd(L.total_sq[c]), _mm512_div_pd(_mm512_mul_pd(f, f), nf)),
+                                 _mm512_div_pd(_mm512_mul_pd(b, b), nb));
+        }
+        const __m512d err = _mm512_add_pd(_mm512_add_pd(e[0], e[1]), e[2]);
+        const __mmask8 valid = (__mmask8)(v * 8 + 8 <= kTwoRegion ? 0xFF : (1u << (kTwoRegion - v * 8)) - 1u);
+        const __mmask8 keep = _mm512_mask_cmp_pd_mask(valid, diff, vthr, _CMP_GE_OQ);
+        kept += popcount8(keep);
+        // 严格 <：同一 lane 上靠前的字形在相等时保留
+        const __mmask8 lt = _mm512_mask_cmp_pd_mask(keep, err, best, _CMP_LT_OQ);
+        best = _mm512_mask_blend_pd(lt, best, err);
+        best_idx = _mm512_mask_blend_pd(lt, best_idx, _mm512_load_pd(kLaneIndex.v + 8 * v));
+    }
+    const double m = _mm512_reduce_min_pd(best);
+    const __mmask8 eq = _mm512_cmp_pd_mask(best, _mm512_set1_pd(m), _CMP_EQ_OQ);
+    return Best{m, (int)_mm512_mask_reduce_min_pd(eq, best_idx), kept};
+}
+
+#elif PICCONV_KERNEL_ISA >= PICCONV_ISA_AVX2
+
+inline __m256d floor_div_256(__m256d s, __m256d n, __m256d inv) {
+    const __m256d one = _mm256_set1_pd(1.0);
+    __m256d q = _mm256_round_pd(_mm256_mul_pd(s, inv), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    const __m256d low = _mm256_cmp_pd(_mm256_mul_pd(_mm256_add_pd(q, one), n), s, _CMP_LE_OQ);
+    return _mm256_add_pd(q, _mm256_and_pd(low, one));
+}
+
+inline Best best_two_region(const CellLanes &L, double thresh) {
+    const __m256d vthr = _mm256_set1_pd(thresh);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    __m256d best = _mm256_set1_pd(kInf);
+    __m256d best_idx = _mm256_setzero_pd();
+    int kept = 0;
+    for (int v = 0; v < (kTwoRegion + 3) / 4; ++v) {
+        const __m256d nf = _mm256_load_pd(kFgCnt.v + 4 * v);
+        const __m256d nb = _mm256_load_pd(kBgCnt.v + 4 * v);
+        const __m256d inf_ = _mm256_load_pd(kFgInv.v + 4 * v);
+        const __m256d inb = _mm256_load_pd(kBgInv.v + 4 * v);
+        __m256d diff = _mm256_setzero_pd();
+        __m256d e[3];
+        for (int c = 0; c < 3; ++c) {
+            const __m256d f = _mm256_load_pd(L.fg[c] + 4 * v);
+            const __m256d b = _mm256_sub_pd(_mm256_set1_pd(L.total[c]), f);
+            const __m256d fq = floor_div_256(f, nf, inf_);
+            const __m256d bq = floor_div_256(b, nb, inb);
+            diff = _mm256_add_pd(diff, _mm256_andnot_pd(sign, _mm256_sub_pd(fq, bq)));
+            e[c] = _mm256_sub_pd(_mm256_sub_pd(_mm256_set1_pd(L.total_sq[c]), _mm256_div_pd(_mm256_mul_pd(f, f), nf)),
+                                 _mm256_div_pd(_mm256_mul_pd(b, b), nb));
+        }
+        const __m256d err = _mm256_add_pd(_mm256_add_pd(e[0], e[1]), e[2]);
+        const __m256d idx = _mm256_load_pd(kLaneIndex.v + 4 * v);
+        __m256d keep = _mm256_cmp_pd(diff, vthr, _CMP_GE_OQ);
+        keep = _mm256_and_pd(keep, _mm256_cmp_pd(idx, _mm256_set1_pd((double)kTwoRegion), _CMP_LT_OQ));
+        kept += popcount8(_mm256_movemask_pd(keep));
+        const __m256d lt = _mm256_and_pd(keep, _mm256_cmp_pd(err, best, _CMP_LT_OQ));
+        best = _mm256_blendv_pd(best, err, lt);
+        best_idx = _mm256_blendv_pd(best_idx, idx, lt);
+    }
+    // lane 间归约：先取最小误差，再在等于最小值的 lane 中取最小下标
+    __m256d m = _mm256_min_pd(best, _mm256_permute2f128_pd(best, best, 1));
+    m = _mm256_min_pd(m, _mm256_shuffle_pd(m, m, 0x5));
+    const __m256d eq = _mm256_cmp_pd(best, m, _CMP_EQ_OQ);
+    __m256d ix = _mm256_blendv_pd(_mm256_set1_pd((double)kLanes), best_idx, eq);
+    ix = _mm256_min_pd(ix, _mm256_permute2f128_pd(ix, ix, 1));
+    ix = _mm256_min_pd(ix, _mm256_shuffle_pd(ix, ix, 0x5));
+    return Best{_mm256_cvtsd_f64(m), (int)_mm256_cvtsd_f64(ix), kept};
+}
+
+#elif PICCONV_KERNEL_ISA >= PICCONV_ISA_SSE41
+
+inline __m128d floor_div_128(__m128d s, __m128d n, __m128d inv) {
+    const __m128d one = _mm_set1_pd(1.0);
+    __m128d q = _mm_round_pd(_mm_mul_pd(s, inv), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    const __m128d low = _mm_cmple_pd(_mm_mul_pd(_mm_add_pd(q, one), n), s);
+    return _mm_add_pd(q, _mm_and_pd(low, one));
+}
+
+inline Best best_two_region(const CellLanes &L, double thresh) {
+    const __m128d vthr = _mm_set1_pd(thresh);
+    const __m128d sign = _mm_set1_pd(-0.0);
+    __m128d best = _mm_set1_pd(kInf);
+    __m128d best_idx = _mm_setzero_pd();
+    int kept = 0;
+    // kTwoRegion 为偶数，无需 padding lane
+    for (int v = 0; v < kTwoRegion / 2; ++v) {
+        const __m128d nf = _mm_load_pd(kFgCnt.v + 2 * v);
+        const __m128d nb = _mm_load_pd(kBgCnt.v + 2 * v);
+        const __m128d inf_ = _mm_load_pd(kFgInv.v + 2 * v);
+        const __m128d inb = _mm_load_pd(kBgInv.v + 2 * v);
+        __m128d diff = _mm_setzero_pd();
+        __m128d e[3];
+        for (int c = 0; c < 3; ++c) {
+            const __m128d f = _mm_load_pd(L.fg[c] + 2 * v);
+            const __m128d b = _mm_sub_pd(_mm_set1_pd(L.total[c]), f);
+            const __m128d fq = floor_div_128(f, nf, inf_);
+            const __m128d bq = floor_div_128(b, nb, inb);
+            diff = _mm_add_pd(diff, _mm_andnot_pd(sign, _mm_sub_pd(fq, bq)));
+            e[c] = _mm_sub_pd(_mm_sub_pd(_mm_set1_pd(L.total_sq[c]), _mm_div_pd(_mm_mul_pd(f, f), nf)),
+                              _mm_div_pd(_mm_mul_pd(b, b), nb));
+        }
+        const __m128d err = _mm_add_pd(_mm_add_pd(e[0], e[1]), e[2]);
+        const __m128d keep = _mm_cmpge_pd(diff, vthr);
+        kept += popcount8(_mm_movemask_pd(keep));
+        const __m128d lt = _mm_and_pd(keep, _mm_cmplt_pd(err, best));
+        best = _mm_blendv_pd(best, err, lt);
+        best_idx = _mm_blendv_pd(best_idx, _mm_load_pd(kLaneIndex.v + 2 * v), lt);
+    }
+    // 两个 lane 各自保存的是其奇偶位置上的最优者：误差相等时取下标较小者
+    alignas(16) double e2[2], i2[2];
+    _mm_store_pd(e2, best);
+    _mm_store_pd(i2, best_idx);
+    const int pick = (e2[1] < e2[0] || (e2[1] == e2[0] && i2[1] < i2[0])) ? 1 : 0;
+    return Best{e2[pick], (int)i2[pick], kept};
+}
+
+#else
+
+inline Best best_two_region(const CellLanes &L, double thresh) {
+    Best best{kInf, 0, 0};
+    for (int i = 0; i < kTwoRegion; ++i) {
+        const double nf = kFgCnt.v[i], nb = kBgCnt.v[i];
+        double diff = 0.0, e[3];
+        for (int c = 0; c < 3; ++c) {
+            const double f = L.fg[c][i], b = L.total[c] - f;
+            const double fq = (double)(int64_t)(f / nf), bq = (double)(int64_t)(b / nb);
+            diff += fq > bq ? fq - bq : bq - fq;
+            e[c] = (L.total_sq[c] - f * f / nf) - b * b / nb;
+        }
+        const double err = (e[0] + e[1]) + e[2];
+        const bool keep = diff >= thresh;
+        const bool take = keep & (err < best.err);
+        best.kept += keep;
+        best.err = take ? err : best.err;
+        best.idx = take ? i : best.idx;
+    }
+    return best;
+}
+#endif
+
+} // namespace
+
+namespace PICCONV_ISA_NS {
+
+GlyphEvalCounts evaluate_glyphs(const CellMoments* cells, int count, int prune_threshold, CellChoice* out) {
+    GlyphEvalCounts counts{0, 0};
+    const double thresh = (double)prune_threshold;
+    CellLanes L;
+    for (int i = 0; i < count; ++i) {
+        const CellMoments &cm = cells[i];
+
+        // F：fg 为整单元平均色、bg 为 0
+        int avg[3];
+        int f_diff = 0;
+        double f_err[3];
+        double flat_bound = 3.0;
+        for (int c = 0; c < 3; ++c) {
+            const double T = (double)cm.ch[c].total;
+            avg[c] = (int)(cm.ch[c].total / 64);
+            f_diff += avg[c];
+            f_err[c] = (double)cm.ch[c].total_sq - T * T / 64.0;
+            flat_bound += std::sqrt(f_err[c] / 7.0);
+        }
+        const bool f_keep = f_diff >= prune_threshold;
+
+        // 低方差快速路径：两区域字形的组间平方和不超过单元平方和 SS，即 nf·nb/64·(μf-μb)² <= SS，
+        // 而 nf·nb >= 8×56，故 |μf-μb| <= sqrt(SS/7)，取整后各通道差 < sqrt(SS/7) + 1。
+        // 三通道之和的上界不超过阈值时所有两区域字形必然被剪枝，结果只能是 F 或空格，无需逐字形求值
+        if (flat_bound * (1.0 + 1e-12) <= thresh) {
+            counts.flat += 1;
+            counts.skipped += (uint64_t)kTwoRegion + (f_keep ? 0 : 4);
+            out[i] = f_keep ? CellChoice{0x2588, avg[0], avg[1], avg[2], 0, 0, 0} : CellChoice{0x20, 0, 0, 0, 0, 0, 0};
+            continue;
+        }
+
+        load_lanes(cm, L);
+        const double errF = f_keep ? (f_err[0] + f_err[1]) + f_err[2] : kInf;
+
+        const Best best = best_two_region(L, thresh);
+        // S、8/8 水平、8/8 垂直与 F 同时被剪枝
+        counts.skipped += (uint64_t)(kTwoRegion - best.kept) + (f_keep ? 0 : 4);
+
+        CellChoice &ch = out[i];
+        if (f_keep && !(best.err < errF)) {
+            ch = CellChoice{0x2588, avg[0], avg[1], avg[2], 0, 0, 0};
+        } else if (best.err < kInf) {
+            const GlyphGeom &g = kGlyphs[best.idx];
+            const uint32_t nf = g.fg_cnt, nb = 64 - nf;
+            int fgc[3], bgc[3];
+            for (int c = 0; c < 3; ++c) {
+                uint32_t f = region_sum(cm.ch[c], g);
+                fgc[c] = (int)(f / nf);
+                bgc[c] = (int)((cm.ch[c].total - f) / nb);
+            }
+            ch = CellChoice{g.code, fgc[0], fgc[1], fgc[2], bgc[0], bgc[1], bgc[2]};
+        } else {
+            ch = CellChoice{0x20, 0, 0, 0, 0, 0, 0};
+        }
+    }
+    return counts;
+}
+
+} // namespace PICCONV_ISA_NS
@@ -0,0 +1,17 @@
+#pragma once
+#include "cell_moments.h"
+#include <cstdint>
+
+// glyph search 的结果：字形码位与 fg/bg 颜色
+struct CellChoice { int cp; int fr, fg, fb, br, bg, bb; };
+
+// render_high 的候选字形数：full、space、4 个象限、8 个水平、8 个垂直
+constexpr int kGlyphCandidates = 22;
+
+// 对 count 个单元执行 glyph search：在每个单元的全部候选字形中选出平方误差最小者（相同误差取靠前者）。
+// 候选按 fg/bg 平均色的通道绝对差之和 < prune_threshold 剪枝；全部被剪枝时输出全零颜色的空格。
+// 方差小到任何两区域字形都必然被剪枝的单元直接得出结果（F 或空格），不做逐字形求值。
+// 返回被剪枝的候选总数与走快速路径的单元数（用于 PruneStats）。实现按 ISA 多版本编译（glyph_eval.cpp），经 CpuDispatch 分派。
+inline GlyphEvalCounts evaluate_glyphs(const CellMoments* cells, int count, int prune_threshold, CellChoice* out) {
+    return PicConvertor::kernels().evaluate_glyphs(cells, count, prune_threshold, out);
+}
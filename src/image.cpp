@@ -1,16 +1,81 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #include "image.h"
+#include "MappedFile.h"
+#include "jpeg_decoder.h"
+#include <climits>
+#include <cstdlib>
 #include <iostream>
 
-bool Image::load_from_file(const std::string &path) {
-    unsigned char *data = stbi_load(path.c_str(), &width, &height, &channels, 3);
+void PixelBuffer::resize(size_t n) {
+    reset();
+    if (n == 0) return;
+    uint8_t *p = static_cast<uint8_t *>(std::calloc(n, 1));
+    if (!p) throw std::bad_alloc();
+    adopt(p, n, std::free);
+}
+
+static void release_stb(void *p) { stbi_image_free(p); }
+
+// 解码器分配的缓冲直接由 pixels 接管，不再复制。baseline JPEG 走内置解码器（可在 DCT 域缩小），其余格式交给 stb
+static bool decode_into(Image &img, const uint8_t *data, size_t size, const DecodeHint &hint) {
+    if (size == 0) return false;
+    JpegDecodeInfo info;
+    if (is_jpeg(data, size) && decode_jpeg(data, size, hint, img, &info)) {
+        img.source_width = info.full_width;
+        img.source_height = info.full_height;
+        return true;
+    }
+    if (size > (size_t)INT_MAX) return false;
+    int w = 0, h = 0, c = 0;
+    unsigned char *decoded = stbi_load_from_memory(data, (int)size, &w, &h, &c, 3);
+    if (!decoded) return false;
+    img.width = img.source_width = w;
+    img.height = img.source_height = h;
+    img.channels = 3;
+    img.pixels.adopt(decoded, (size_t)w * h * 3, release_stb);
+    return true;
+}
+
+bool probe_image_size(const uint8_t *data, size_t size, int &width, int &height) {
+    if (size == 0 || size > (size_t)INT_MAX) return false;
+    int c = 0;
+    return stbi_info_from_memory(data, (int)size, &width, &height, &c) != 0;
+}
+
+bool Image::load_from_file(const std::string &path, const DecodeHint &hint) {
+    PicConvertor::MappedFile file;
+    std::string error;
+    if (!file.open(path, error)) {
+        std::cerr << "Failed to load image: " << error << "\n";
+        return false;
+    }
+    if (file.size() <= (size_t)INT_MAX) {
+        if (!decode_into(*this, file.data(), file.size(), hint)) {
+            std::cerr << "Failed to load image: " << path << " (" << (file.size() ? stbi_failure_reason() : "empty file") << ")\n";
+            return false;
+        }
+        return true;
+    }
+    // stbi_load_from_memory 的长度为 int：超大文件退回 stdio 读取
+    file.close();
+    int w = 0, h = 0, c = 0;
+    unsigned char *data = stbi_load(path.c_str(), &w, &h, &c, 3);
     if (!data) {
         std::cerr << "Failed to load image: " << path << " (" << stbi_failure_reason() << ")\n";
         return false;
     }
+    width = source_width = w;
+    height = source_height = h;
     channels = 3;
-    pixels.assign(data, data + (size_t)width * height * channels);
-    stbi_image_free(data);
+    pixels.adopt(data, (size_t)w * h * 3, release_stb);
+    return true;
+}
+
+bool Image::load_from_memory(const uint8_t *data, size_t size, const DecodeHint &hint) {
+    if (!decode_into(*this, data, size, hint)) {
+        std::cerr << "Failed to decode image from memory (" << (size && size <= (size_t)INT_MAX ? stbi_failure_reason() : "bad size") << ")\n";
+        return false;
+    }
     return true;
 }
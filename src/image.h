@@ -1,13 +1,97 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <cstddef>
 #include <cstdint>
 
+namespace PicConvertor { class TaskSystem; }
+
+// 像素缓冲：自行分配，或接管解码器（stb_image）分配的内存而不复制。只可移动
+class PixelBuffer {
+public:
+    using Release = void (*)(void *);
+
+    PixelBuffer() = default;
+    ~PixelBuffer() { reset(); }
+    PixelBuffer(PixelBuffer &&other) noexcept : ptr(other.ptr), len(other.len), release(other.release) {
+        other.ptr = nullptr; other.len = 0; other.release = nullptr;
+    }
+    PixelBuffer &operator=(PixelBuffer &&other) noexcept {
+        if (this != &other) {
+            reset();
+            ptr = other.ptr; len = other.len; release = other.release;
+            other.ptr = nullptr; other.len = 0; other.release = nullptr;
+        }
+        return *this;
+    }
+    PixelBuffer(const PixelBuffer &) = delete;
+    PixelBuffer &operator=(const PixelBuffer &) = delete;
+
+    // 接管 p 指向的 n 字节，释放时调用 release(p)；release 为空时只借用，由调用方保证内存的生命周期
+    void adopt(uint8_t *p, size_t n, Release fn) { reset(); ptr = p; len = n; release = fn; }
+    // 重新分配 n 个置零字节（不保留原内容）
+    void resize(size_t n);
+    void reset() {
+        if (ptr && release) release(ptr);
+        ptr = nullptr; len = 0; release = nullptr;
+    }
+
+    uint8_t *data() { return ptr; }
+    const uint8_t *data() const { return ptr; }
+    size_t size() const { return len; }
+    bool empty() const { return len == 0; }
+    uint8_t &operator[](size_t i) { return ptr[i]; }
+    const uint8_t &operator[](size_t i) const { return ptr[i]; }
+
+private:
+    uint8_t *ptr = nullptr;
+    size_t len = 0;
+    Release release = nullptr;
+};
+
+// 解码提示：调用方最终需要的采样网格（像素）。JPEG 据此在 DCT 域缩小解码（1/2、1/4、1/8），
+// 结果仍不小于该网格；0 表示该方向不限制，两者均为 0 时全尺寸解码
+struct DecodeHint {
+    int min_width = 0;
+    int min_height = 0;
+    PicConvertor::TaskSystem *pool = nullptr; // 非空时内置 JPEG 解码器在其上并行
+};
+
 struct Image {
     int width = 0;
     int height = 0;
     int channels = 0; // 期望为 3（RGB）
-    std::vector<uint8_t> pixels; // 行主序，RGBRGB...
+    PixelBuffer pixels; // 行主序，RGBRGB...
+    // 缩小解码前的原始尺寸（用于保持纵横比推算）；未缩小时与 width/height 相同
+    int source_width = 0;
+    int source_height = 0;
+
+    // 输入文件以只读映射交给解码器，解码结果直接由 pixels 接管
+    bool load_from_file(const std::string &path, const DecodeHint &hint = DecodeHint());
+    // 从内存中的已编码图像（JPEG/PNG/...）解码
+    bool load_from_memory(const uint8_t *data, size_t size, const DecodeHint &hint = DecodeHint());
+};
+
+// 只解析文件头取得原始尺寸，不解码（例如在分配像素之前拒绝过大的输入）；无法识别的格式返回 false
+bool probe_image_size(const uint8_t *data, size_t size, int &width, int &height);
+
+// 非拥有的只读 RGB 像素视图，重采样器的输入。可由 Image 隐式构造，
+// 也可直接指向调用方的缓冲（例如视频帧或已映射的原始像素），无需先复制进 Image
+struct ImageView {
+    const uint8_t *pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    size_t stride = 0; // 行字节数，>= width * 3
+    int source_width = 0; // 见 Image::source_width
+    int source_height = 0;
+
+    ImageView() = default;
+    ImageView(const uint8_t *pixels, int width, int height, size_t stride = 0)
+        : pixels(pixels), width(width), height(height), stride(stride ? stride : (size_t)width * 3),
+          source_width(width), source_height(height) {}
+    ImageView(const Image &img) : ImageView(img.pixels.data(), img.width, img.height) {
+        if (img.source_width > 0) { source_width = img.source_width; source_height = img.source_height; }
+    }
 
-    bool load_from_file(const std::string &path);
+    const uint8_t *row(int y) const { return pixels + (size_t)y * stride; }
 };
@@ -0,0 +1,642 @@
+#include "jpeg_decoder.h"
+#include "TaskSystem.h"
+#include "Logger.h"
+#include "Tracer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+namespace {
+
+// 第 k 个 zigzag 系数在 8×8 块中的自然顺序下标
+const uint8_t kNaturalOrder[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+inline uint8_t clamp_sample(int64_t v) { return (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v)); }
+
+// 反量化。合法数据的系数远小于 2^15；钳位只防止损坏数据（16 位量化表 × 15 位系数）溢出
+inline int32_t dequantize(int v, int q) { return (int32_t)std::max<int64_t>(-32768, std::min<int64_t>(32767, (int64_t)v * q)); }
+
+struct HuffTable {
+    static constexpr int kLookBits = 9;
+    bool present = false;
+    uint16_t fast[1 << kLookBits];   // (码长 << 8) | 符号；0 表示码长超过 kLookBits
+    // AC 用：码字与附加位合计不超过 kLookBits 时一次查出 (系数值 << 16) | (游程 << 8) | 总位数；0 表示走常规路径
+    int32_t fast_ac[1 << kLookBits];
+    int32_t maxcode[18];             // 各码长的最大码字，-1 表示该码长没有码字
+    int32_t valoffset[17];
+    uint8_t values[256];
+
+    bool build(const uint8_t *bits, const uint8_t *vals, int count) {
+        std::memcpy(values, vals, (size_t)count);
+        std::memset(fast, 0, sizeof(fast));
+        int code = 0, p = 0;
+        for (int len = 1; len <= 16; ++len) {
+            const int n = bits[len - 1];
+            if (n == 0) { maxcode[len] = -1; code <<= 1; continue; }
+            if (code + n > (1 << len)) return false; // 码长计数不合法
+            valoffset[len] = p - code;
+            for (int i = 0; i < n; ++i, ++p, ++code) {
+                if (len <= kLookBits) {
+                    const int shift = kLookBits - len;
+                    for (int j = 0; j < (1 << shift); ++j) fast[(code << shift) | j] = (uint16_t)((len << 8) | vals[p]);
+                }
+            }
+            maxcode[len] = code - 1;
+            code <<= 1;
+        }
+        maxcode[17] = 0x7FFFFFFF;
+        for (int i = 0; i < (1 << kLookBits); ++i) {
+            fast_ac[i] = 0;
+            const int len = fast[i] >> 8, run = (fast[i] >> 4) & 15, size = fast[i] & 15;
+            if (len == 0 || size == 0 || len + size > kLookBits) continue;
+            int v = (i >> (kLookBits - len - size)) & ((1 << size) - 1);
+            if (v < (1 << (size - 1))) v = v - (1 << size) + 1;
+            fast_ac[i] = v * 65536 + (run << 8) + len + size;
+        }
+        present = true;
+        return true;
+    }
+};
+
+// 熵编码数据的位读取器：0xFF00 去填充；遇到标记或数据末尾后只补零（与 libjpeg 的处理一致）
+struct BitReader {
+    const uint8_t *p;
+    const uint8_t *end;
+    uint64_t acc = 0; // 左对齐，最高位为下一位
+    int count = 0;
+
+    BitReader(const uint8_t *begin, const uint8_t *end) : p(begin), end(end) {}
+
+    void fill() {
+        // 快速路径：后续 8 字节中没有 0xFF 时整字节批量装入
+        if (end - p >= 8) {
+            uint64_t w = 0;
+            for (int i = 0; i < 8; ++i) w = (w << 8) | p[i];
+            const uint64_t inv = ~w;
+            if (!((inv - 0x0101010101010101ull) & ~inv & 0x8080808080808080ull)) {
+                const int bytes = (64 - count) >> 3;
+                acc |= (w >> (64 - bytes * 8)) << (64 - count - bytes * 8);
+                count += bytes * 8;
+                p += bytes;
+                return;
+            }
+        }
+        while (count <= 56) {
+            uint32_t byte = 0;
+            if (p < end) {
+                byte = *p;
+                if (byte == 0xFF) {
+                    if (p + 1 < end && p[1] == 0x00) p += 2;
+                    else { p = end; byte = 0; } // 标记：之后全部补零
+                } else {
+                    ++p;
+                }
+            }
+            acc |= (uint64_t)byte << (56 - count);
+            count += 8;
+        }
+    }
+    uint32_t peek(int n) const { return (uint32_t)(acc >> (64 - n)); }
+    void consume(int n) { acc <<= n; count -= n; }
+
+    // 返回 -1 表示码字无效
+    int decode(const HuffTable &t) {
+        if (count < 16) fill();
+        const uint16_t e = t.fast[peek(HuffTable::kLookBits)];
+        if (e) { consume(e >> 8); return e & 0xFF; }
+        for (int len = HuffTable::kLookBits + 1; len <= 16; ++len) {
+            const int32_t code = (int32_t)peek(len);
+            if (code <= t.maxcode[len]) { consume(len); return t.values[(code + t.valoffset[len]) & 0xFF]; }
+        }
+        return -1;
+    }
+
+    int receive_extend(int s) {
+        if (s == 0) return 0;
+        if (count < s) fill();
+        int v = (int)peek(s);
+        consume(s);
+        return v < (1 << (s - 1)) ? v - (1 << s) + 1 : v;
+    }
+};
+
+struct Component {
+    int id = 0;
+    int h = 1, v = 1;
+    int nh = 8, nv = 8;     // 每块输出的采样数（缩小解码时 < 8）
+    int tq = 0;             // 量化表
+    int td = 0, ta = 0;     // DC / AC Huffman 表
+    int blocks_w = 0, blocks_h = 0;
+    int stride = 0;         // 平面行字节数 = blocks_w * nh
+    std::vector<uint8_t> plane;
+};
+
+// 8×8 整数 IDCT（与 libjpeg 的 jidctint "islow" 相同的算法与舍入）
+constexpr int kConstBits = 13;
+constexpr int kPass1Bits = 2;
+constexpr int64_t FIX_0_298631336 = 2446, FIX_0_390180644 = 3196, FIX_0_541196100 = 4433, FIX_0_765366865 = 6270,
+                  FIX_0_899976223 = 7373, FIX_1_175875602 = 9633, FIX_1_501321110 = 12299, FIX_1_847759065 = 15137,
+                  FIX_1_961570560 = 16069, FIX_2_053119869 = 16819, FIX_2_562915447 = 20995, FIX_3_072711026 = 25172;
+
+inline int64_t descale(int64_t x, int n) { return (x + (1 << (n - 1))) >> n; }
+
+void idct_8x8(const int32_t *in, uint8_t *out, int stride) {
+    int64_t ws[64];
+    for (int c = 0; c < 8; ++c) {
+        const int32_t *col = in + c;
+        int64_t *w = ws + c;
+        if (!(col[8] | col[16] | col[24] | col[32] | col[40] | col[48] | col[56])) {
+            const int64_t dc = col[0] * (1 << kPass1Bits);
+            for (int r = 0; r < 8; ++r) w[r * 8] = dc;
+            continue;
+        }
+        int64_t z2 = col[16], z3 = col[48];
+        int64_t z1 = (z2 + z3) * FIX_0_541196100;
+        int64_t tmp2 = z1 + z3 * (-FIX_1_847759065);
+        int64_t tmp3 = z1 + z2 * FIX_0_765366865;
+        z2 = col[0]; z3 = col[32];
+        int64_t tmp0 = (z2 + z3) * (1 << kConstBits);
+        int64_t tmp1 = (z2 - z3) * (1 << kConstBits);
+        const int64_t tmp10 = tmp0 + tmp3, tmp13 = tmp0 - tmp3, tmp11 = tmp1 + tmp2, tmp12 = tmp1 - tmp2;
+
+        tmp0 = col[56]; tmp1 = col[40]; tmp2 = col[24]; tmp3 = col[8];
+        z1 = tmp0 + tmp3; z2 = tmp1 + tmp2; z3 = tmp0 + tmp2; int64_t z4 = tmp1 + tmp3;
+        const int64_t z5 = (z3 + z4) * FIX_1_175875602;
+        tmp0 *= FIX_0_298631336; tmp1 *= FIX_2_053119869; tmp2 *= FIX_3_072711026; tmp3 *= FIX_1_501321110;
+        z1 *= -FIX_0_899976223; z2 *= -FIX_2_562915447; z3 *= -FIX_1_961570560; z4 *= -FIX_0_390180644;
+        z3 += z5; z4 += z5;
+        tmp0 += z1 + z3; tmp1 += z2 + z4; tmp2 += z2 + z3; tmp3 += z1 + z4;
+
+        const int sh = kConstBits - kPass1Bits;
+        w[0]  = descale(tmp10 + tmp3, sh); w[56] = descale(tmp10 - tmp3, sh);
+        w[8]  = descale(tmp11 + tmp2, sh); w[48] = descale(tmp11 - tmp2, sh);
+        w[16] = descale(tmp12 + tmp1, sh); w[40] = descale(tmp12 - tmp1, sh);
+        w[24] = descale(tmp13 + tmp0, sh); w[32] = descale(tmp13 - tmp0, sh);
+    }
+    for (int r = 0; r < 8; ++r) {
+        const int64_t *w = ws + r * 8;
+        uint8_t *o = out + (size_t)r * stride;
+        const int sh = kConstBits + kPass1Bits + 3;
+        int64_t z2 = w[2], z3 = w[6];
+        int64_t z1 = (z2 + z3) * FIX_0_541196100;
+        int64_t tmp2 = z1 + z3 * (-FIX_1_847759065);
+        int64_t tmp3 = z1 + z2 * FIX_0_765366865;
+        int64_t tmp0 = (w[0] + w[4]) * (1 << kConstBits);
+        int64_t tmp1 = (w[0] - w[4]) * (1 << kConstBits);
+        const int64_t tmp10 = tmp0 + tmp3, tmp13 = tmp0 - tmp3, tmp11 = tmp1 + tmp2, tmp12 = tmp1 - tmp2;
+
+        tmp0 = w[7]; tmp1 = w[5]; tmp2 = w[3]; tmp3 = w[1];
+        z1 = tmp0 + tmp3; z2 = tmp1 + tmp2; z3 = tmp0 + tmp2; int64_t z4 = tmp1 + tmp3;
+        const int64_t z5 = (z3 + z4) * FIX_1_175875602;
+        tmp0 *= FIX_0_298631336; tmp1 *= FIX_2_053119869; tmp2 *= FIX_3_072711026; tmp3 *= FIX_1_501321110;
+        z1 *= -FIX_0_899976223; z2 *= -FIX_2_562915447; z3 *= -FIX_1_961570560; z4 *= -FIX_0_390180644;
+        z3 += z5; z4 += z5;
+        tmp0 += z1 + z3; tmp1 += z2 + z4; tmp2 += z2 + z3; tmp3 += z1 + z4;
+
+        o[0] = clamp_sample(descale(tmp10 + tmp3, sh) + 128); o[7] = clamp_sample(descale(tmp10 - tmp3, sh) + 128);
+        o[1] = clamp_sample(descale(tmp11 + tmp2, sh) + 128); o[6] = clamp_sample(descale(tmp11 - tmp2, sh) + 128);
+        o[2] = clamp_sample(descale(tmp12 + tmp1, sh) + 128); o[5] = clamp_sample(descale(tmp12 - tmp1, sh) + 128);
+        o[3] = clamp_sample(descale(tmp13 + tmp0, sh) + 128); o[4] = clamp_sample(descale(tmp13 - tmp0, sh) + 128);
+    }
+}
+
+// 缩小 IDCT（输出 n = 1、2、4、8 点）的一维基：M[x][u] 为 8 点 IDCT 基函数在 x 覆盖的 8/n 个采样上的平均，
+// 因此缩小解码的结果就是全尺寸解码结果的盒式平均（仅差舍入），与重采样器的盒式滤波一致
+struct ScaledIdctBasis {
+    float m[8][8]; // m[x][u]
+
+    explicit ScaledIdctBasis(int n) {
+        const double pi = 3.14159265358979323846;
+        const int group = 8 / n;
+        for (int x = 0; x < n; ++x)
+            for (int u = 0; u < 8; ++u) {
+                double sum = 0;
+                for (int k = x * group; k < (x + 1) * group; ++k) sum += std::cos((2 * k + 1) * u * pi / 16.0);
+                m[x][u] = (float)(0.5 * (u == 0 ? std::sqrt(0.5) : 1.0) * sum / group);
+            }
+    }
+};
+
+// n = 8 时的“平均”即 8 点 IDCT 本身（用于 8×4 等非方形输出）
+const ScaledIdctBasis &scaled_basis(int n) {
+    static const ScaledIdctBasis b1(1), b2(2), b4(4), b8(8);
+    return n == 1 ? b1 : (n == 2 ? b2 : (n == 4 ? b4 : b8));
+}
+
+// 输出 nh×nv（各为 1、2、4 或 8，且不同时为 8）；row_mask 标记含非零系数的行
+void idct_scaled(const int32_t *in, unsigned row_mask, uint8_t *out, int stride, int nh, int nv) {
+    const ScaledIdctBasis &bh = scaled_basis(nh);
+    const ScaledIdctBasis &bv = scaled_basis(nv);
+    float tmp[8][8] = {}; // tmp[y][u]：先沿列方向变换
+    for (int v = 0; v < 8; ++v) {
+        if (!(row_mask & (1u << v))) continue;
+        const int32_t *row = in + v * 8;
+        for (int y = 0; y < nv; ++y) {
+            const float w = bv.m[y][v];
+            for (int u = 0; u < 8; ++u) tmp[y][u] += w * (float)row[u];
+        }
+    }
+    for (int y = 0; y < nv; ++y) {
+        uint8_t *o = out + (size_t)y * stride;
+        for (int x = 0; x < nh; ++x) {
+            float s = 0;
+            for (int u = 0; u < 8; ++u) s += bh.m[x][u] * tmp[y][u];
+            o[x] = clamp_sample((int)(s + 128.5f)); // 负值截断后同样被钳位到 0
+        }
+    }
+}
+
+inline void idct_1x1(const int32_t *in, uint8_t *out) { *out = clamp_sample(descale(in[0], 3) + 128); }
+
+// YCbCr -> RGB：与 libjpeg jdcolor 相同的 16 位定点系数与舍入，按分量值预先查表；limit 为钳位表
+struct YccTables {
+    int cr_r[256], cb_b[256], cr_g[256], cb_g[256];
+    uint8_t limit[256 + 256 + 256]; // limit[256 + v] = clamp(v)，v ∈ [-256, 512)
+
+    YccTables() {
+        for (int i = 0; i < 256; ++i) {
+            const int c = i - 128;
+            cr_r[i] = (91881 * c + 32768) >> 16;
+            cb_b[i] = (116130 * c + 32768) >> 16;
+            cr_g[i] = -46802 * c;
+            cb_g[i] = -22554 * c + 32768;
+        }
+        for (int v = -256; v < 512; ++v) limit[v + 256] = clamp_sample(v);
+    }
+};
+
+const YccTables &ycc_tables() {
+    static const YccTables tables;
+    return tables;
+}
+
+struct JpegState {
+    int width = 0, height = 0;
+    int hmax = 1, vmax = 1;
+    int restart_interval = 0;
+    bool adobe = false;
+    int adobe_transform = -1;
+    bool have_frame = false;
+    uint16_t qt[4][64];     // 自然顺序
+    bool qt_present[4] = {false, false, false, false};
+    HuffTable dc[4], ac[4];
+    std::vector<Component> comps;
+    std::vector<int> scan;  // 扫描中各分量在 comps 中的下标
+    const uint8_t *scan_begin = nullptr;
+};
+
+inline uint16_t be16(const uint8_t *p) { return (uint16_t)((p[0] << 8) | p[1]); }
+
+// 解析到 SOS 为止；不支持的编码方式返回 false
+bool parse_headers(const uint8_t *data, size_t size, JpegState &st) {
+    const uint8_t *p = data + 2;
+    const uint8_t *end = data + size;
+    for (;;) {
+        while (p < end && *p != 0xFF) ++p; // 容忍标记前的多余字节
+        while (p < end && *p == 0xFF) ++p; // 填充字节
+        if (p >= end) return false;
+        const uint8_t marker = *p++;
+        if (marker == 0xD8 || (marker >= 0xD0 && marker <= 0xD7) || marker == 0x01) continue;
+        if (marker == 0xD9) return false; // SOS 之前的 EOI
+        if (end - p < 2) return false;
+        const size_t len = be16(p);
+        if (len < 2 || (size_t)(end - p) < len) return false;
+        const uint8_t *seg = p + 2;
+        const uint8_t *seg_end = p + len;
+        p = seg_end;
+
+        switch (marker) {
+        case 0xDB: // DQT
+            while (seg < seg_end) {
+                const int pq = *seg >> 4, tq = *seg & 15;
+                ++seg;
+                if (tq > 3 || pq > 1 || seg_end - seg < (pq ? 128 : 64)) return false;
+                for (int k = 0; k < 64; ++k) {
+                    st.qt[tq][kNaturalOrder[k]] = pq ? be16(seg + 2 * k) : seg[k];
+                }
+                seg += pq ? 128 : 64;
+                st.qt_present[tq] = true;
+            }
+            break;
+        case 0xC4: // DHT
+            while (seg < seg_end) {
+                if (seg_end - seg < 17) return false;
+                const int tc = *seg >> 4, th = *seg & 15;
+                if (tc > 1 || th > 3) return false;
+                int count = 0;
+                for (int i = 0; i < 16; ++i) count += seg[1 + i];
+                if (count > 256 || seg_end - seg < 17 + count) return false;
+                HuffTable &t = tc == 0 ? st.dc[th] : st.ac[th];
+                if (!t.build(seg + 1, seg + 17, count)) return false;
+                seg += 17 + count;
+            }
+            break;
+        case 0xC0: case 0xC1: { // baseline / extended sequential（Huffman）
+            if (st.have_frame || seg_end - seg < 6 || seg[0] != 8) return false;
+            st.height = be16(seg + 1);
+            st.width = be16(seg + 3);
+            const int nf = seg[5];
+            if (st.width <= 0 || st.height <= 0 || (nf != 1 && nf != 3) || seg_end - seg < 6 + 3 * nf) return false;
+            st.comps.resize((size_t)nf);
+            for (int i = 0; i < nf; ++i) {
+                Component &c = st.comps[(size_t)i];
+                c.id = seg[6 + 3 * i];
+                c.h = seg[7 + 3 * i] >> 4;
+                c.v = seg[7 + 3 * i] & 15;
+                c.tq = seg[8 + 3 * i];
+                if (c.h < 1 || c.h > 4 || c.v < 1 || c.v > 4 || c.tq > 3) return false;
+                st.hmax = std::max(st.hmax, c.h);
+                st.vmax = std::max(st.vmax, c.v);
+            }
+            for (const Component &c : st.comps)
+                if (st.hmax % c.h != 0 || st.vmax % c.v != 0) return false; // 非整数倍采样比
+            st.have_frame = true;
+            break;
+        }
+        case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+        case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+            return false; // progressive、lossless、arithmetic 等
+        case 0xDD: // DRI
+            if (seg_end - seg < 2) return false;
+            st.restart_interval = be16(seg);
+            break;
+        case 0xEE: // APP14 Adobe：transform 0 表示 RGB（或 CMYK）
+            if (seg_end - seg >= 12 && std::memcmp(seg, "Adobe", 5) == 0) {
+                st.adobe = true;
+                st.adobe_transform = seg[11];
+            }
+            break;
+        case 0xDA: { // SOS
+            if (!st.have_frame || seg_end - seg < 1) return false;
+            const int ns = seg[0];
+            if (ns != (int)st.comps.size() || seg_end - seg < 1 + 2 * ns + 3) return false; // 仅支持单次全分量扫描
+            for (int i = 0; i < ns; ++i) {
+                const int id = seg[1 + 2 * i];
+                int idx = -1;
+                for (size_t c = 0; c < st.comps.size(); ++c) if (st.comps[c].id == id) idx = (int)c;
+                if (idx < 0) return false;
+                Component &c = st.comps[(size_t)idx];
+                c.td = seg[2 + 2 * i] >> 4;
+                c.ta = seg[2 + 2 * i] & 15;
+                if (c.td > 3 || c.ta > 3 || !st.dc[c.td].present || !st.ac[c.ta].present || !st.qt_present[c.tq]) return false;
+                st.scan.push_back(idx);
+            }
+            const uint8_t ss = seg[1 + 2 * ns], se = seg[2 + 2 * ns], ahal = seg[3 + 2 * ns];
+            if (ss != 0 || se != 63 || ahal != 0) return false;
+            st.scan_begin = seg_end;
+            return true;
+        }
+        default:
+            break; // APPn、COM 等
+        }
+    }
+}
+
+// 按 RST 标记把扫描数据切分为可独立解码的段；返回扫描数据末尾（下一个非 RST 标记处）
+const uint8_t *split_restart_segments(const uint8_t *begin, const uint8_t *end, std::vector<std::pair<const uint8_t *, const uint8_t *>> &segments) {
+    const uint8_t *seg_start = begin;
+    const uint8_t *p = begin;
+    for (;;) {
+        p = static_cast<const uint8_t *>(std::memchr(p, 0xFF, (size_t)(end - p)));
+        if (!p || p + 1 >= end) { segments.emplace_back(seg_start, end); return end; }
+        const uint8_t m = p[1];
+        if (m == 0x00 || m == 0xFF) { p += 1 + (m == 0x00); continue; }
+        if (m >= 0xD0 && m <= 0xD7) {
+            segments.emplace_back(seg_start, p);
+            p += 2;
+            seg_start = p;
+            continue;
+        }
+        segments.emplace_back(seg_start, p);
+        return p;
+    }
+}
+
+// 扫描之后是否还有别的 SOS（多次扫描的 baseline 文件）
+bool has_further_scan(const uint8_t *p, const uint8_t *end) {
+    while (p + 4 <= end) {
+        if (p[0] != 0xFF) { ++p; continue; }
+        const uint8_t m = p[1];
+        if (m == 0xFF) { ++p; continue; }
+        if (m == 0xD9) return false;
+        if (m == 0xDA) return true;
+        if ((m >= 0xD0 && m <= 0xD7) || m == 0x01 || m == 0x00) { p += 2; continue; }
+        p += 2 + be16(p + 2);
+    }
+    return false;
+}
+
+} // namespace
+
+bool is_jpeg(const uint8_t *data, size_t size) {
+    return size >= 4 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF;
+}
+
+bool decode_jpeg(const uint8_t *data, size_t size, const DecodeHint &hint, Image &out, JpegDecodeInfo *info) {
+    PC_TRACE_SCOPE("jpeg_decode");
+    if (!is_jpeg(data, size)) return false;
+    JpegState st;
+    if (!parse_headers(data, size, st)) return false;
+    if ((uint64_t)st.width * st.height > (1ull << 30)) return false;
+    const uint8_t *end = data + size;
+
+    std::vector<std::pair<const uint8_t *, const uint8_t *>> segments;
+    const uint8_t *scan_end = split_restart_segments(st.scan_begin, end, segments);
+    if (has_further_scan(scan_end, end)) return false;
+
+    // 满足采样网格的最大缩小比例。缩小时子采样分量输出 N*比值 个采样，只有比值为 2 的幂时
+    // 才是 1、2、4 或 8（例如比值 3 会得到 3 或 6，没有对应的基）：否则全尺寸解码
+    bool pow2_ratios = true;
+    for (const Component &c : st.comps) {
+        const int rh = st.hmax / c.h, rv = st.vmax / c.v;
+        pow2_ratios = pow2_ratios && (rh & (rh - 1)) == 0 && (rv & (rv - 1)) == 0;
+    }
+    int scale = 1;
+    if (pow2_ratios && (hint.min_width > 0 || hint.min_height > 0)) {
+        for (int s : {8, 4, 2}) {
+            const int w = (st.width + s - 1) / s, h = (st.height + s - 1) / s;
+            if (w >= hint.min_width && h >= hint.min_height) { scale = s; break; }
+        }
+    }
+    const int N = 8 / scale;
+
+    // MCU 网格：交错扫描以 hmax×vmax 个块为单位；单分量扫描每个 MCU 为一个块
+    const bool interleaved = st.comps.size() > 1;
+    const int mcu_w = interleaved ? 8 * st.hmax : 8;
+    const int mcu_h = interleaved ? 8 * st.vmax : 8;
+    const int mcus_x = (st.width + mcu_w - 1) / mcu_w;
+    const int mcus_y = (st.height + mcu_h - 1) / mcu_h;
+    // 子采样分量用更大的 IDCT 输出（不超过 8），尽量直接得到与亮度相同的分辨率，省去复制式上采样
+    for (Component &c : st.comps) {
+        c.blocks_w = interleaved ? mcus_x * c.h : mcus_x;
+        c.blocks_h = interleaved ? mcus_y * c.v : mcus_y;
+        c.nh = interleaved ? std::min(8, N * (st.hmax / c.h)) : N;
+        c.nv = interleaved ? std::min(8, N * (st.vmax / c.v)) : N;
+        c.stride = c.blocks_w * c.nh;
+        try {
+            c.plane.assign((size_t)c.stride * c.blocks_h * c.nv, 128);
+        } catch (const std::bad_alloc &) {
+            return false;
+        }
+    }
+    const int64_t total_mcus = (int64_t)mcus_x * mcus_y;
+    const int64_t per_segment = st.restart_interval > 0 ? st.restart_interval : total_mcus;
+    const int64_t segment_count = std::min<int64_t>((int64_t)segments.size(), (total_mcus + per_segment - 1) / per_segment);
+
+    auto decode_segment = [&](int64_t seg) {
+        BitReader br(segments[(size_t)seg].first, segments[(size_t)seg].second);
+        int pred[4] = {0, 0, 0, 0};
+        int32_t coef[64] = {}; // 每块用完后按 row_mask 清零
+        const int64_t m0 = seg * per_segment;
+        const int64_t m1 = std::min(total_mcus, m0 + per_segment);
+        for (int64_t m = m0; m < m1; ++m) {
+            const int mx = (int)(m % mcus_x), my = (int)(m / mcus_x);
+            for (size_t si = 0; si < st.scan.size(); ++si) {
+                Component &c = st.comps[(size_t)st.scan[si]];
+                const HuffTable &dct = st.dc[c.td];
+                const HuffTable &act = st.ac[c.ta];
+                const uint16_t *q = st.qt[c.tq];
+                const int bh = interleaved ? c.h : 1, bv = interleaved ? c.v : 1;
+                for (int v = 0; v < bv; ++v) {
+                    for (int h = 0; h < bh; ++h) {
+                        unsigned row_mask = 1;
+                        const int t = br.decode(dct);
+                        if (t < 0 || t > 16) return; // 损坏的数据：放弃本段剩余部分
+                        pred[si] = std::max(-65536, std::min(65535, pred[si] + br.receive_extend(t)));
+                        coef[0] = dequantize(pred[si], q[0]);
+                        for (int k = 1; k < 64;) {
+                            if (br.count < 16) br.fill();
+                            const int32_t fe = act.fast_ac[br.peek(HuffTable::kLookBits)];
+                            if (fe) {
+                                br.consume(fe & 255);
+                                k += (fe >> 8) & 15;
+                                if (k > 63) return;
+                                const int n = kNaturalOrder[k];
+                                coef[n] = (fe >> 16) * q[n];
+                                row_mask |= 1u << (n >> 3);
+                                ++k;
+                                continue;
+                            }
+                            const int rs = br.decode(act);
+                            if (rs < 0) return;
+                            const int r = rs >> 4, s = rs & 15;
+                            if (s == 0) {
+                                if (r != 15) break; // EOB
+                                k += 16;
+                                continue;
+                            }
+                            k += r;
+                            if (k > 63) return;
+                            const int val = br.receive_extend(s);
+                            const int n = kNaturalOrder[k];
+                            coef[n] = dequantize(val, q[n]);
+                            row_mask |= 1u << (n >> 3);
+                            ++k;
+                        }
+                        const int bx = interleaved ? mx * c.h + h : mx;
+                        const int by = interleaved ? my * c.v + v : my;
+                        uint8_t *dst = c.plane.data() + (size_t)by * c.nv * c.stride + (size_t)bx * c.nh;
+                        if (c.nh == 8 && c.nv == 8) idct_8x8(coef, dst, c.stride);
+                        else if (c.nh == 1 && c.nv == 1) idct_1x1(coef, dst);
+                        else idct_scaled(coef, row_mask, dst, c.stride, c.nh, c.nv);
+                        for (int r = 0; r < 8; ++r)
+                            if (row_mask & (1u << r)) std::memset(coef + r * 8, 0, 8 * sizeof(int32_t));
+                    }
+                }
+            }
+        }
+    };
+    if (hint.pool && segment_count > 1) {
+        PC_TRACE_SCOPE("jpeg_segments");
+        hint.pool->parallel_for(0, segment_count, 1, [&](int64_t s0, int64_t s1) {
+            for (int64_t s = s0; s < s1; ++s) decode_segment(s);
+        });
+    } else {
+        for (int64_t s = 0; s < segment_count; ++s) decode_segment(s);
+    }
+
+    // 上采样（按采样比复制）与颜色转换，输出 ceil(W/scale)×ceil(H/scale)
+    const int out_w = (st.width + scale - 1) / scale;
+    const int out_h = (st.height + scale - 1) / scale;
+    uint8_t *rgb = static_cast<uint8_t *>(std::malloc((size_t)out_w * out_h * 3));
+    if (!rgb) return false;
+    const bool gray = st.comps.size() == 1;
+    const bool is_rgb = !gray && ((st.adobe && st.adobe_transform == 0) ||
+                                  (st.comps[0].id == 'R' && st.comps[1].id == 'G' && st.comps[2].id == 'B'));
+    // 各分量列号：x * 比例。比例为 1、1/2、1/4 时用移位，否则查表
+    std::vector<int> xmap[3];
+    int xshift[3] = {0, 0, 0};
+    for (size_t ci = 0; ci < st.comps.size(); ++ci) {
+        const Component &c = st.comps[ci];
+        const int num = gray ? 1 : c.h * c.nh, den = gray ? 1 : st.hmax * N;
+        xshift[ci] = num == den ? 0 : (num * 2 == den ? 1 : (num * 4 == den ? 2 : -1));
+        if (xshift[ci] >= 0) continue;
+        xmap[ci].resize((size_t)out_w);
+        for (int x = 0; x < out_w; ++x) xmap[ci][(size_t)x] = x * num / den;
+    }
+    auto convert_rows = [&](int64_t y0, int64_t y1) {
+        const int w = out_w;
+        std::vector<uint8_t> expanded[3];
+        // 返回分量 ci 在输出行 y 上按输出列对齐的采样（比例为 1 时直接指向平面）
+        auto component_row = [&](int ci, int64_t y) -> const uint8_t * {
+            const Component &c = st.comps[(size_t)ci];
+            const uint8_t *src = c.plane.data() + (size_t)(gray ? y : y * c.v * c.nv / (st.vmax * N)) * c.stride;
+            if (xshift[ci] == 0) return src;
+            std::vector<uint8_t> &e = expanded[ci];
+            e.resize((size_t)w);
+            uint8_t *d = e.data();
+            if (xshift[ci] > 0) {
+                const int sh = xshift[ci];
+                for (int x = 0; x < w; ++x) d[x] = src[x >> sh];
+            } else {
+                const int *map = xmap[ci].data();
+                for (int x = 0; x < w; ++x) d[x] = src[map[x]];
+            }
+            return d;
+        };
+        for (int64_t y = y0; y < y1; ++y) {
+            uint8_t *o = rgb + (size_t)y * w * 3;
+            if (gray) {
+                const uint8_t *yr = component_row(0, y);
+                for (int x = 0; x < w; ++x) { o[3 * x] = o[3 * x + 1] = o[3 * x + 2] = yr[x]; }
+                continue;
+            }
+            const uint8_t *r0 = component_row(0, y), *r1 = component_row(1, y), *r2 = component_row(2, y);
+            if (is_rgb) {
+                for (int x = 0; x < w; ++x) { o[3 * x] = r0[x]; o[3 * x + 1] = r1[x]; o[3 * x + 2] = r2[x]; }
+                continue;
+            }
+            const YccTables &t = ycc_tables();
+            for (int x = 0; x < w; ++x) {
+                const uint8_t *lim = t.limit + 256 + r0[x];
+                const int cb = r1[x], cr = r2[x];
+                o[3 * x]     = lim[t.cr_r[cr]];
+                o[3 * x + 1] = lim[(t.cb_g[cb] + t.cr_g[cr]) >> 16];
+                o[3 * x + 2] = lim[t.cb_b[cb]];
+            }
+        }
+    };
+    if (hint.pool) hint.pool->parallel_for(0, out_h, 0, convert_rows);
+    else convert_rows(0, out_h);
+
+    out.width = out_w;
+    out.height = out_h;
+    out.channels = 3;
+    out.pixels.adopt(rgb, (size_t)out_w * out_h * 3, std::free);
+    PC_LOGF_INFO("JPEG {}x{} decoded at 1/{} -> {}x{} ({} restart segments)", st.width, st.height, scale, out_w, out_h, segment_count);
+    if (info) {
+        info->full_width = st.width;
+        info->full_height = st.height;
+        info->scale_denom = scale;
+        info->restart_segments = (int)segment_count;
+    }
+    return true;
+}
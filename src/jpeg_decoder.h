@@ -0,0 +1,25 @@
+#pragma once
+#include "image.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace PicConvertor { class TaskSystem; }
+
+// 内置 baseline JPEG 解码器（SOF0/SOF1、Huffman、8 位精度、单次交错扫描，灰度或 YCbCr）。
+// 在 DCT 域按 1/2、1/4、1/8 缩小解码：每个 8×8 块直接输出 N×N（N = 8/scale）个采样，其值为全尺寸
+// IDCT 结果的盒式平均，IDCT、颜色转换与像素/分量平面内存随面积下降。存在 restart interval 时各段并行解码。
+// progressive、arithmetic、12 位、CMYK 与多次扫描等不支持的格式返回 false，由调用方回退到 stb_image。
+
+// 数据是否以 JPEG SOI 标记开头
+bool is_jpeg(const uint8_t *data, size_t size);
+
+struct JpegDecodeInfo {
+    int full_width = 0;     // 原始尺寸
+    int full_height = 0;
+    int scale_denom = 1;    // 1、2、4 或 8
+    int restart_segments = 1;
+};
+
+// 解码为 RGB。选择使 ceil(W/scale) >= min_width 且 ceil(H/scale) >= min_height 的最大 scale；
+// pool 非空时 restart 段与颜色转换在其上并行
+bool decode_jpeg(const uint8_t *data, size_t size, const DecodeHint &hint, Image &out, JpegDecodeInfo *info = nullptr);
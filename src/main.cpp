@@ -1,29 +1,235 @@
+#include <algorithm>
 #include <iostream>
+#ifdef _WIN32
 #include <windows.h>
+#endif
 #include <fstream>
 #include <string>
 #include <cstring>
 #include <cmath>
+#include <type_traits>
+#include <memory>
+#include <iterator>
+#include <vector>
+#include <climits>
+#include <csignal>
+#ifndef _WIN32
+#include <pthread.h>
+#include <stdlib.h>
+#endif
 #include "image.h"
 #include "resample.h"
 #include "renderer.h"
+#include "prune_tuner.h"
+#include "convert.h"
+#include "plane_file.h"
+#include "batch.h"
+#include "Server.h"
+#include "ServeProtocol.h"
 #include "TaskSystem.h"
 #include "timing.h"
 #include "Logger.h"
+#include "Tracer.h"
+#include "CpuDispatch.h"
+#include "OutputSink.h"
+#include "ProcessStats.h"
+#include "MappedFile.h"
+#include "RenderCache.h"
 
 void print_usage() {
-    std::cout << "Usage: picconvertor -i <input.jpg> [-w width_chars] [-h height_chars] [-s charset] [-T tile_height] [-o output.txt]\n";
+    std::cout << "Usage: picconvertor -i <input.jpg> [-i ...] [--list files.txt] [--out-dir dir] [-w width_chars[,width_chars...]] [-h height_chars] [-s charset] [-T tile_height] [-o output.txt] [--layout linear|tiled] [--low-direct] [--full-decode] [--cache-dir dir [--cache-size MB]] [--isa name] [--memo bits] [-P [--prune-budget pct]] [--dump-planes file | --from-planes file] [--tune-file file] [--serve socket | --connect socket [--inline]] [--trace trace.json]\n";
+    std::cout << "  -i may be repeated, name a directory (all images in it) or use * and ? in the file name; --list reads one path per line.\n"
+                 "     With several inputs, decode/resample/render run as an overlapped pipeline; outputs go to --out-dir/<name>.txt,\n"
+                 "     or one after another to -o/stdout. --batch-queue <n> bounds images waiting between stages (default 2),\n"
+                 "     --batch-decoders <n> bounds concurrent decodes (default: worker count)\n";
+    std::cout << "  -w may list several distinct widths (e.g. -w 40,80,160): the image is decoded once, reduced into a 2x box pyramid and every\n"
+                 "     width is resampled from the smallest level that still covers it and rendered in one pass; -o out.txt then\n"
+                 "     writes out.w40.txt, out.w80.txt, ..., otherwise the outputs go to stdout in the order given\n";
     std::cout << "  -s charset: low | high (default low)\n";
-    std::cout << "  -T tile_height: tile height (rows) used for tile-based resampling (default 64)\n";
+    std::cout << "  --low-direct: for -s low, resample straight to one sample per cell instead of 8x8 sub-pixels per cell\n"
+                 "                (much faster; colors differ slightly because box boundaries are per cell)\n";
+    std::cout << "  --full-decode: decode JPEG inputs at full size (by default baseline JPEGs are decoded at 1/2, 1/4 or 1/8 scale\n"
+                 "                 in the DCT domain when that still covers the sampling grid)\n";
+    std::cout << "  --cache-dir <dir>: reuse rendered output for identical input bytes and options from an on-disk cache shared\n"
+                 "                     between processes (--cache-size <MB> bounds it, default 256; least recently used output is evicted first)\n";
+    std::cout << "  -T tile_height: rows per parallel_for chunk in resampling (default 0 = automatic)\n";
     std::cout << "  -p <int>: prune threshold for render_high (sum abs color diff), default 24\n";
-    std::cout << "  -P: run prune threshold sweep (useful for tuning)\n";
+    std::cout << "  --memo <bits>: reuse glyph decisions for repeated 8x8 cells within a frame; cells are keyed by content\n"
+                 "                 with the low <bits> bits dropped (0 = exact, output unchanged). Default off\n";
+    std::cout << "  -P: run prune threshold sweep instead of rendering: reports cells/s, skip ratio and error vs. an unpruned search\n"
+                 "      for each threshold, and recommends the largest threshold within the error budget\n";
+    std::cout << "  --prune-budget <pct>: allowed error increase over the unpruned search for -P, default 1.0\n";
+    std::cout << "  --dump-planes <file>: decode and resample only, and write the sampled planes to <file> (for -s low/high and -P\n"
+                 "                        this is the 8x8 sub-pixel grid; with -s low --low-direct one sample per cell)\n";
+    std::cout << "  --from-planes <file>: render (or -P sweep) from a --dump-planes file instead of -i; the file is memory-mapped\n"
+                 "                        and used as is, and its grid size and layout replace -w/-h/--layout\n";
+    std::cout << "  --tune-file <file>: -P stores the recommended threshold for the image class here; -s high without -p\n"
+                 "                      reads the threshold for the image class from it\n";
+    std::cout << "  --layout linear|tiled: sub-pixel plane layout (tiled = 8x8 cell-contiguous), default linear\n";
+    std::cout << "  --isa scalar|sse41|avx2|avx512: force the SIMD kernel set (default: best supported by this CPU)\n";
+    std::cout << "  --serve <socket>: run as a daemon serving conversions on a Unix domain socket until SIGINT/SIGTERM\n"
+                 "                    (--serve-concurrency <n> requests at once, default 2; --serve-queue <n> ready connections, default 32)\n";
+    std::cout << "  --connect <socket>: send this conversion to a --serve daemon (--inline sends the file bytes instead of its path)\n";
+    std::cout << "  --trace <file>: write per-stage spans as Chrome trace-event JSON\n";
+}
+
+// --serve：常驻进程，在 Unix domain socket 上处理转换请求，直到收到 SIGINT/SIGTERM
+static int run_server(const std::string &socket_path, int concurrency, int queue, int prune_thresh, const std::string &tune_file,
+                      const std::string &cache_dir, int cache_mb) {
+#ifndef _WIN32
+    // 在创建任何线程之前屏蔽信号，由主线程 sigwait 统一处理；客户端断开时的写入错误以返回值处理
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    PicConvertor::TaskSystem pool;
+    pool.preheat();
+    PicConvertor::ConversionServer::Options options;
+    options.socketPath = socket_path;
+    options.maxConcurrent = std::max(1, concurrency);
+    options.maxQueued = std::max(1, queue);
+    options.defaultPrune = prune_thresh;
+    options.tuneFile = tune_file;
+    options.cacheDir = cache_dir;
+    options.cacheBytes = (uint64_t)cache_mb << 20;
+    PicConvertor::ConversionServer server(pool, options);
+    std::string error;
+    if (!server.start(error)) { std::cerr << "Failed to start server: " << error << "\n"; return 5; }
+    std::cerr << "Serving on " << socket_path << " (Ctrl-C to stop)\n";
+#ifndef _WIN32
+    int sig = 0;
+    sigwait(&signals, &sig);
+#endif
+    server.stop();
+    return 0;
+}
+
+// -P 的报告：写到 stdout 与日志，指定 --tune-file 时保存推荐阈值
+static int report_prune_sweep(const PruneSweepResult &result, const std::string &tune_file) {
+    const std::string report = format_prune_sweep(result);
+    std::cout << report;
+    PC_LOG_INFO(report);
+    if (!tune_file.empty()) {
+        if (!save_tuned_threshold(tune_file, result.image_class, result.recommended)) {
+            std::cerr << "Failed to write tune file " << tune_file << "\n";
+            return 3;
+        }
+        std::cout << "Saved prune threshold " << result.recommended << " for class '" << result.image_class << "' to " << tune_file << "\n";
+    }
+    return 0;
+}
+
+// --from-planes：在映射的平面文件上直接渲染或扫描 prune 阈值，不解码、不重采样
+static int run_from_planes(const std::string &path, ConvertOptions opt, bool prune_sweep, double prune_budget_pct,
+                           const std::string &outfile, const std::string &tracefile) {
+    PreparedFrame frame;
+    std::string error;
+    if (!map_planes(path, frame, error)) { std::cerr << error << "\n"; return 2; }
+    if (frame.cells && (opt.charset == Charset::high || prune_sweep)) {
+        std::cerr << path << " holds one sample per cell (--low-direct); only -s low can render it\n";
+        return 1;
+    }
+    opt.out_w = frame.out_w;
+    opt.out_h = frame.out_h;
+    opt.layout = frame.layout;
+    opt.low_direct = frame.cells;
+    PicConvertor::TaskSystem pool;
+    pool.preheat();
+    int rc = 0;
+    if (prune_sweep) {
+        const double budget = prune_budget_pct / 100.0;
+        const PruneSweepResult result = frame.layout == PlaneLayout::Tiled8x8
+            ? run_prune_sweep(frame.tiled, frame.out_w, frame.out_h, pool, default_prune_sweep_thresholds(), budget)
+            : run_prune_sweep(frame.linear, frame.out_w, frame.out_h, pool, default_prune_sweep_thresholds(), budget);
+        rc = report_prune_sweep(result, opt.tune_file);
+    } else {
+        std::unique_ptr<PicConvertor::FdSink> file_sink;
+        if (!outfile.empty()) {
+            file_sink = PicConvertor::FdSink::openFile(outfile);
+            if (!file_sink) { std::cerr << "Failed to open output file\n"; return 3; }
+        }
+        PicConvertor::OutputSink &sink = file_sink ? static_cast<PicConvertor::OutputSink&>(*file_sink) : PicConvertor::FdSink::standardOutput();
+        const RenderStreamStats stats = render_frame(frame, opt, pool, sink);
+        PC_LOG_INFO(format_worker_report(stats));
+        if (!stats.ok) { std::cerr << "Failed to write output\n"; return 3; }
+    }
+    if (!tracefile.empty()) {
+        pool.stop();
+        if (!PicConvertor::Tracer::getInstance().writeChromeJson(tracefile)) return 4;
+    }
+    return rc;
+}
+
+// -w 解析：逗号分隔的一个或多个互不相同的正整数（重复的宽度会映射到同一个输出文件，末尾不能有空项）
+static bool parse_widths(const char *arg, std::vector<int> &widths) {
+    widths.clear();
+    const char *p = arg;
+    while (*p) {
+        char *end = nullptr;
+        const long w = strtol(p, &end, 10);
+        if (end == p || w <= 0 || w > 4096 || (*end != ',' && *end != '\0')) return false;
+        if (*end == ',' && end[1] == '\0') return false;
+        if (std::find(widths.begin(), widths.end(), (int)w) != widths.end()) return false;
+        widths.push_back((int)w);
+        p = *end ? end + 1 : end;
+    }
+    return !widths.empty();
+}
+
+// 多宽度输出的文件名：在扩展名之前插入 .w<宽度>
+static std::string width_output_path(const std::string &outfile, int width) {
+    const size_t slash = outfile.find_last_of("/\\");
+    const size_t dot = outfile.find_last_of('.');
+    const size_t at = (dot == std::string::npos || (slash != std::string::npos && dot < slash)) ? outfile.size() : dot;
+    return outfile.substr(0, at) + ".w" + std::to_string(width) + outfile.substr(at);
+}
+
+// --connect：把本次转换交给 --serve 进程，输出写入 stdout 或 -o
+static int run_client(const std::string &socket_path, PicConvertor::ServeRequest request, bool send_inline, const std::string &infile, const std::string &outfile) {
+#ifndef _WIN32
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    if (send_inline) {
+        std::ifstream in(infile, std::ios::binary);
+        if (!in) { std::cerr << "Failed to read " << infile << "\n"; return 2; }
+        request.data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        request.inlineData = true;
+    } else {
+        // 服务端的工作目录与客户端不同，发送绝对路径
+#ifndef _WIN32
+        char resolved[PATH_MAX];
+        request.data = realpath(infile.c_str(), resolved) ? std::string(resolved) : infile;
+#else
+        request.data = infile;
+#endif
+    }
+    std::unique_ptr<PicConvertor::FdSink> file_sink;
+    if (!outfile.empty()) {
+        file_sink = PicConvertor::FdSink::openFile(outfile);
+        if (!file_sink) { std::cerr << "Failed to open output file\n"; return 3; }
+    }
+    PicConvertor::OutputSink &sink = file_sink ? static_cast<PicConvertor::OutputSink&>(*file_sink) : PicConvertor::FdSink::standardOutput();
+    PicConvertor::ServeClient client;
+    std::string error;
+    if (!client.connect(socket_path, error)) { std::cerr << error << "\n"; return 5; }
+    PicConvertor::ServeResult result;
+    if (!client.request(request, sink, result)) { std::cerr << "Connection to " << socket_path << " lost\n"; return 5; }
+    if (!result.outputOk) { std::cerr << "Failed to write output\n"; return 3; }
+    if (result.status != PicConvertor::ServeStatus::Ok) {
+        std::cerr << "Server error " << (uint32_t)result.status << ": " << result.message << "\n";
+        return 6;
+    }
+    return 0;
 }
 
 int main(int argc, char** argv) {
+#ifdef _WIN32
     // 确保控制台使用 UTF-8 编码
     SetConsoleOutputCP(65001);
     SetConsoleCP(65001);
-    std::ios_base::sync_with_stdio(false);
 
     // 启用虚拟终端处理以支持 ANSI 转义（Windows 10+）。若不可用则静默回退以保持兼容性。
 #ifndef ENABLE_VIRTUAL_TERMINAL_PROCESSING
@@ -40,6 +246,9 @@ int main(int argc, char** argv) {
             SetConsoleMode(hOut, dwMode);
         }
     }
+#endif
+    std::ios_base::sync_with_stdio(false);
+    Stopwatch since_start; // 用于报告 time-to-first-row
 
     if (argc < 2) { print_usage(); return 1; }
 
@@ -47,65 +256,299 @@ int main(int argc, char** argv) {
     PicConvertor::Logger::getInstance().initialize("picconvertor.log");
     PC_LOG_INFO(std::string("Program started. Input: ") + (argc>1?argv[1]:""));
     std::string infile;
+    std::vector<std::string> input_args;
+    std::string list_file;
+    BatchOptions batch_opt;
     std::string outfile;
+    std::string tracefile;
     int out_w = 80;
+    std::vector<int> widths{out_w};
     int out_h = 0;
     std::string charset_str = "shading";
     bool dither = false; // 为向后兼容保留，但 low/high 不使用
-    int tile_h = 64; // 默认 tile height
+    int tile_h = 0; // 默认自动选择 parallel_for 粒度
     int prune_thresh = 24; // 默认 pruning 阈值
+    bool prune_thresh_given = false;
+    bool prune_sweep = false;
+    double prune_budget_pct = 1.0;
+    std::string tune_file;
+    int memo_quant = -1; // 单元 memo 默认关闭
+    bool low_direct = false;
+    bool full_decode = false;
+    std::string cache_dir;
+    int cache_mb = 256;
+    std::string planes_out;
+    std::string planes_in;
+    std::string serve_path;
+    std::string connect_path;
+    bool send_inline = false;
+    int serve_concurrency = 2;
+    int serve_queue = 32;
+    PlaneLayout layout = PlaneLayout::Linear;
+    std::string isa_str;
     for (int i=1;i<argc;i++) {
-        if (strcmp(argv[i],"-i")==0 && i+1<argc) infile = argv[++i];
+        if (strcmp(argv[i],"-i")==0 && i+1<argc) input_args.push_back(argv[++i]);
+        else if (strcmp(argv[i],"--list")==0 && i+1<argc) list_file = argv[++i];
+        else if (strcmp(argv[i],"--out-dir")==0 && i+1<argc) batch_opt.out_dir = argv[++i];
+        else if (strcmp(argv[i],"--batch-queue")==0 && i+1<argc) batch_opt.decoded_depth = batch_opt.frame_depth = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i],"--batch-decoders")==0 && i+1<argc) batch_opt.decode_inflight = std::max(1, atoi(argv[++i]));
         else if (strcmp(argv[i],"-o")==0 && i+1<argc) outfile = argv[++i];
-        else if (strcmp(argv[i],"-w")==0 && i+1<argc) out_w = atoi(argv[++i]);
+        else if (strcmp(argv[i],"-w")==0 && i+1<argc) {
+            if (!parse_widths(argv[++i], widths)) { print_usage(); return 1; }
+            out_w = widths.front();
+        }
         else if (strcmp(argv[i],"-h")==0 && i+1<argc) out_h = atoi(argv[++i]);
         else if (strcmp(argv[i],"-s")==0 && i+1<argc) charset_str = argv[++i];
         else if (strcmp(argv[i],"-T")==0 && i+1<argc) tile_h = atoi(argv[++i]);
-        else if (strcmp(argv[i],"-p")==0 && i+1<argc) prune_thresh = atoi(argv[++i]);
+        else if (strcmp(argv[i],"-p")==0 && i+1<argc) { prune_thresh = atoi(argv[++i]); prune_thresh_given = true; }
+        else if (strcmp(argv[i],"-P")==0) prune_sweep = true;
+        else if (strcmp(argv[i],"--low-direct")==0) low_direct = true;
+        else if (strcmp(argv[i],"--full-decode")==0) full_decode = true;
+        else if (strcmp(argv[i],"--dump-planes")==0 && i+1<argc) planes_out = argv[++i];
+        else if (strcmp(argv[i],"--from-planes")==0 && i+1<argc) planes_in = argv[++i];
+        else if (strcmp(argv[i],"--cache-dir")==0 && i+1<argc) cache_dir = argv[++i];
+        else if (strcmp(argv[i],"--cache-size")==0 && i+1<argc) cache_mb = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i],"--serve")==0 && i+1<argc) serve_path = argv[++i];
+        else if (strcmp(argv[i],"--serve-concurrency")==0 && i+1<argc) serve_concurrency = atoi(argv[++i]);
+        else if (strcmp(argv[i],"--serve-queue")==0 && i+1<argc) serve_queue = atoi(argv[++i]);
+        else if (strcmp(argv[i],"--connect")==0 && i+1<argc) connect_path = argv[++i];
+        else if (strcmp(argv[i],"--inline")==0) send_inline = true;
+        else if (strcmp(argv[i],"--prune-budget")==0 && i+1<argc) prune_budget_pct = std::max(0.0, atof(argv[++i]));
+        else if (strcmp(argv[i],"--tune-file")==0 && i+1<argc) tune_file = argv[++i];
+        else if (strcmp(argv[i],"--memo")==0 && i+1<argc) memo_quant = std::max(0, std::min(7, atoi(argv[++i])));
+        else if (strcmp(argv[i],"--layout")==0 && i+1<argc) {
+            std::string v = argv[++i];
+            if (v == "linear") layout = PlaneLayout::Linear;
+            else if (v == "tiled") layout = PlaneLayout::Tiled8x8;
+            else { print_usage(); return 1; }
+        }
+        else if (strcmp(argv[i],"--isa")==0 && i+1<argc) isa_str = argv[++i];
+        else if (strcmp(argv[i],"--trace")==0 && i+1<argc) tracefile = argv[++i];
         else { print_usage(); return 1; }
     }
-    if (infile.empty()) { std::cerr << "No input file specified.\n"; print_usage(); return 1; }
+    // 展开目录/通配符与文件列表；只有一个输入且未指定 --out-dir 时走单图路径
+    std::vector<std::string> inputs;
+    for (const std::string &arg : input_args) {
+        if (!expand_batch_input(arg, inputs)) { std::cerr << "No images match " << arg << "\n"; return 2; }
+    }
+    if (!list_file.empty() && !read_batch_list(list_file, inputs)) { std::cerr << "Failed to read " << list_file << "\n"; return 2; }
+    const bool batch = inputs.size() > 1 || !batch_opt.out_dir.empty();
+    if (!inputs.empty()) infile = inputs.front();
+    if (serve_path.empty() && infile.empty() && planes_in.empty()) { std::cerr << "No input file specified.\n"; print_usage(); return 1; }
+    if (batch && (prune_sweep || !connect_path.empty() || !planes_out.empty())) { std::cerr << "-P, --connect and --dump-planes take a single input.\n"; return 1; }
+    if (!planes_in.empty() && (!inputs.empty() || !planes_out.empty() || !connect_path.empty())) { std::cerr << "--from-planes replaces -i.\n"; return 1; }
+    if (!planes_out.empty() && prune_sweep) { std::cerr << "-P cannot be combined with --dump-planes; run it with --from-planes.\n"; return 1; }
+    const bool multi_width = widths.size() > 1;
+    if (multi_width && (batch || prune_sweep || out_h > 0 || !connect_path.empty() || !serve_path.empty() || !planes_out.empty() || !planes_in.empty())) {
+        std::cerr << "Several widths work only for a single rendered input, without -h.\n";
+        return 1;
+    }
 
-    Image img;
-    if (!img.load_from_file(infile)) return 2;
+    if (!connect_path.empty()) {
+        PicConvertor::ServeRequest request;
+        request.width = out_w;
+        request.height = out_h;
+        request.high = charset_from_string(charset_str) == Charset::high;
+        request.prune = prune_thresh_given ? prune_thresh : -1;
+        request.memo = memo_quant;
+        request.lowDirect = low_direct;
+        request.tiled = layout == PlaneLayout::Tiled8x8;
+        return run_client(connect_path, request, send_inline, infile, outfile);
+    }
 
-    // 若未提供输出高度则计算
-    if (out_h <= 0) {
-        // 近似字符单元纵横比：高度约为宽度的两倍 -> 使用 0.5
-        double aspect = 0.5;
-        out_h = std::max(1, (int)std::round((double)img.height * out_w * aspect / img.width));
+    // kernel 表在首次使用时按 cpuid 选择；--isa 只能降级（用于对比基准）
+    {
+        PicConvertor::Isa isa = PicConvertor::detectIsa();
+        if (!isa_str.empty() && !PicConvertor::parseIsa(isa_str, isa)) { print_usage(); return 1; }
+        if (!PicConvertor::setIsa(isa)) {
+            std::cerr << "ISA " << isa_str << " is not supported on this CPU (max: " << PicConvertor::isaName(PicConvertor::detectIsa()) << ").\n";
+            return 1;
+        }
+    }
+
+    if (!serve_path.empty()) return run_server(serve_path, serve_concurrency, serve_queue, prune_thresh, tune_file, cache_dir, cache_mb);
+
+    // 必须在创建 TaskSystem 之前启用，以便工作线程注册轨道名
+    if (!tracefile.empty()) {
+        PicConvertor::Tracer::getInstance().enable();
+        PicConvertor::Tracer::getInstance().setThreadName("main");
+    }
+
+    ConvertOptions opt;
+    opt.out_w = out_w;
+    opt.out_h = out_h; // 批处理中 <= 0 时按每张图像分别推算
+    opt.charset = charset_from_string(charset_str);
+    opt.prune_threshold = prune_thresh;
+    opt.prune_given = prune_thresh_given;
+    opt.tune_file = tune_file;
+    opt.memo_quant = memo_quant;
+    opt.layout = layout;
+    opt.low_direct = low_direct;
+    opt.tile_h = tile_h;
+    opt.full_decode = full_decode;
+
+    if (!planes_in.empty()) return run_from_planes(planes_in, opt, prune_sweep, prune_budget_pct, outfile, tracefile);
+
+    if (batch) {
+        std::unique_ptr<PicConvertor::FdSink> file_sink;
+        if (batch_opt.out_dir.empty() && !outfile.empty()) {
+            file_sink = PicConvertor::FdSink::openFile(outfile);
+            if (!file_sink) { std::cerr << "Failed to open output file\n"; return 3; }
+        }
+        PicConvertor::OutputSink &sink = file_sink ? static_cast<PicConvertor::OutputSink&>(*file_sink) : PicConvertor::FdSink::standardOutput();
+        PicConvertor::TaskSystem pool;
+        pool.preheat();
+        PC_LOG_INFO("Batch of " + std::to_string(inputs.size()) + " inputs" + (batch_opt.out_dir.empty() ? "" : " -> " + batch_opt.out_dir));
+        const BatchStats stats = run_batch(inputs, opt, batch_opt, pool, &sink);
+        file_sink.reset();
+        const std::string summary = format_batch_stats(stats);
+        std::cerr << summary;
+        PC_LOG_INFO(summary + "peak RSS: " + std::to_string(PicConvertor::peakRssBytes() / 1024) + " KB");
+        if (!tracefile.empty()) {
+            pool.stop();
+            if (!PicConvertor::Tracer::getInstance().writeChromeJson(tracefile)) return 4;
+        }
+        if (!stats.ok) return 3;
+        return stats.failed > 0 ? 2 : 0;
+    }
+
+    // 输出在渲染过程中按行带顺序流式写出，不拼接完整字符串
+    std::unique_ptr<PicConvertor::FdSink> file_sink;
+    if (!prune_sweep && planes_out.empty() && !multi_width && !outfile.empty()) {
+        file_sink = PicConvertor::FdSink::openFile(outfile);
+        if (!file_sink) { std::cerr << "Failed to open output file\n"; return 3; }
     }
+    PicConvertor::OutputSink &sink = file_sink ? static_cast<PicConvertor::OutputSink&>(*file_sink) : PicConvertor::FdSink::standardOutput();
 
-    Charset cs = charset_from_string(charset_str);
-    std::string rendered;
-    // 两种模式均对每字符使用 8x8 high-res 采样
-    // 提前创建 TaskSystem，以便线程创建与重采样工作并行
+    // --cache-dir：按输入字节与选项查找已渲染的输出，命中时不创建线程池、不解码
+    PicConvertor::RenderCache cache;
+    PicConvertor::MappedFile input;
+    PicConvertor::RenderCacheKey cache_key;
+    Stopwatch cache_sw;
+    if (!cache_dir.empty() && !prune_sweep && planes_out.empty() && !multi_width) {
+        PicConvertor::RenderCache::Options cache_opt;
+        cache_opt.dir = cache_dir;
+        cache_opt.maxBytes = (uint64_t)cache_mb << 20;
+        std::string error;
+        if (!cache.open(cache_opt, error)) std::cerr << "Render cache disabled: " << error << "\n";
+        else if (!input.open(infile, error)) { std::cerr << error << "\n"; return 2; }
+        if (cache.isOpen()) {
+            PC_TRACE_SCOPE("cache_lookup");
+            cache_key = PicConvertor::RenderCache::makeKey(input.data(), input.size(), render_options_hash(opt));
+            bool sink_ok = true;
+            if (cache.lookup(cache_key, sink, &sink_ok)) {
+                if (!sink_ok) { std::cerr << "Failed to write output\n"; return 3; }
+                file_sink.reset();
+                PC_LOG_INFO("Render cache hit in " + std::to_string(cache_sw.elapsed_us()) + "us; " + std::to_string(since_start.elapsed_us()) + "us since start");
+                PC_LOG_INFO(cache.formatStats());
+                if (!tracefile.empty() && !PicConvertor::Tracer::getInstance().writeChromeJson(tracefile)) return 4;
+                return 0;
+            }
+        }
+    }
+
+    // 提前创建 TaskSystem，以便线程创建与解码、重采样工作并行
     PicConvertor::TaskSystem pool;
     pool.preheat();
     Stopwatch sw;
     PC_LOG_INFO("TaskSystem created and preheated, elapsed: " + std::to_string(sw.elapsed_us()) + "us; tile_h=" + std::to_string(tile_h));
 
-    auto t0 = Stopwatch();
-    auto high_planes = resample_to_planes_fast(img, out_w*8, out_h*8, pool, tile_h, -1);
-    PC_LOG_INFO("Resample completed in " + std::to_string(t0.elapsed_us()) + "us");
+    Image img;
+    {
+        PC_TRACE_SCOPE("load");
+        ConvertOptions decode_opt = opt;
+        if (prune_sweep) decode_opt.low_direct = false; // -P 总是使用 8x8 子像素平面
+        decode_opt.out_w = *std::max_element(widths.begin(), widths.end()); // 多宽度时按最大的宽度解码
+        const DecodeHint hint = decode_hint(decode_opt, &pool);
+        const bool loaded = input.data() ? img.load_from_memory(input.data(), input.size(), hint) : img.load_from_file(infile, hint);
+        if (!loaded) return 2;
+    }
 
-    if (cs == Charset::high) {
-        Stopwatch tr;
-        rendered = render_high(high_planes, out_w, out_h, pool, prune_thresh, nullptr, false);
-        PC_LOG_INFO("render_high completed in " + std::to_string(tr.elapsed_us()) + "us (prune=" + std::to_string(prune_thresh) + ")");
-    } else {
-        Stopwatch tr;
-        rendered = render_low(high_planes, out_w, out_h);
-        PC_LOG_INFO("render_low completed in " + std::to_string(tr.elapsed_us()) + "us");
+    // 多个宽度：共享一个金字塔，一次提交全部目标。写文件时各目标直接流式写出，写 stdout 时按给定顺序拼接
+    if (multi_width) {
+        std::vector<std::unique_ptr<PicConvertor::FdSink>> files;
+        std::vector<std::string> buffers(widths.size());
+        std::vector<std::unique_ptr<PicConvertor::StringSink>> string_sinks;
+        std::vector<RenderTarget> targets;
+        for (size_t i = 0; i < widths.size(); ++i) {
+            RenderTarget t;
+            t.out_w = widths[i];
+            if (!outfile.empty()) {
+                files.push_back(PicConvertor::FdSink::openFile(width_output_path(outfile, widths[i])));
+                if (!files.back()) { std::cerr << "Failed to open output file " << width_output_path(outfile, widths[i]) << "\n"; return 3; }
+                t.sink = files.back().get();
+            } else {
+                string_sinks.push_back(std::make_unique<PicConvertor::StringSink>(buffers[i]));
+                t.sink = string_sinks.back().get();
+            }
+            targets.push_back(t);
+        }
+        Stopwatch mw;
+        const std::vector<RenderStreamStats> stats = convert_image_multi(img, opt, targets, pool);
+        for (const RenderStreamStats &st : stats)
+            if (!st.ok) { std::cerr << "Failed to write output\n"; return 3; }
+        files.clear();
+        if (outfile.empty()) {
+            std::vector<PicConvertor::OutputChunk> chunks;
+            for (const std::string &b : buffers) chunks.push_back(PicConvertor::OutputChunk{b.data(), b.size()});
+            if (!PicConvertor::FdSink::standardOutput().write(chunks.data(), chunks.size())) { std::cerr << "Failed to write output\n"; return 3; }
+        }
+        PC_LOG_INFO(std::to_string(widths.size()) + " widths converted in " + std::to_string(mw.elapsed_us()) + "us; peak RSS: "
+                    + std::to_string(PicConvertor::peakRssBytes() / 1024) + " KB");
+        if (!tracefile.empty()) {
+            pool.stop();
+            if (!PicConvertor::Tracer::getInstance().writeChromeJson(tracefile)) return 4;
+        }
+        return 0;
     }
 
-    if (outfile.empty()) {
-        std::cout << rendered;
-    } else {
-        std::ofstream ofs(outfile, std::ios::binary);
-        if (!ofs) { std::cerr << "Failed to open output file\n"; return 3; }
-        ofs << rendered;
-        ofs.close();
+    // 若未提供输出高度则计算
+    if (out_h <= 0) out_h = default_out_height(img, out_w);
+
+    // -P：只扫描 prune 阈值并输出报告，不渲染
+    if (prune_sweep) {
+        auto sweep = [&](auto layout_tag) {
+            constexpr PlaneLayout L = decltype(layout_tag)::value;
+            auto high_planes = resample_to_planes_fast<L>(img, out_w*8, out_h*8, pool, tile_h);
+            return run_prune_sweep(high_planes, out_w, out_h, pool, default_prune_sweep_thresholds(), prune_budget_pct / 100.0);
+        };
+        PruneSweepResult result = layout == PlaneLayout::Tiled8x8 ? sweep(std::integral_constant<PlaneLayout, PlaneLayout::Tiled8x8>{})
+                                                                   : sweep(std::integral_constant<PlaneLayout, PlaneLayout::Linear>{});
+        return report_prune_sweep(result, tune_file);
+    }
+    opt.out_h = out_h;
+    // --dump-planes：只解码与重采样，渲染留给 --from-planes
+    if (!planes_out.empty()) {
+        const PreparedFrame frame = prepare_frame(img, opt, pool);
+        std::string error;
+        if (!save_planes(planes_out, frame, error)) { std::cerr << error << "\n"; return 3; }
+        if (!tracefile.empty()) {
+            pool.stop();
+            if (!PicConvertor::Tracer::getInstance().writeChromeJson(tracefile)) return 4;
+        }
+        return 0;
+    }
+    const uint64_t convert_start_us = since_start.elapsed_us();
+    // 未命中时在流式写出的同时收集输出，成功后写入缓存；超过缓存单条上限的输出不复制
+    std::string cache_copy;
+    PicConvertor::TeeSink tee(sink, cache_copy, cache.maxEntryBytes());
+    RenderStreamStats stream_stats = convert_image(img, opt, pool, cache.isOpen() ? static_cast<PicConvertor::OutputSink&>(tee) : sink);
+    const uint64_t convert_first_row_us = stream_stats.first_row_us;
+    stream_stats.first_row_us += convert_start_us;
+
+    PC_LOG_INFO(format_worker_report(stream_stats));
+    if (!stream_stats.ok) { std::cerr << "Failed to write output\n"; return 3; }
+    file_sink.reset();
+    if (cache.isOpen()) {
+        if (!tee.overflowed()) cache.store(cache_key, cache_copy, cache_sw.elapsed_us());
+        PC_LOG_INFO(cache.formatStats());
+    }
+    PC_LOG_INFO("Time to first row: " + std::to_string(stream_stats.first_row_us) + "us since start (conversion +" + std::to_string(convert_first_row_us) + "us); peak pending output: "
+                + std::to_string(stream_stats.peak_pending_bytes) + " bytes; peak RSS: " + std::to_string(PicConvertor::peakRssBytes() / 1024) + " KB");
+
+    if (!tracefile.empty()) {
+        pool.stop(); // 确保工作线程不再写入事件缓冲区
+        if (!PicConvertor::Tracer::getInstance().writeChromeJson(tracefile)) return 4;
     }
 
     return 0;
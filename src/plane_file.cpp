@@ -0,0 +1,120 @@
+#include "plane_file.h"
+#include "MappedFile.h"
+#include "Logger.h"
+#include "timing.h"
+#include <cstring>
+#include <fstream>
+#include <memory>
+
+namespace {
+
+constexpr char kMagic[8] = {'P', 'C', 'P', 'L', 'A', 'N', 'E', 'S'};
+constexpr uint32_t kVersion = 1;
+constexpr size_t kHeaderBytes = 128;
+constexpr size_t kAlign = 64;
+constexpr int kMaxCells = 1 << 16;
+
+struct PlaneFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t layout;        // PlaneLayout
+    uint32_t cell_samples;  // 每个字符单元每个方向的采样数：8（子像素）或 1（low_direct 的单元分辨率）
+    int32_t out_w;          // 字符网格
+    int32_t out_h;
+    int32_t width;          // 平面尺寸 = out_w*cell_samples × out_h*cell_samples
+    int32_t height;
+    uint32_t reserved;
+    uint64_t plane_bytes;   // 每个通道的字节数（BlockPlanesT::storage_size）
+    uint64_t offsets[3];    // r、g、b 的文件偏移
+};
+static_assert(sizeof(PlaneFileHeader) <= kHeaderBytes, "plane file header must fit in kHeaderBytes");
+
+size_t align_up(size_t n) { return (n + kAlign - 1) / kAlign * kAlign; }
+
+template<PlaneLayout L>
+bool write_planes(const std::string &path, const BlockPlanesT<L> &planes, const PreparedFrame &frame, std::string &error) {
+    PlaneFileHeader h{};
+    std::memcpy(h.magic, kMagic, sizeof(kMagic));
+    h.version = kVersion;
+    h.layout = (uint32_t)L;
+    h.cell_samples = frame.cells ? 1 : 8;
+    h.out_w = frame.out_w;
+    h.out_h = frame.out_h;
+    h.width = planes.width;
+    h.height = planes.height;
+    h.plane_bytes = planes.storage_size();
+    for (int c = 0; c < 3; ++c) h.offsets[c] = kHeaderBytes + (uint64_t)c * align_up(h.plane_bytes);
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) { error = "cannot create " + path; return false; }
+    char header[kHeaderBytes] = {};
+    std::memcpy(header, &h, sizeof(h));
+    out.write(header, sizeof(header));
+    static const char zeros[kAlign] = {};
+    const PixelBuffer *channels[3] = {&planes.r, &planes.g, &planes.b};
+    for (const PixelBuffer *c : channels) {
+        out.write(reinterpret_cast<const char *>(c->data()), (std::streamsize)h.plane_bytes);
+        out.write(zeros, (std::streamsize)(align_up(h.plane_bytes) - h.plane_bytes));
+    }
+    out.flush();
+    if (!out) { error = "failed to write " + path; return false; }
+    return true;
+}
+
+template<PlaneLayout L>
+void borrow_planes(BlockPlanesT<L> &planes, const PlaneFileHeader &h, const std::shared_ptr<PicConvertor::MappedFile> &file) {
+    // 映射为只读（PROT_READ）；渲染器只读取通道，PixelBuffer 的非 const 指针不会被写入
+    uint8_t *base = const_cast<uint8_t *>(file->data());
+    planes.width = h.width;
+    planes.height = h.height;
+    planes.r.adopt(base + h.offsets[0], h.plane_bytes, nullptr);
+    planes.g.adopt(base + h.offsets[1], h.plane_bytes, nullptr);
+    planes.b.adopt(base + h.offsets[2], h.plane_bytes, nullptr);
+    planes.backing = file;
+}
+
+} // namespace
+
+bool save_planes(const std::string &path, const PreparedFrame &frame, std::string &error) {
+    Stopwatch sw;
+    const bool ok = frame.layout == PlaneLayout::Tiled8x8 && !frame.cells
+        ? write_planes(path, frame.tiled, frame, error)
+        : write_planes(path, frame.linear, frame, error);
+    if (ok) PC_LOGF_INFO("Planes {}x{} ({} bytes) written to {} in {}us", frame.out_w, frame.out_h, frame.bytes(), path, sw.elapsed_us());
+    return ok;
+}
+
+bool map_planes(const std::string &path, PreparedFrame &frame, std::string &error) {
+    auto file = std::make_shared<PicConvertor::MappedFile>();
+    if (!file->open(path, error)) return false;
+    PlaneFileHeader h{};
+    if (file->size() < kHeaderBytes) { error = path + ": not a plane file"; return false; }
+    std::memcpy(&h, file->data(), sizeof(h));
+    if (std::memcmp(h.magic, kMagic, sizeof(kMagic)) != 0) { error = path + ": not a plane file"; return false; }
+    if (h.version != kVersion) { error = path + ": unsupported plane file version " + std::to_string(h.version); return false; }
+
+    // 校验尺寸与偏移，映射后渲染器按 width/height 直接索引通道
+    const bool tiled = h.layout == (uint32_t)PlaneLayout::Tiled8x8;
+    const int s = (int)h.cell_samples;
+    bool valid = (h.layout == (uint32_t)PlaneLayout::Linear || tiled) && (s == 8 || (s == 1 && !tiled))
+                 && h.out_w > 0 && h.out_h > 0 && h.out_w <= kMaxCells && h.out_h <= kMaxCells
+                 && h.width == h.out_w * s && h.height == h.out_h * s;
+    if (valid) {
+        const uint64_t expected = tiled ? (uint64_t)((h.width + 7) / 8) * ((h.height + 7) / 8) * 64 : (uint64_t)h.width * h.height;
+        valid = h.plane_bytes == expected;
+        for (int c = 0; c < 3 && valid; ++c)
+            valid = h.offsets[c] >= kHeaderBytes && h.offsets[c] % kAlign == 0 && h.offsets[c] <= file->size()
+                    && h.plane_bytes <= file->size() - h.offsets[c];
+    }
+    if (!valid) { error = path + ": corrupt plane file header"; return false; }
+
+    frame = PreparedFrame();
+    frame.out_w = h.out_w;
+    frame.out_h = h.out_h;
+    frame.layout = tiled ? PlaneLayout::Tiled8x8 : PlaneLayout::Linear;
+    frame.cells = s == 1;
+    if (tiled) borrow_planes(frame.tiled, h, file);
+    else borrow_planes(frame.linear, h, file);
+    PC_LOGF_INFO("Planes {}x{} ({}{}) mapped from {}", frame.out_w, frame.out_h, tiled ? "tiled" : "linear", frame.cells ? ", cell resolution" : "", path);
+    return true;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include "convert.h"
+#include <string>
+
+// 平面文件（--dump-planes / --from-planes）：重采样结果（PreparedFrame）的二进制形式，
+// 调参（-p、-s、-P）或在另一台机器上渲染时不必重新解码、重采样。
+// 布局：128 字节文件头（魔数、版本、平面布局、字符网格与平面尺寸、各通道的偏移与长度），
+// 随后为 r、g、b 三个通道，各自按 64 字节对齐、按 BlockPlanesT 的存储顺序原样存放；
+// 多字节字段为本机字节序，读取时以魔数与版本校验。
+
+// 写出 frame 中已填充的平面；失败时返回 false 并写入 error
+bool save_planes(const std::string &path, const PreparedFrame &frame, std::string &error);
+
+// 只读映射 path 并校验文件头，frame 的平面直接指向映射中的通道（不解析、不复制），映射随平面一同释放。
+// 布局与是否为单元分辨率取自文件
+bool map_planes(const std::string &path, PreparedFrame &frame, std::string &error);
@@ -0,0 +1,183 @@
+#include "prune_tuner.h"
+#include "renderer.h"
+#include "glyph_eval.h"
+#include "cell_memo.h"
+#include "timing.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+// 码位在终端中显示的前景形状：第 dy*8+dx 位为 1 表示该子像素显示 fg。
+// 注意 glyph search 的候选码位沿用原表（例如左侧 k+1 列的字形映射到 U+2588+k），
+// 这里按码位的真实形状计算，度量的是用户实际看到的误差
+uint64_t display_mask(int code) {
+    auto rows = [](int r0, int r1) { uint64_t m = 0; for (int y = r0; y < r1; ++y) m |= 0xFFull << (8 * y); return m; };
+    auto cols = [](int c0, int c1) { uint64_t m = 0; for (int y = 0; y < 8; ++y) for (int x = c0; x < c1; ++x) m |= 1ull << (8 * y + x); return m; };
+    const uint64_t ul = rows(0, 4) & cols(0, 4), ur = rows(0, 4) & cols(4, 8);
+    const uint64_t ll = rows(4, 8) & cols(0, 4), lr = rows(4, 8) & cols(4, 8);
+    if (code == 0x2580) return rows(0, 4);
+    if (code >= 0x2581 && code <= 0x2588) return rows(8 - (code - 0x2580), 8);
+    if (code >= 0x2589 && code <= 0x258F) return cols(0, 8 - (code - 0x2588));
+    switch (code) {
+        case 0x2590: return cols(4, 8);
+        case 0x2594: return rows(0, 1);
+        case 0x2595: return cols(7, 8);
+        case 0x2596: return ll;
+        case 0x2597: return lr;
+        case 0x2598: return ul;
+        case 0x2599: return ul | ll | lr;
+        case 0x259A: return ul | lr;
+        case 0x259B: return ul | ur | ll;
+        case 0x259C: return ul | ur | lr;
+        case 0x259D: return ur;
+        case 0x259E: return ur | ll;
+        case 0x259F: return ur | ll | lr;
+        default: return 0; // 空格：只显示背景
+    }
+}
+
+template<PlaneLayout L>
+double display_error(const BlockPlanesT<L> &planes, int out_w, int out_h, const std::vector<CellChoice> &choices) {
+    uint8_t px[kCellKeyBytes];
+    double total = 0;
+    for (int cy = 0; cy < out_h; ++cy) {
+        for (int cx = 0; cx < out_w; ++cx) {
+            const CellChoice &c = choices[(size_t)cy * out_w + cx];
+            gather_cell_key(planes, cx, cy, 0, px);
+            const uint64_t mask = display_mask(c.cp);
+            const int fg[3] = {c.fr, c.fg, c.fb}, bg[3] = {c.br, c.bg, c.bb};
+            int64_t cell = 0;
+            for (int ch = 0; ch < 3; ++ch) {
+                for (int i = 0; i < 64; ++i) {
+                    const int d = (int)px[ch * 64 + i] - ((mask >> i) & 1 ? fg[ch] : bg[ch]);
+                    cell += d * d;
+                }
+            }
+            total += (double)cell;
+        }
+    }
+    return total;
+}
+
+} // namespace
+
+std::vector<int> default_prune_sweep_thresholds() {
+    return {0, 4, 8, 12, 16, 24, 32, 48, 64, 96};
+}
+
+template<PlaneLayout L>
+const char* classify_planes(const BlockPlanesT<L> &planes) {
+    // 每 4 行取一行，统计相邻子像素亮度差的平均值
+    uint64_t sum = 0, n = 0;
+    for (int y = 0; y < planes.height; y += 4) {
+        for (int x = 1; x < planes.width; ++x) {
+            const size_t a = planes.index(x - 1, y), b = planes.index(x, y);
+            const int la = planes.r[a] * 2 + planes.g[a] * 5 + planes.b[a];
+            const int lb = planes.r[b] * 2 + planes.g[b] * 5 + planes.b[b];
+            sum += (uint64_t)std::abs(la - lb);
+            ++n;
+        }
+    }
+    const double grad = n ? (double)sum / (double)n / 8.0 : 0.0;
+    if (grad < 2.0) return "flat";
+    if (grad < 10.0) return "photo";
+    return "detailed";
+}
+
+template<PlaneLayout L>
+PruneSweepResult run_prune_sweep(const BlockPlanesT<L> &planes, int out_w, int out_h, PicConvertor::TaskSystem &pool,
+                                 const std::vector<int> &thresholds, double error_budget, int rounds) {
+    PruneSweepResult result;
+    result.image_class = classify_planes(planes);
+    result.error_budget = error_budget;
+    const size_t cells = (size_t)out_w * out_h;
+
+    std::vector<CellChoice> exhaustive(cells), choices(cells);
+    render_high(planes, out_w, out_h, pool, 0, nullptr, true, -1, exhaustive.data());
+    result.exhaustive_error = display_error(planes, out_w, out_h, exhaustive);
+
+    for (int t : thresholds) {
+        PruneSweepPoint p;
+        p.threshold = t;
+        // 第一轮收集统计与单元选择，之后的轮次只计时
+        PruneStats stats;
+        double best_us = 1e300;
+        for (int r = 0; r < std::max(1, rounds); ++r) {
+            Stopwatch sw;
+            if (r == 0) render_high(planes, out_w, out_h, pool, t, &stats, true, -1, choices.data());
+            else render_high(planes, out_w, out_h, pool, t, nullptr, true);
+            best_us = std::min(best_us, (double)std::max<uint64_t>(1, sw.elapsed_us()));
+        }
+        p.cells_per_sec = (double)cells * 1e6 / best_us;
+        const uint64_t considered = stats.get(kCandidatesConsidered);
+        p.skip_ratio = considered ? (double)stats.get(kCandidatesSkipped) / (double)considered : 0.0;
+        p.flat_ratio = cells ? (double)stats.get(kFlatCells) / (double)cells : 0.0;
+        p.sq_error = display_error(planes, out_w, out_h, choices);
+        p.error_increase = result.exhaustive_error > 0 ? p.sq_error / result.exhaustive_error - 1.0 : (p.sq_error > 0 ? 1.0 : 0.0);
+        size_t changed = 0;
+        for (size_t i = 0; i < cells; ++i) changed += choices[i].cp != exhaustive[i].cp;
+        p.changed_cells = cells ? (double)changed / (double)cells : 0.0;
+        result.points.push_back(p);
+    }
+    // 误差随阈值不一定单调：取从最小阈值起连续满足预算的最后一个
+    std::vector<PruneSweepPoint> sorted = result.points;
+    std::sort(sorted.begin(), sorted.end(), [](const PruneSweepPoint &a, const PruneSweepPoint &b) { return a.threshold < b.threshold; });
+    for (const auto &p : sorted) {
+        if (p.error_increase > error_budget) break;
+        result.recommended = p.threshold;
+    }
+    return result;
+}
+
+std::string format_prune_sweep(const PruneSweepResult &result) {
+    std::ostringstream os;
+    char line[160];
+    std::snprintf(line, sizeof(line), "Prune sweep (image class: %s, exhaustive error %.4g, budget +%.2f%%)\n",
+                  result.image_class.c_str(), result.exhaustive_error, result.error_budget * 100.0);
+    os << line;
+    os << "  thresh   Mcells/s   skipped   flat    error     +err%   changed\n";
+    for (const auto &p : result.points) {
+        std::snprintf(line, sizeof(line), "  %6d %10.2f %8.1f%% %5.1f%% %9.4g %8.3f%% %8.2f%%%s\n", p.threshold, p.cells_per_sec / 1e6,
+                      p.skip_ratio * 100.0, p.flat_ratio * 100.0, p.sq_error, p.error_increase * 100.0, p.changed_cells * 100.0,
+                      p.threshold == result.recommended ? "  <- recommended" : "");
+        os << line;
+    }
+    return os.str();
+}
+
+bool load_tuned_threshold(const std::string &path, const std::string &image_class, int &threshold) {
+    std::ifstream in(path);
+    if (!in) return false;
+    std::string cls;
+    int t = 0;
+    while (in >> cls >> t) {
+        if (cls == image_class) { threshold = t; return true; }
+    }
+    return false;
+}
+
+bool save_tuned_threshold(const std::string &path, const std::string &image_class, int threshold) {
+    std::vector<std::pair<std::string, int>> entries;
+    {
+        std::ifstream in(path);
+        std::string cls;
+        int t = 0;
+        while (in >> cls >> t) {
+            if (cls != image_class) entries.emplace_back(cls, t);
+        }
+    }
+    entries.emplace_back(image_class, threshold);
+    std::ofstream out(path, std::ios::trunc);
+    if (!out) return false;
+    for (const auto &e : entries) out << e.first << ' ' << e.second << '\n';
+    return (bool)out;
+}
+
+template const char* classify_planes<PlaneLayout::Linear>(const BlockPlanesT<PlaneLayout::Linear> &);
+template const char* classify_planes<PlaneLayout::Tiled8x8>(const BlockPlanesT<PlaneLayout::Tiled8x8> &);
+template PruneSweepResult run_prune_sweep<PlaneLayout::Linear>(const BlockPlanesT<PlaneLayout::Linear> &, int, int, PicConvertor::TaskSystem &, const std::vector<int> &, double, int);
+template PruneSweepResult run_prune_sweep<PlaneLayout::Tiled8x8>(const BlockPlanesT<PlaneLayout::Tiled8x8> &, int, int, PicConvertor::TaskSystem &, const std::vector<int> &, double, int);
@@ -0,0 +1,50 @@
+#pragma once
+#include "resample.h"
+#include <string>
+#include <vector>
+
+namespace PicConvertor { class TaskSystem; } // forward
+
+// prune_threshold 的扫描与自动调优（-P）：重采样一次，对每个阈值以 measure_only 运行 render_high，
+// 与不剪枝的穷举搜索（阈值 0，严格 < 比较下不剪去任何候选）比较输出误差，按误差预算推荐阈值。
+//
+// 误差按终端实际显示的结果计算：每个单元按字形码位的显示形状取 fg/bg，
+// 与 8×8 子像素逐通道求平方差之和。
+
+// 单个阈值的结果
+struct PruneSweepPoint {
+    int threshold = 0;
+    double cells_per_sec = 0;
+    double skip_ratio = 0;        // 被剪枝的候选比例（PruneStats）
+    double flat_ratio = 0;        // 走低方差快速路径的单元比例
+    double sq_error = 0;          // 全图显示误差（平方和）
+    double error_increase = 0;    // 相对穷举搜索的误差增量比例：sq_error / exhaustive - 1
+    double changed_cells = 0;     // 与穷举搜索相比字形（码位）改变的单元比例
+};
+
+struct PruneSweepResult {
+    std::string image_class;      // classify_planes 的结果，调优结果按类别持久化
+    double exhaustive_error = 0;
+    double error_budget = 0;
+    std::vector<PruneSweepPoint> points;
+    int recommended = 0;          // 从小到大连续满足误差预算的最大阈值（至少为 0）
+};
+
+// 默认扫描的阈值（包含默认值 24）
+std::vector<int> default_prune_sweep_thresholds();
+
+// 按子像素亮度的平均水平梯度粗分图像类别："flat"（图形/界面）、"photo"、"detailed"（纹理/噪声）
+template<PlaneLayout L>
+const char* classify_planes(const BlockPlanesT<L> &planes);
+
+// error_budget 为允许的相对误差增量（0.01 = 比穷举搜索多 1%）；每个阈值计时 rounds 轮取最快
+template<PlaneLayout L>
+PruneSweepResult run_prune_sweep(const BlockPlanesT<L> &planes, int out_w, int out_h, PicConvertor::TaskSystem &pool,
+                                 const std::vector<int> &thresholds, double error_budget, int rounds = 3);
+
+// 表格形式的扫描报告（每个阈值一行，最后给出推荐值）
+std::string format_prune_sweep(const PruneSweepResult &result);
+
+// 调优文件：每行 "<类别> <阈值>"。load 找不到文件或类别时返回 false；save 更新该类别并保留其他行
+bool load_tuned_threshold(const std::string &path, const std::string &image_class, int &threshold);
+bool save_tuned_threshold(const std::string &path, const std::string &image_class, int threshold);
@@ -3,39 +3,100 @@
 #include <string>
 #include <vector>
 
-namespace PicConvertor { class TaskSystem; } // forward
+namespace PicConvertor { class TaskSystem; class OutputSink; } // forward
 
 // 新的简洁模式：
 // - low：每字符单元的纯 background-color 映射（视觉更简洁）
 // - high：使用 horizontal/vertical/quadrant glyphs 的高精度子像素映射
 enum class Charset { low, high };
 
+// 渲染输出格式版本：glyph 集合、颜色量化或转义序列的输出有变化时递增，使 --cache-dir 中的旧结果失效
+constexpr int kRenderOutputVersion = 1;
+
 // Low：仅背景渲染器。highres_blocks 应采样为 (out_w*8) × (out_h*8)
-std::string render_low(const BlockPlanes &highres, int out_w, int out_h);
+// 两个渲染器均按 BlockPlanesT 的布局模板化，renderer.cpp 中为 Linear/Tiled8x8 显式实例化
+template<PlaneLayout L>
+std::string render_low(const BlockPlanesT<L> &highres, int out_w, int out_h);
+
+// 单个线程在一次渲染中的负载：busy_us 为渲染行带（含写出）的累计时间，其余时间为空闲/等待
+struct WorkerLoad {
+    uint64_t busy_us = 0;
+    uint32_t bands = 0;
+    uint32_t rows = 0;
+};
+
+// 流式渲染的统计：first_row_us 为从开始渲染到第一块输出写入 sink 的微秒数，
+// peak_pending_bytes 为等待按序写出的乱序行带占用的最大字节数，ok 为 false 表示 sink 写入失败。
+// workers[0] 为调用线程，workers[i] 为 TaskSystem 的第 i-1 个工作线程；wall_us 为整个行带阶段的墙钟时间。
+// other 汇总其他非工作线程（它们在等待自己的 parallel_for 时可能顺带执行本次的行带）
+struct RenderStreamStats {
+    uint64_t first_row_us = 0;
+    size_t peak_pending_bytes = 0;
+    bool ok = true;
+    uint64_t wall_us = 0;
+    int band_rows = 0;
+    std::vector<WorkerLoad> workers;
+    WorkerLoad other;
+};
+
+// 每线程 busy/idle 利用率报告（多行文本，供日志输出）
+std::string format_worker_report(const RenderStreamStats &stats);
+
+// 流式版本：按行带并行渲染，完成的行带按顺序直接写入 sink，不拼接完整输出
+template<PlaneLayout L>
+RenderStreamStats render_low(const BlockPlanesT<L> &highres, int out_w, int out_h, PicConvertor::TaskSystem &pool, PicConvertor::OutputSink &sink);
+
+// Low 的直接采样版本：cells 为单元分辨率（out_w × out_h，见 resample_to_cells）的平面，每个样本即单元背景色。
+// 不经过 8×8 子像素，重采样的写入量与 render_low 的读取量都只有 1/64；框边界与取整只发生一次，颜色可能与 8×8 路径相差 1 级
+RenderStreamStats render_low_cells(const BlockPlanes &cells, PicConvertor::TaskSystem &pool, PicConvertor::OutputSink &sink);
 
 // High：advanced renderer，使用 subpixel masks 和 glyph search。highres_blocks 应采样为 (out_w*8) × (out_h*8)
 // 现在接受一个 TaskSystem 引用（在 main 中创建）用于并行化
-#include <atomic>
-
-struct PruneStats {
-    std::atomic<uint64_t> total_cells{0};
-    std::atomic<uint64_t> candidates_considered{0};
-    std::atomic<uint64_t> candidates_skipped{0};
-    std::atomic<uint64_t> evaluations{0};
-    // 累计微秒计时器，用于定位 SIMD 优化热点
-    std::atomic<uint64_t> prune_check_us{0};
-    std::atomic<uint64_t> eval_us{0};
+#include "Instrumentation.h"
+
+struct CellChoice;
+
+// PruneStats 的计数器与直方图下标
+enum PruneCounter : size_t {
+    kTotalCells,
+    kCandidatesConsidered,
+    kCandidatesSkipped,
+    kEvaluations,
+    kFlatCells,      // 低方差快速路径的单元数（glyph_eval.h）
+    kMemoLookups,    // memo 关闭时为 0
+    kMemoHits,
+    kPruneCounterCount
+};
+enum PruneHistogram : size_t {
+    kRowSearchNs,    // 采样的单行 glyph search 耗时（含矩计算与 memo），每线程每 kSamplePeriod 行计时一次
+    kPruneHistogramCount
+};
+
+// render_high 的统计：每个线程写自己的分片（见 Instrumentation.h），渲染结束后合并读取。
+// stats 为 nullptr 或以 PICCONV_INSTRUMENTATION=0 构建时，渲染路径中不包含任何探针
+struct PruneStats : PicConvertor::ThreadShardedStats<kPruneCounterCount, kPruneHistogramCount> {
+    uint64_t get(PruneCounter c) const { return counter(c); }
+    // 由采样耗时外推的 glyph search 总耗时（微秒）
+    uint64_t estimated_search_us() const {
+        return histogram(kRowSearchNs).sum * PicConvertor::kSamplePeriod / 1000;
+    }
 };
 
 // High：advanced renderer，使用 subpixel masks 和 glyph search。highres_blocks 应采样为 (out_w*8) × (out_h*8)
 // prune_threshold：用于快速 pruning 的通道绝对差之和阈值
 // measure_only：为 true 时不组装字符串，仅收集统计与代价
-std::string render_high(const BlockPlanes &highres, int out_w, int out_h, PicConvertor::TaskSystem &pool, int prune_threshold = 24, PruneStats* stats = nullptr, bool measure_only = false);
+// choices_out：非空时写入每个单元的选择（out_w × out_h，行主序），供 prune_tuner 比较剪枝前后的结果
+// memo_quant：< 0 关闭单元 memo；>= 0 时以丢弃低 memo_quant 位后的 8×8 内容为键在帧内复用 glyph search 结果
+//             （0 为逐位相同才复用，输出不变；> 0 时单元按量化后的内容渲染）
+template<PlaneLayout L>
+std::string render_high(const BlockPlanesT<L> &highres, int out_w, int out_h, PicConvertor::TaskSystem &pool, int prune_threshold = 24, PruneStats* stats = nullptr, bool measure_only = false, int memo_quant = -1, CellChoice* choices_out = nullptr);
+
+// 流式版本（见 render_low 的流式重载）
+template<PlaneLayout L>
+RenderStreamStats render_high(const BlockPlanesT<L> &highres, int out_w, int out_h, PicConvertor::TaskSystem &pool, PicConvertor::OutputSink &sink, int prune_threshold = 24, PruneStats* stats = nullptr, int memo_quant = -1);
 
-// 快速重采样辅助：用于从图像构建 highres_blocks
-std::vector<Block> resample_to_blocks_fast(const Image &img, int out_w, int out_h);
-BlockPlanes resample_to_planes_fast(const Image &img, int out_w, int out_h, PicConvertor::TaskSystem &pool, int tile_h, int tile_h_horiz);
-BlockPlanes resample_to_planes_fast(const Image &img, int out_w, int out_h);
+// PruneStats 的单行摘要（快速路径比例、memo 命中率、剪枝率）
+std::string format_prune_stats(const PruneStats &stats);
 
 // 辅助：从字符串选择 charset
 Charset charset_from_string(const std::string &s);
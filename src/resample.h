@@ -2,6 +2,7 @@
 #include "image.h"
 #include <vector>
 #include <cstdint>
+#include <memory>
 
 namespace PicConvertor { class TaskSystem; }
 
@@ -10,24 +11,81 @@ struct Block {
     double luminance; // perceived luminance（感知亮度）
 };
 
+// high-res 子像素平面的存储布局：
+// - Linear：行主序，与 Image 一致
+// - Tiled8x8：8×8 tile 主序，每个字符单元的 64 个子像素连续存放（单元内按行主序）
+enum class PlaneLayout { Linear, Tiled8x8 };
+
 // 用于 high-res blocks 的 Structure-of-arrays 布局（SoA）。宽/高为逻辑网格尺寸（例如 out_w*8 × out_h*8，用于 high 模式采样）。
-struct BlockPlanes {
+// 通道为均值，取值恒在 0..255，因此以 uint8_t 存储（每子像素 3 字节）。
+// 通道缓冲由 allocate 自行分配，或借用 backing 持有的只读内存（例如 map_planes 映射的平面文件，此时不得写入）。只可移动
+template<PlaneLayout L>
+struct BlockPlanesT {
+    static constexpr PlaneLayout layout = L;
     int width = 0;
     int height = 0;
-    std::vector<int> r;
-    std::vector<int> g;
-    std::vector<int> b;
+    PixelBuffer r;
+    PixelBuffer g;
+    PixelBuffer b;
+    std::shared_ptr<const void> backing;
+
+    // Tiled8x8 按整 tile 分配，宽/高不是 8 的倍数时末尾 tile 留有 padding
+    size_t storage_size() const {
+        if constexpr (L == PlaneLayout::Linear) return (size_t)width * height;
+        return (size_t)((width + 7) / 8) * ((height + 7) / 8) * 64;
+    }
+    void allocate(int w, int h) {
+        width = w; height = h;
+        size_t n = storage_size();
+        backing.reset();
+        r.resize(n); g.resize(n); b.resize(n);
+    }
+    // 子像素 (x, y) 在各通道数组中的下标
+    size_t index(int x, int y) const {
+        if constexpr (L == PlaneLayout::Linear) return (size_t)y * width + x;
+        size_t tile = (size_t)(y >> 3) * ((width + 7) >> 3) + (x >> 3);
+        return tile * 64 + (size_t)(y & 7) * 8 + (x & 7);
+    }
+    // 单元 (cx, cy) 第 dy 行 8 个子像素的起始下标；两种布局下这 8 个子像素都连续
+    size_t cell_row(int cx, int cy, int dy) const { return index(cx * 8, cy * 8 + dy); }
 };
 
+using BlockPlanes = BlockPlanesT<PlaneLayout::Linear>;
+using TiledBlockPlanes = BlockPlanesT<PlaneLayout::Tiled8x8>;
+
 // 将图像重采样为宽×高的块网格（朴素实现）
-std::vector<Block> resample_to_blocks(const Image &img, int out_w, int out_h);
+std::vector<Block> resample_to_blocks(ImageView img, int out_w, int out_h);
+
+// SoA 快速重采样辅助（按输出行带流式处理，不保留整幅水平和缓冲）。tile_h 为每个并行块的输出行数，<= 0 时自动选择
+// 模板参数选择输出布局，resample.cpp 中为两种布局显式实例化
+template<PlaneLayout L = PlaneLayout::Linear>
+BlockPlanesT<L> resample_to_planes_fast(ImageView img, int out_w, int out_h);
+template<PlaneLayout L = PlaneLayout::Linear>
+BlockPlanesT<L> resample_to_planes_fast(ImageView img, int out_w, int out_h, PicConvertor::TaskSystem &pool, int tile_h = 0);
+
+// 直接按字符单元分辨率采样（每个单元一个框平均），供不需要子像素细节的 render_low_cells 使用
+inline BlockPlanes resample_to_cells(ImageView img, int out_w, int out_h, PicConvertor::TaskSystem &pool, int tile_h = 0) {
+    return resample_to_planes_fast<PlaneLayout::Linear>(img, out_w, out_h, pool, tile_h);
+}
+
+// 多分辨率金字塔：第 0 级为源图像本身（不复制），第 k 级为第 k-1 级的 2×2 盒式平均（四舍五入；
+// 奇数边长时最后一列/行只平均实际覆盖的像素）。同一图像要采样到多个尺寸时，每个尺寸从仍不小于它的最小一级重采样，
+// 源图像只被完整读取一次。各级保留源图像的 source_width/source_height，default_out_height 的结果不变
+struct ImagePyramid {
+    ImageView base;
+    std::vector<Image> levels; // levels[k - 1] 为第 k 级
+
+    int level_count() const { return 1 + (int)levels.size(); }
+    ImageView level(int k) const;
+    // 宽高均不小于 w × h 的最小一级（第 0 级小于 w × h 时仍返回第 0 级）
+    int best_level(int w, int h) const;
+};
 
-// SoA 快速重采样辅助
-BlockPlanes resample_to_planes_fast(const Image &img, int out_w, int out_h);
-BlockPlanes resample_to_planes_fast(const Image &img, int out_w, int out_h, PicConvertor::TaskSystem &pool, int tile_h = 64, int tile_h_horiz = -1);
+// 构建到仍不小于 min_width × min_height 的最小一级为止；调用方保证 img 的像素在金字塔使用期间有效
+ImagePyramid build_pyramid(ImageView img, int min_width, int min_height, PicConvertor::TaskSystem &pool);
 
 // 使用积分图的快速重采样（对大输出更快）
-std::vector<Block> resample_to_blocks_fast(const Image &img, int out_w, int out_h);
+std::vector<Block> resample_to_blocks_fast(ImageView img, int out_w, int out_h);
 
 // 并行快速重采样变体：使用提供的 TaskSystem 实现按行并行
-std::vector<Block> resample_to_blocks_fast(const Image &img, int out_w, int out_h, PicConvertor::TaskSystem &pool, int tile_h = 64);
+std::vector<Block> resample_to_blocks_fast(ImageView img, int out_w, int out_h, PicConvertor::TaskSystem &pool, int tile_h = 0);
@@ -0,0 +1,164 @@
+#include "simd_kernels.h"
+#if PICCONV_KERNEL_ISA >= PICCONV_ISA_AVX2
+    #include <immintrin.h>
+#elif PICCONV_KERNEL_ISA >= PICCONV_ISA_SSE41
+    #include <smmintrin.h>
+#endif
+
+// ---- 交错 RGB 的水平框求和 kernel（按 ISA 多版本编译，见 simd_kernels.h）----
+// 对从 p 开始的 len 个 RGB 像素按通道求和。SIMD 路径按 3 个向量为一组（恰好覆盖整数个像素）加载，
+// 用与通道相位对应的字节 mask 在寄存器内完成 deinterleave，再用 SAD 对 8 字节组水平求和。
+
+namespace PICCONV_ISA_NS {
+
+static inline void sum_rgb_scalar(const uint8_t* p, int len, uint32_t &r, uint32_t &g, uint32_t &b) {
+    uint32_t sr = 0, sg = 0, sb = 0;
+    for (int i = 0; i < len; ++i) {
+        sr += p[3*i + 0];
+        sg += p[3*i + 1];
+        sb += p[3*i + 2];
+    }
+    r = sr; g = sg; b = sb;
+}
+
+// 第 k 个向量（k = 0..2）中属于通道 c 的字节 mask：字节 j 对应交错流中的位置 (VW*k + j) % 3
+template<int VW>
+struct RgbPhaseMasks {
+    alignas(64) uint8_t m[3][3][VW]; // [k][c][j]
+    RgbPhaseMasks() {
+        for (int k = 0; k < 3; ++k)
+            for (int c = 0; c < 3; ++c)
+                for (int j = 0; j < VW; ++j)
+                    m[k][c][j] = ((VW*k + j) % 3 == c) ? 0xFF : 0x00;
+    }
+};
+
+#if PICCONV_KERNEL_ISA >= PICCONV_ISA_AVX512BW
+static inline void sum_rgb_avx512(const uint8_t* p, int len, uint32_t &r, uint32_t &g, uint32_t &b) {
+    static const RgbPhaseMasks<64> masks;
+    const int nbytes = len * 3;
+    const __m512i zero = _mm512_setzero_si512();
+    __m512i acc[3] = {zero, zero, zero};
+    __m512i mk[3][3];
+    for (int k = 0; k < 3; ++k)
+        for (int c = 0; c < 3; ++c)
+            mk[k][c] = _mm512_load_si512((const void*)masks.m[k][c]);
+    int i = 0;
+    // 每 192 字节（64 像素）三个向量
+    for (; i + 192 <= nbytes; i += 192) {
+        for (int k = 0; k < 3; ++k) {
+            __m512i v = _mm512_loadu_si512((const void*)(p + i + 64*k));
+            for (int c = 0; c < 3; ++c)
+                acc[c] = _mm512_add_epi64(acc[c], _mm512_sad_epu8(_mm512_and_si512(v, mk[k][c]), zero));
+        }
+    }
+    for (int k = 0; i + 64 <= nbytes; i += 64, ++k) {
+        __m512i v = _mm512_loadu_si512((const void*)(p + i));
+        for (int c = 0; c < 3; ++c)
+            acc[c] = _mm512_add_epi64(acc[c], _mm512_sad_epu8(_mm512_and_si512(v, mk[k][c]), zero));
+    }
+    uint64_t sums[3];
+    for (int c = 0; c < 3; ++c) sums[c] = (uint64_t)_mm512_reduce_add_epi64(acc[c]);
+    // 尾部的起点不一定落在像素边界：按字节所属通道累加
+    for (; i < nbytes; ++i) sums[i % 3] += p[i];
+    r = (uint32_t)sums[0]; g = (uint32_t)sums[1]; b = (uint32_t)sums[2];
+}
+
+#endif
+
+#if PICCONV_KERNEL_ISA >= PICCONV_ISA_AVX2
+static inline void sum_rgb_avx2(const uint8_t* p, int len, uint32_t &r, uint32_t &g, uint32_t &b) {
+    static const RgbPhaseMasks<32> masks;
+    const int nbytes = len * 3;
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc[3] = {zero, zero, zero};
+    __m256i mk[3][3];
+    for (int k = 0; k < 3; ++k)
+        for (int c = 0; c < 3; ++c)
+            mk[k][c] = _mm256_load_si256((const __m256i*)masks.m[k][c]);
+    int i = 0;
+    // 每 96 字节（32 像素）三个向量，相位 0/1/2 各用一组 mask
+    for (; i + 96 <= nbytes; i += 96) {
+        for (int k = 0; k < 3; ++k) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(p + i + 32*k));
+            for (int c = 0; c < 3; ++c)
+                acc[c] = _mm256_add_epi64(acc[c], _mm256_sad_epu8(_mm256_and_si256(v, mk[k][c]), zero));
+        }
+    }
+    // 剩余不足 96 字节时，仍可按相位顺序处理完整的 32 字节向量
+    for (int k = 0; i + 32 <= nbytes; i += 32, ++k) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+        for (int c = 0; c < 3; ++c)
+            acc[c] = _mm256_add_epi64(acc[c], _mm256_sad_epu8(_mm256_and_si256(v, mk[k][c]), zero));
+    }
+    uint64_t sums[3];
+    for (int c = 0; c < 3; ++c) {
+        __m128i s = _mm_add_epi64(_mm256_castsi256_si128(acc[c]), _mm256_extracti128_si256(acc[c], 1));
+        sums[c] = (uint64_t)_mm_cvtsi128_si64(s) + (uint64_t)_mm_extract_epi64(s, 1);
+    }
+    // 尾部的起点不一定落在像素边界：按字节所属通道累加
+    for (; i < nbytes; ++i) sums[i % 3] += p[i];
+    r = (uint32_t)sums[0]; g = (uint32_t)sums[1]; b = (uint32_t)sums[2];
+}
+#endif
+
+#if PICCONV_KERNEL_ISA >= PICCONV_ISA_SSE41
+static inline void sum_rgb_sse(const uint8_t* p, int len, uint32_t &r, uint32_t &g, uint32_t &b) {
+    static const RgbPhaseMasks<16> masks;
+    const int nbytes = len * 3;
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc[3] = {zero, zero, zero};
+    __m128i mk[3][3];
+    for (int k = 0; k < 3; ++k)
+        for (int c = 0; c < 3; ++c)
+            mk[k][c] = _mm_load_si128((const __m128i*)masks.m[k][c]);
+    int i = 0;
+    for (; i + 48 <= nbytes; i += 48) {
+        for (int k = 0; k < 3; ++k) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(p + i + 16*k));
+            for (int c = 0; c < 3; ++c)
+                acc[c] = _mm_add_epi64(acc[c], _mm_sad_epu8(_mm_and_si128(v, mk[k][c]), zero));
+        }
+    }
+    for (int k = 0; i + 16 <= nbytes; i += 16, ++k) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+        for (int c = 0; c < 3; ++c)
+            acc[c] = _mm_add_epi64(acc[c], _mm_sad_epu8(_mm_and_si128(v, mk[k][c]), zero));
+    }
+    uint64_t sums[3];
+    for (int c = 0; c < 3; ++c) {
+        sums[c] = (uint64_t)_mm_cvtsi128_si64(acc[c]) + (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(acc[c], acc[c]));
+    }
+    // 尾部的起点不一定落在像素边界：按字节所属通道累加
+    for (; i < nbytes; ++i) sums[i % 3] += p[i];
+    r = (uint32_t)sums[0]; g = (uint32_t)sums[1]; b = (uint32_t)sums[2];
+}
+#endif
+
+// 按框宽选择 kernel：窄框（典型的 2~8 像素）直接标量累加更快
+static inline void sum_rgb_box(const uint8_t* p, int len, uint32_t &r, uint32_t &g, uint32_t &b) {
+#if PICCONV_KERNEL_ISA >= PICCONV_ISA_AVX512BW
+    if (len >= 64) { sum_rgb_avx512(p, len, r, g, b); return; }
+#endif
+#if PICCONV_KERNEL_ISA >= PICCONV_ISA_AVX2
+    if (len >= 16) { sum_rgb_avx2(p, len, r, g, b); return; }
+#endif
+#if PICCONV_KERNEL_ISA >= PICCONV_ISA_SSE41
+    if (len >= 8) { sum_rgb_sse(p, len, r, g, b); return; }
+#endif
+    sum_rgb_scalar(p, len, r, g, b);
+}
+
+// 单行水平框求和到紧凑宽度 (out_w) 缓冲区：直接读取交错的 RGB 行，
+// 在寄存器内 deinterleave 并把三个通道的框和写入 dstR/dstG/dstB
+void horizontal_box_row(const uint8_t* row, const int* x0s, const Run* runs, int run_count,
+                        uint32_t* dstR, uint32_t* dstG, uint32_t* dstB) {
+    for (int ri = 0; ri < run_count; ++ri) {
+        const Run &run = runs[ri];
+        for (int bx = run.start; bx < run.end; ++bx) {
+            sum_rgb_box(row + (size_t)x0s[bx] * 3, run.len, dstR[bx], dstG[bx], dstB[bx]);
+        }
+    }
+}
+
+} // namespace PICCONV_ISA_NS
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// 多版本 SIMD kernel 的公共定义。
+//
+// resample_kernels.cpp、cell_moments.cpp、glyph_eval.cpp 会以不同的目标 ISA 各编译一次
+// （CMake 中的 picconv_kernels_<isa> object 库，定义 PICCONV_KERNEL_ISA），
+// 每次编译的符号放在各自的命名空间 isa_<name> 中，由 CpuDispatch 在启动时按 cpuid 选择。
+// kernel 代码只依据 PICCONV_KERNEL_ISA 选择路径，不依赖编译器的 __AVX2__ 等宏，以便 MSVC 同样适用。
+
+#define PICCONV_ISA_SCALAR 0
+#define PICCONV_ISA_SSE41 1
+#define PICCONV_ISA_AVX2 2
+#define PICCONV_ISA_AVX512BW 3
+
+// 未经多版本构建直接编译某个 kernel TU 时，按编译器的目标选项推断
+#ifndef PICCONV_KERNEL_ISA
+  #if defined(__AVX512F__) && defined(__AVX512BW__)
+    #define PICCONV_KERNEL_ISA PICCONV_ISA_AVX512BW
+  #elif defined(__AVX2__)
+    #define PICCONV_KERNEL_ISA PICCONV_ISA_AVX2
+  #elif defined(__SSE4_1__)
+    #define PICCONV_KERNEL_ISA PICCONV_ISA_SSE41
+  #else
+    #define PICCONV_KERNEL_ISA PICCONV_ISA_SCALAR
+  #endif
+#endif
+
+#if PICCONV_KERNEL_ISA == PICCONV_ISA_AVX512BW
+  #define PICCONV_ISA_NS isa_avx512bw
+#elif PICCONV_KERNEL_ISA == PICCONV_ISA_AVX2
+  #define PICCONV_ISA_NS isa_avx2
+#elif PICCONV_KERNEL_ISA == PICCONV_ISA_SSE41
+  #define PICCONV_ISA_NS isa_sse41
+#else
+  #define PICCONV_ISA_NS isa_scalar
+#endif
+
+struct CellMoments;
+struct CellChoice;
+
+// evaluate_glyphs 的计数：skipped 为被剪枝的候选数，flat 为走低方差快速路径的单元数
+struct GlyphEvalCounts { uint64_t skipped; uint64_t flat; };
+
+// 重采样水平过程中等宽的连续输出框 [start, end)，每框 len 个源像素
+struct Run { int start; int end; int len; };
+
+// 每个 ISA 命名空间中导出的 kernel（签名与 KernelTable 中的函数指针一一对应）
+#define PICCONV_DECLARE_KERNELS(ns)                                                                          \
+    namespace ns {                                                                                           \
+        void horizontal_box_row(const uint8_t* row, const int* x0s, const Run* runs, int run_count,          \
+                                uint32_t* dstR, uint32_t* dstG, uint32_t* dstB);                             \
+        void cell_moments_row(const uint8_t* r, const uint8_t* g, const uint8_t* b,                          \
+                              size_t cell_step, size_t row_stride, int count, CellMoments* out);             \
+        void cell_means_row(const uint8_t* r, const uint8_t* g, const uint8_t* b,                            \
+                            size_t cell_step, size_t row_stride, int count,                                  \
+                            uint8_t* outR, uint8_t* outG, uint8_t* outB);                                    \
+        GlyphEvalCounts evaluate_glyphs(const CellMoments* cells, int count, int prune_threshold, CellChoice* out); \
+    }
@@ -1,22 +1,52 @@
 #pragma once
-#include <windows.h>
+#include <chrono>
 #include <cstdint>
+#if defined(PICCONV_USE_RDTSC)
+  #if defined(_MSC_VER)
+    #include <intrin.h>
+  #else
+    #include <x86intrin.h>
+  #endif
+#endif
 
-// 轻量级高精度计时器，使用 QueryPerformanceCounter（微秒）
-struct Stopwatch {
-    LARGE_INTEGER freq{};
-    LARGE_INTEGER start{};
-    Stopwatch() { QueryPerformanceFrequency(&freq); QueryPerformanceCounter(&start); }
-    void reset() { QueryPerformanceCounter(&start); }
-    uint64_t elapsed_us() const {
-        LARGE_INTEGER t;
-        QueryPerformanceCounter(&t);
-        return (uint64_t)((t.QuadPart - start.QuadPart) * 1000000 / freq.QuadPart);
+// 跨平台高精度时钟。默认基于 std::chrono::steady_clock（tick = 纳秒）；
+// 定义 PICCONV_USE_RDTSC 时改用 rdtsc（tick = TSC 周期，首次使用时对 steady_clock 校准）。
+struct HiResClock {
+#if defined(PICCONV_USE_RDTSC)
+    static uint64_t ticks() { return (uint64_t)__rdtsc(); }
+    static double ticks_per_us() {
+        static const double tpu = calibrate();
+        return tpu;
+    }
+#else
+    static uint64_t ticks() {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
     }
-    static uint64_t now_us() {
-        LARGE_INTEGER f, t;
-        QueryPerformanceFrequency(&f);
-        QueryPerformanceCounter(&t);
-        return (uint64_t)((t.QuadPart * 1000000) / f.QuadPart);
+    static double ticks_per_us() { return 1000.0; }
+#endif
+    static double to_us(uint64_t t) { return (double)t / ticks_per_us(); }
+
+private:
+#if defined(PICCONV_USE_RDTSC)
+    // 约 2ms 忙等待，用 steady_clock 测量 TSC 频率
+    static double calibrate() {
+        using clk = std::chrono::steady_clock;
+        auto c0 = clk::now();
+        uint64_t t0 = (uint64_t)__rdtsc();
+        while (clk::now() - c0 < std::chrono::milliseconds(2)) {}
+        uint64_t t1 = (uint64_t)__rdtsc();
+        auto c1 = clk::now();
+        double us = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(c1 - c0).count() / 1000.0;
+        return us > 0.0 ? (double)(t1 - t0) / us : 1000.0;
     }
-};
\ No newline at end of file
+#endif
+};
+
+// 轻量级高精度计时器（微秒）
+struct Stopwatch {
+    uint64_t start = HiResClock::ticks();
+    void reset() { start = HiResClock::ticks(); }
+    uint64_t elapsed_us() const { return (uint64_t)HiResClock::to_us(HiResClock::ticks() - start); }
+    static uint64_t now_us() { return (uint64_t)HiResClock::to_us(HiResClock::ticks()); }
+};